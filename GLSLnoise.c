@@ -1,712 +1,2626 @@
-/* 
- * Testbed for GLSL fragment noise() functions.
- *
- * Shaders are loaded from two external files:
- * "GLSLnoise.vert" and "GLSLnoise.frag".
- * The program itself draws a spinning sphere
- * with a noise-generated fragment color.
- *
- * This program uses GLFW for convenience, to handle the OS-specific
- * window management stuff. Some Windows-specific stuff for extension
- * loading is still here, but the code should still compile and run
- * on other platforms - function pointer reloading should not hurt. 
- *
- * Author: Stefan Gustavson (stegu@itn.liu.se) 2004, 2005, 2010
- */
-
- /*
-As the original author of this code, I hereby
-release it irrevocably into the public domain.
-Please feel free to use it for whatever you want.
-Credit is appreciated where appropriate, and I also
-appreciate being told where this code finds any use,
-but you may do as you like. Alternatively, if you want
-to have a familiar OSI-approved license, you may use
-This code under the terms of the MIT license:
-
-Copyright (C) 2004, 2005, 2010 by Stefan Gustavson. All rights reserved.
-This code is licensed to you under the terms of the MIT license:
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-*/
-
-#include <stdio.h>
-#include <stdlib.h>
-#define _USE_MATH_DEFINES
-#include <math.h>
-#include <GL/glfw.h>
-
-// The default include file for GL extensions might not be up to date.
-// #include <GL/glext.h>
-#include "glext.h"
-
-// colour ramp image
-#include "out_rgb.h"
-
-/* Global variables for all the nice stuff we need above OpenGL 1.1 */
-#ifdef WIN32
-PFNGLACTIVETEXTUREPROC           glActiveTexture      = NULL;
-#endif
-PFNGLCREATEPROGRAMPROC           glCreateProgram      = NULL;
-PFNGLDELETEPROGRAMPROC           glDeleteProgram      = NULL;
-PFNGLUSEPROGRAMPROC              glUseProgram         = NULL;
-PFNGLCREATESHADERPROC            glCreateShader       = NULL;
-PFNGLDELETESHADERPROC            glDeleteShader       = NULL;
-PFNGLSHADERSOURCEPROC            glShaderSource       = NULL;
-PFNGLCOMPILESHADERPROC           glCompileShader      = NULL;
-PFNGLGETSHADERIVPROC             glGetShaderiv        = NULL;
-PFNGLGETPROGRAMIVPROC            glGetProgramiv       = NULL;
-PFNGLATTACHSHADERPROC            glAttachShader       = NULL;
-PFNGLGETSHADERINFOLOGPROC        glGetShaderInfoLog   = NULL;
-PFNGLGETPROGRAMINFOLOGPROC       glGetProgramInfoLog  = NULL;
-PFNGLLINKPROGRAMPROC             glLinkProgram        = NULL;
-PFNGLGETUNIFORMLOCATIONPROC      glGetUniformLocation = NULL;
-PFNGLUNIFORM3FPROC               glUniform3f          = NULL;
-PFNGLUNIFORM4FPROC               glUniform4f          = NULL;
-PFNGLUNIFORM1FPROC               glUniform1f          = NULL;
-PFNGLUNIFORM1IPROC               glUniform1i          = NULL;
-
-/* Some more global variables for convenience. This is C, and I'm lazy. */
-double t0 = 0.0;
-int frames = 0;
-char titlestring[200];
-
-GLuint permTextureID;
-GLuint gradTextureID;
-GLuint diffTextureID;
-GLuint sphereList;
-GLboolean updateTime = GL_TRUE;
-GLboolean animateObject = GL_TRUE;
-
-GLuint octaves = 8;
-
-GLhandleARB programObj;
-GLhandleARB vertexShader;
-GLhandleARB fragmentShader;
-GLint location_permTexture = -1; 
-GLint location_gradTexture = -1; 
-GLint location_diffTexture = -1; 
-GLint location_time = -1;
-GLint location_octavesIn = -1;
-GLint location_frequency = -1;
-
-const char *vertexShaderStrings[1];
-const char *fragmentShaderStrings[1];
-GLint vertexCompiled;
-GLint fragmentCompiled;
-GLint shadersLinked;
-char str[4096]; // For error messages from the GLSL compiler and linker
-
-int perm[256]= {151,160,137,91,90,15,
-  131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
-  190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
-  88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
-  77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
-  102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
-  135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
-  5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
-  223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
-  129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
-  251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
-  49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
-  138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180};
-
-/* These are Ken Perlin's proposed gradients for 3D noise. I kept them for
-   better consistency with the reference implementation, but there is really
-   no need to pad this to 16 gradients for this particular implementation.
-   If only the "proper" first 12 gradients are used, they can be extracted
-   from the grad4[][] array: grad3[i][j] == grad4[i*2][j], 0<=i<=11, j=0,1,2
-*/
-int grad3[16][3] = {{0,1,1},{0,1,-1},{0,-1,1},{0,-1,-1},
-                   {1,0,1},{1,0,-1},{-1,0,1},{-1,0,-1},
-                   {1,1,0},{1,-1,0},{-1,1,0},{-1,-1,0}, // 12 cube edges
-                   {1,0,-1},{-1,0,-1},{0,-1,1},{0,1,1}}; // 4 more to make 16
-
-/* These are my own proposed gradients for 4D noise. They are the coordinates
-   of the midpoints of each of the 32 edges of a tesseract, just like the 3D
-   noise gradients are the midpoints of the 12 edges of a cube.
-*/
-int grad4[32][4]= {{0,1,1,1}, {0,1,1,-1}, {0,1,-1,1}, {0,1,-1,-1}, // 32 tesseract edges
-                   {0,-1,1,1}, {0,-1,1,-1}, {0,-1,-1,1}, {0,-1,-1,-1},
-                   {1,0,1,1}, {1,0,1,-1}, {1,0,-1,1}, {1,0,-1,-1},
-                   {-1,0,1,1}, {-1,0,1,-1}, {-1,0,-1,1}, {-1,0,-1,-1},
-                   {1,1,0,1}, {1,1,0,-1}, {1,-1,0,1}, {1,-1,0,-1},
-                   {-1,1,0,1}, {-1,1,0,-1}, {-1,-1,0,1}, {-1,-1,0,-1},
-                   {1,1,1,0}, {1,1,-1,0}, {1,-1,1,0}, {1,-1,-1,0},
-                   {-1,1,1,0}, {-1,1,-1,0}, {-1,-1,1,0}, {-1,-1,-1,0}};
-
-/*
- * printError() - Signal an error. MessageBox() is a Windows-specific function,
- * rewrite this to print the error message to the console to make it portable!
- */
-void printError(const char *errtype, const char *errmsg) {
-  fprintf(stderr, "%s: %s\n", errtype, errmsg);
-}
-
-
-/*
- * Override the Win32 filelength() function with
- * a version that takes a Unix-style file handle as
- * input instead of a file ID number, and which works
- * on platforms other than Windows.
- */
-long filelength(FILE *file) {
-    long numbytes;
-    long savedpos = ftell(file);
-    fseek(file, 0, SEEK_END);
-    numbytes = ftell(file);
-    fseek(file, savedpos, SEEK_SET);
-    return numbytes;
-}
-
-
-/*
- * loadExtensions() - Load OpenGL extensions for anything above OpenGL
- * version 1.1. (This is a requirement from Windows, not from OpenGL.)
- */
-void loadExtensions() {
-    //These extension strings indicate that the OpenGL Shading Language
-    // and GLSL shader objects are supported.
-    if(!glfwExtensionSupported("GL_ARB_shading_language_100"))
-    {
-        printError("GL init error", "GL_ARB_shading_language_100 extension was not found");
-        return;
-    }
-    if(!glfwExtensionSupported("GL_ARB_shader_objects"))
-    {
-        printError("GL init error", "GL_ARB_shader_objects extension was not found");
-        return;
-    }
-    else
-    {
-#ifdef WIN32
-        glActiveTexture           = (PFNGLACTIVETEXTUREPROC)glfwGetProcAddress("glActiveTexture");
-#endif
-        glCreateProgram           = (PFNGLCREATEPROGRAMPROC)glfwGetProcAddress("glCreateProgram");
-        glDeleteProgram           = (PFNGLDELETEPROGRAMPROC)glfwGetProcAddress("glDeleteProgram");
-        glUseProgram              = (PFNGLUSEPROGRAMPROC)glfwGetProcAddress("glUseProgram");
-        glCreateShader            = (PFNGLCREATESHADERPROC)glfwGetProcAddress("glCreateShader");
-        glDeleteShader            = (PFNGLDELETESHADERPROC)glfwGetProcAddress("glDeleteShader");
-        glShaderSource            = (PFNGLSHADERSOURCEPROC)glfwGetProcAddress("glShaderSource");
-        glCompileShader           = (PFNGLCOMPILESHADERPROC)glfwGetProcAddress("glCompileShader");
-        glGetShaderiv             = (PFNGLGETSHADERIVPROC)glfwGetProcAddress("glGetShaderiv");
-        glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)glfwGetProcAddress("glGetShaderInfoLog");
-        glAttachShader            = (PFNGLATTACHSHADERPROC)glfwGetProcAddress("glAttachShader");
-        glLinkProgram             = (PFNGLLINKPROGRAMPROC)glfwGetProcAddress("glLinkProgram");
-        glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)glfwGetProcAddress("glGetProgramiv");
-        glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)glfwGetProcAddress("glGetProgramInfoLog");
-        glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)glfwGetProcAddress("glGetUniformLocation");
-        glUniform3f               = (PFNGLUNIFORM3FPROC)glfwGetProcAddress("glUniform3f");
-        glUniform4f               = (PFNGLUNIFORM4FPROC)glfwGetProcAddress("glUniform4f");
-        glUniform1f               = (PFNGLUNIFORM1FPROC)glfwGetProcAddress("glUniform1f");
-        glUniform1i               = (PFNGLUNIFORM1IPROC)glfwGetProcAddress("glUniform1i");
-
-        if( !glActiveTexture || !glCreateProgram || !glDeleteProgram || !glUseProgram ||
-            !glCreateShader || !glDeleteShader || !glShaderSource || !glCompileShader || 
-            !glGetShaderiv || !glGetShaderInfoLog || !glAttachShader || !glLinkProgram ||
-            !glGetProgramiv || !glGetProgramInfoLog || !glGetUniformLocation ||
-            !glUniform4f || !glUniform1f || !glUniform1i )
-        {
-            printError("GL init error", "One or more required OpenGL functions were not found");
-            return;
-        }
-    }
-}
-
-
-/*
- * readShaderFile(filename) - read a shader source string from a file
- */
-unsigned char* readShaderFile(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if(file == NULL)
-    {
-        printError("ERROR", "Cannot open shader file!");
-  		  return 0;
-    }
-    int bytesinfile = filelength(file);
-    unsigned char *buffer = (unsigned char*)malloc(bytesinfile+1);
-    int bytesread = fread( buffer, 1, bytesinfile, file);
-    buffer[bytesread] = 0; // Terminate the string with 0
-    fclose(file);
-    
-    return buffer;
-}
-
-
-/*
- * createShaders() - create, load, compile and link the GLSL shader objects.
- */
-void createShaders() {
-	  // Create the vertex shader.
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-
-    unsigned char *vertexShaderAssembly = readShaderFile("test.vert");
-    vertexShaderStrings[0] = (char*)vertexShaderAssembly;
-    glShaderSource( vertexShader, 1, vertexShaderStrings, NULL );
-    glCompileShader( vertexShader);
-    free((void *)vertexShaderAssembly);
-
-    glGetShaderiv( vertexShader, GL_COMPILE_STATUS,
-                               &vertexCompiled );
-    if(vertexCompiled  == GL_FALSE)
-  	{
-        glGetShaderInfoLog(vertexShader, sizeof(str), NULL, str);
-        printError("Vertex shader compile error", str);
-  	}
-
-  	// Create the fragment shader.
-    fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
-
-    unsigned char *fragmentShaderAssembly = readShaderFile( "test.frag" );
-    fragmentShaderStrings[0] = (char*)fragmentShaderAssembly;
-    glShaderSource( fragmentShader, 1, fragmentShaderStrings, NULL );
-    glCompileShader( fragmentShader );
-    free((void *)fragmentShaderAssembly);
-
-    glGetProgramiv( fragmentShader, GL_COMPILE_STATUS, 
-                               &fragmentCompiled );
-    if(fragmentCompiled == GL_FALSE)
-   	{
-        glGetShaderInfoLog( fragmentShader, sizeof(str), NULL, str );
-        printError("Fragment shader compile error", str);
-    }
-
-    // Create a program object and attach the two compiled shaders.
-    programObj = glCreateProgram();
-    glAttachShader( programObj, vertexShader );
-    glAttachShader( programObj, fragmentShader );
-
-    // Link the program object and print out the info log.
-    glLinkProgram( programObj );
-    glGetProgramiv( programObj, GL_LINK_STATUS, &shadersLinked );
-
-    if( shadersLinked == GL_FALSE )
-	{
-		glGetProgramInfoLog( programObj, sizeof(str), NULL, str );
-		printError("Program object linking error", str);
-	}
-	// Locate the uniform shader variables so we can set them later:
-    // a texture ID ("permTexture") and a float ("time").
-	location_permTexture = glGetUniformLocation( programObj, "permTexture" );
-	if(location_permTexture == -1)
-    printError("Binding error","Failed to locate uniform variable 'permTexture'.");
-    // This is not needed for the 2D and 3D noise variants.
-    location_gradTexture = glGetUniformLocation( programObj, "gradTexture" );
-	/*
-    if(location_gradTexture == -1)
-      printError("Binding error","Failed to locate uniform variable 'gradTexture'.");
-    */
-	location_diffTexture = glGetUniformLocation( programObj, "diffuse" );
-	location_octavesIn = glGetUniformLocation( programObj, "octavesIn" );
-	location_frequency = glGetUniformLocation( programObj, "frequency" );
-    // This is not used for the 2D noise demo.
-    location_time = glGetUniformLocation( programObj, "time" );
-    /*
-	if(location_time == -1)
-      printError("Binding error", "Failed to locate uniform variable 'time'.");
-    */
-}
-
-
-/*
- * showFPS() - Calculate and report frames per second
- * (updated once per second) in the window title bar
- */
-void showFPS() {
-
-    double t, fps;
-    
-    // Get current time
-    t = glfwGetTime();  // Gets number of seconds since glfwInit()
-    // If one second has passed, or if this is the very first frame
-    if( (t-t0) > 1.0 || frames == 0 )
-    {
-        fps = (double)frames / (t-t0);
-        sprintf(titlestring, "GLSL Perlin noise (%.1f FPS), %u octaves", fps, octaves);
-        glfwSetWindowTitle(titlestring);
-        t0 = t;
-        frames = 0;
-    }
-    frames ++;
-}
-
-
-/*
- * setupCamera() - set up the OpenGL projection and (model)view matrices
- */
-void setupCamera() {
-
-    int width, height;
-    
-    // Get window size. It may start out different from the requested
-    // size, and will change if the user resizes the window.
-    glfwGetWindowSize( &width, &height );
-    if(height<=0) height=1; // Safeguard against iconified/closed window
-
-    // Set viewport. This is the pixel rectangle we want to draw into.
-    glViewport( 0, 0, width, height ); // The entire window
-
-    // Select and setup the projection matrix.
-    glMatrixMode(GL_PROJECTION); // "We want to edit the projection matrix"
-    glLoadIdentity(); // Reset the matrix to identity
-    // 45 degrees FOV, same aspect ratio as viewport, depth range 1 to 100
-    gluPerspective( 45.0f, (GLfloat)width/(GLfloat)height, 1.0f, 100.0f );
-
-    // Select and setup the modelview matrix.
-    glMatrixMode( GL_MODELVIEW ); // "We want to edit the modelview matrix"
-    glLoadIdentity(); // Reset the matrix to identity
-    // Look from 0,-4,0 towards 0,0,0 with Z as "up" in the image
-    gluLookAt( 0.0f, -4.0f, 0.0f,  // Eye position
-               0.0f, 0.0f, 0.0f,   // View point
-               0.0f, 0.0f, 1.0f ); // Up vector
-}
-
-
-/*
- * drawTexturedSphere(r, segs) - Draw a sphere centered on the local
- * origin, with radius "r" and approximated by "segs" polygon segments,
- * with texture coordinates in a latitude-longitude mapping.
- */
-void drawTexturedSphere(float r, int segs) {
-  int i, j;
-  float x, y, z, z1, z2, R, R1, R2;
-
-  // Top cap
-  glBegin(GL_TRIANGLE_FAN);
-  glNormal3f(0,0,1);
-  glTexCoord2f(0.5f,1.0f); // This is an ugly (u,v)-mapping singularity
-  glVertex3f(0,0,r);
-  z = cos(M_PI/segs);
-  R = sin(M_PI/segs);
-    for(i = 0; i <= 2*segs; i++) {
-      x = R*cos(i*2.0*M_PI/(2*segs));
-      y = R*sin(i*2.0*M_PI/(2*segs));
-      glNormal3f(x, y, z);
-      glTexCoord2f((float)i/(2*segs), 1.0f-1.0f/segs);
-      glVertex3f(r*x, r*y, r*z);
-    }
-  glEnd();  
-
-  // Height segments
-  for(j = 1; j < segs-1; j++) {
-    z1 = cos(j*M_PI/segs);
-    R1 = sin(j*M_PI/segs);
-    z2 = cos((j+1)*M_PI/segs);
-    R2 = sin((j+1)*M_PI/segs);
-    glBegin(GL_TRIANGLE_STRIP);
-    for(i = 0; i <= 2*segs; i++) {
-      x = R1*cos(i*2.0*M_PI/(2*segs));
-      y = R1*sin(i*2.0*M_PI/(2*segs));
-      glNormal3f(x, y, z1);
-      glTexCoord2f((float)i/(2*segs), 1.0f-(float)j/segs);
-      glVertex3f(r*x, r*y, r*z1);
-      x = R2*cos(i*2.0*M_PI/(2*segs));
-      y = R2*sin(i*2.0*M_PI/(2*segs));
-      glNormal3f(x, y, z2);
-      glTexCoord2f((float)i/(2*segs), 1.0f-(float)(j+1)/segs);
-      glVertex3f(r*x, r*y, r*z2);
-    }
-    glEnd();
-  }
-
-  // Bottom cap
-  glBegin(GL_TRIANGLE_FAN);
-  glNormal3f(0,0,-1);
-  glTexCoord2f(0.5f, 1.0f); // This is an ugly (u,v)-mapping singularity
-  glVertex3f(0,0,-r);
-  z = -cos(M_PI/segs);
-  R = sin(M_PI/segs);
-    for(i = 2*segs; i >= 0; i--) {
-      x = R*cos(i*2.0*M_PI/(2*segs));
-      y = R*sin(i*2.0*M_PI/(2*segs));
-      glNormal3f(x, y, z);
-      glTexCoord2f(1.0f-(float)i/(2*segs), 1.0f/segs);
-      glVertex3f(r*x, r*y, r*z);
-    }
-  glEnd();
-}
-
-
-/*
- * initSphereList(GLuint *listID, GLdouble scale) - create a display list
- * to render the sphere more efficently than calling lots of trigonometric
- * functions for each frame.
- * (A vertex array could be even faster, but I'm a bit lazy here.)
- */
-void initSphereList(GLuint *listID, GLdouble scale)
-{
-  *listID = glGenLists(1);
-  
-  glNewList(*listID, GL_COMPILE);
-  drawTexturedSphere(scale, 20);
-  glEndList();
-}
-
-
-/*
- * initPermTexture(GLuint *texID) - create and load a 2D texture for
- * a combined index permutation and gradient lookup table.
- * This texture is used for 2D and 3D noise, both classic and simplex.
- */
-void initPermTexture(GLuint *texID)
-{
-  char *pixels;
-  int i,j;
-  
-  glGenTextures(1, texID); // Generate a unique texture ID
-  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 0
-
-  pixels = (char*)malloc( 256*256*4 );
-  for(i = 0; i<256; i++)
-    for(j = 0; j<256; j++) {
-      int offset = (i*256+j)*4;
-      char value = perm[(j+perm[i]) & 0xFF];
-      pixels[offset] = grad3[value & 0x0F][0] * 64 + 64;   // Gradient x
-      pixels[offset+1] = grad3[value & 0x0F][1] * 64 + 64; // Gradient y
-      pixels[offset+2] = grad3[value & 0x0F][2] * 64 + 64; // Gradient z
-      pixels[offset+3] = value;                     // Permuted index
-    }
-  
-  // GLFW texture loading functions won't work here - we need GL_NEAREST lookup.
-  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-}
-
-/*
- * initGradTexture(GLuint *texID) - create and load a 2D texture
- * for a 4D gradient lookup table. This is used for 4D noise only.
- */
-void initGradTexture(GLuint *texID)
-{
-  char *pixels;
-  int i,j;
-  
-  glActiveTexture( GL_TEXTURE1 ); // Activate a different texture unit (unit 1)
-
-  glGenTextures(1, texID); // Generate a unique texture ID
-  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 2
-
-  pixels = (char*)malloc( 256*256*4 );
-  for(i = 0; i<256; i++)
-    for(j = 0; j<256; j++) {
-      int offset = (i*256+j)*4;
-      char value = perm[(j+perm[i]) & 0xFF];
-      pixels[offset] = grad4[value & 0x1F][0] * 64 + 64;   // Gradient x
-      pixels[offset+1] = grad4[value & 0x1F][1] * 64 + 64; // Gradient y
-      pixels[offset+2] = grad4[value & 0x1F][2] * 64 + 64; // Gradient z
-      pixels[offset+3] = grad4[value & 0x1F][3] * 64 + 64; // Gradient w
-    }
-  
-  // GLFW texture loading functions won't work here - we need GL_NEAREST lookup.
-  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-
-  glActiveTexture( GL_TEXTURE0 ); // Switch active texture unit back to 0 again
-}
-
-/*
- * initDiffTexture(GLuint *texID) - create and load a 2D texture for
- * a combined index permutation and gradient lookup table.
- * This texture is used for 2D and 3D noise, both classic and simplex.
- */
-void initDiffTexture(GLuint *texID)
-{
-  glActiveTexture( GL_TEXTURE2 ); // Activate a different texture unit (unit 2)
-  
-  glGenTextures(1, texID); // Generate a unique texture ID
-  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 2
-  
-  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, 256, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, MagickImage+12 );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-
-  glActiveTexture( GL_TEXTURE0 ); // Switch active texture unit back to 0 again
-}
-
-
-
-/*
- * drawScene(float t) - the actual drawing commands to render our scene.
- */
-void drawScene(float t) {
-    glRotatef(30.0f, 1.0f, 0.0f, 0.0f); // Rotate the view somewhat
-    glPushMatrix(); // Transforms to animate the light:
-      glRotatef(30.0f*t, 0.0f, 0.0f, 1.0f);
-      glTranslatef(5.0f, 0.0f, 0.0f); // Orbit around Z, 5 units from origin
-      float lightpos0[4]={0.0f, 0.0f, 0.0f, 1.0f}; // Origin, in hom. coords
-      glLightfv(GL_LIGHT0, GL_POSITION, lightpos0); // Set light position
-    glPopMatrix(); // Revert to initial transform
-    glPushMatrix(); // Transforms to animate the object:
-      glRotatef(45.0f*t, 0.0f, 0.0f, 1.0f); // Spin around Z
-      glColor3f(1.0f, 1.0f, 1.0f); // White base color
-      // Enable lighting and the LIGHT0 we placed before
-      glEnable(GL_LIGHTING);
-      glEnable(GL_LIGHT0);
-      // We have now enabled lighting, so this object is lit.
-      glCallList(sphereList); // Draw a sphere using the display list
-    glPopMatrix(); // Revert to initial transform
-    // Disable lighting again, to prepare for next frame.
-    glDisable(GL_LIGHTING);
-    glDisable(GL_LIGHT0);
-}
-
-
-/*
- * renderScene() - a wrapper to drawScene() to switch shaders on and off
- */
-void renderScene( void )
-{
-  static float t;
-  if (animateObject) t = (float)glfwGetTime(); // Get elapsed time
-	if(GL_TRUE)
-	{
-  	  // Use vertex and fragment shaders.
-	  glUseProgram( programObj );
-	  // Update the uniform time variable.
-      if(( updateTime ) && ( location_time != -1 ))
-    		glUniform1f( location_time, (float)glfwGetTime() );
-	  // Identify the textures to use.
- 	  if( location_permTexture != -1 )
-  		glUniform1i( location_permTexture, 0 ); // Texture unit 0
- 	  if( location_gradTexture != -1 )
-  		glUniform1i( location_gradTexture, 1 ); // Texture unit 1
-	  if( location_diffTexture != -1 )
-  		glUniform1i( location_diffTexture, 2 ); // Texture unit 2
-	  
-	  
-	  if( location_octavesIn != -1 )
-  		glUniform1i( location_octavesIn, octaves ); //
-	  if( location_frequency != -1 )
-  		glUniform3f( location_frequency, 0.5, 1.0, 2.0 ); // 
-		
- 		// Render with the shaders active.
-	  drawScene(t);
-	  // Deactivate the shaders.
-      glUseProgram(0);
-	}
-	else
-	{
-		// Render without shaders.
-		drawScene(t);
-	}
-}
-
-
-/*
- * main(argc, argv) - the standard C entry point for the program
- */
-int main(int argc, char *argv[]) {
-
-    int running = GL_TRUE; // Main loop exits when this is set to GL_FALSE
-    
-    // Initialise GLFW
-    glfwInit();
-
-    // Open the OpenGL window
-    if( !glfwOpenWindow(640, 480, 8,8,8,8, 32,0, GLFW_WINDOW) )
-    {
-        glfwTerminate(); // glfwOpenWindow failed, quit the program.
-        return 1;
-    }
-    
-    // Load the extensions for GLSL - note that this has to be done
-    // *after* the window has been opened, or we won't have a GL context
-    // to query for those extensions and connect to instances of them.
-    loadExtensions();
-
-    // Create the two shaders
-    createShaders();
-
-    // Enable back face culling and Z buffering
-    glEnable(GL_CULL_FACE); // Cull away all back facing polygons
-    glEnable(GL_DEPTH_TEST); // Use the Z buffer
-
-    // Use a dark blue color with A=1 for the background color
-    glClearColor(0.0f, 0.1f, 0.3f, 1.0f);
-
-    glEnable(GL_TEXTURE_1D); // Enable 1D texturing
-    glEnable(GL_TEXTURE_2D); // Enable 2D texturing
-
-    // Create and load the textures (generated, not read from a file)
-    initPermTexture(&permTextureID);
-    initGradTexture(&gradTextureID);
-	initDiffTexture(&diffTextureID);
-    
-    glfwSwapInterval(1); // Wait for screen refresh between frames
-
-    // Compile a display list for the teapot, to render it more quickly
-    initSphereList(&sphereList, 1.0);
-    
-    // Main loop
-    while(running)
-    {
-        // Calculate and update the frames per second (FPS) display
-        showFPS();
-
-        // Clear the color buffer and the depth buffer.
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
- 
-        // Set up the camera projection.
-        setupCamera();
-        
-        // Draw the scene.
-        renderScene();
-
-        // Swap buffers, i.e. display the image and prepare for next frame.
-        glfwSwapBuffers();
-
-        // Decide whether to update the shader "time" variable or not
-        if(glfwGetKey('A')) updateTime = GL_TRUE;
-        if(glfwGetKey('S')) updateTime = GL_FALSE;
-        // Decide whether to animate the rotation for the scene or not
-        if(glfwGetKey('Z')) animateObject = GL_TRUE;
-        if(glfwGetKey('X')) animateObject = GL_FALSE;
-		
-        // Increase / Decrease the number of octaves used in the shader fbm noise
-		static float fLastTime = 0.0f;
-		const float currTime = (float)glfwGetTime();
-		if(currTime - fLastTime > 0.5f) {
-			if(glfwGetKey('Q')) {
-				++octaves;
-				octaves = min(octaves, 32);
-				fLastTime = currTime;
-			}
-			if(glfwGetKey('E')) {
-				--octaves;
-				octaves = max(octaves, 2);
-				fLastTime = currTime;
-			}
-		}
-		
-
-        // Check if the ESC key was pressed or the window was closed.
-        if(glfwGetKey(GLFW_KEY_ESC) || !glfwGetWindowParam(GLFW_OPENED))
-          running = GL_FALSE;
-    }
-
-    // Close the OpenGL window and terminate GLFW.
-    glfwTerminate();
-
-    return 0;
-}
+/* 
+ * Testbed for GLSL fragment noise() functions.
+ *
+ * Shaders are loaded from two external files:
+ * "GLSLnoise.vert" and "GLSLnoise.frag".
+ * The program itself draws a spinning sphere
+ * with a noise-generated fragment color.
+ *
+ * This program uses GLFW for convenience, to handle the OS-specific
+ * window management stuff. Some Windows-specific stuff for extension
+ * loading is still here, but the code should still compile and run
+ * on other platforms - function pointer reloading should not hurt. 
+ *
+ * Author: Stefan Gustavson (stegu@itn.liu.se) 2004, 2005, 2010
+ */
+
+ /*
+As the original author of this code, I hereby
+release it irrevocably into the public domain.
+Please feel free to use it for whatever you want.
+Credit is appreciated where appropriate, and I also
+appreciate being told where this code finds any use,
+but you may do as you like. Alternatively, if you want
+to have a familiar OSI-approved license, you may use
+This code under the terms of the MIT license:
+
+Copyright (C) 2004, 2005, 2010 by Stefan Gustavson. All rights reserved.
+This code is licensed to you under the terms of the MIT license:
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <direct.h>
+#endif
+#define _USE_MATH_DEFINES
+#include <math.h>
+#ifdef HEADLESS
+#include <time.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#else
+#include <GL/glfw.h>
+#endif
+
+// The default include file for GL extensions might not be up to date.
+// #include <GL/glext.h>
+#include "glext.h"
+// Tokens that are newer than the bundled glext.h
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+#ifndef GL_TEXTURE_CUBE_MAP_SEAMLESS
+#define GL_TEXTURE_CUBE_MAP_SEAMLESS 0x884F
+#endif
+#ifndef GL_ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, GLvoid *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC) (GLuint program, GLenum binaryFormat, const GLvoid *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC) (GLuint program, GLenum pname, GLint value);
+#endif
+
+// The perm/grad tables and the colour ramp, and the CPU noise
+#include "noise.h"
+
+/* Global variables for all the nice stuff we need above OpenGL 1.1 */
+#ifdef WIN32
+PFNGLACTIVETEXTUREPROC           glActiveTexture      = NULL;
+PFNGLBLENDEQUATIONPROC           glBlendEquation      = NULL;
+#endif
+PFNGLCREATEPROGRAMPROC           glCreateProgram      = NULL;
+PFNGLDELETEPROGRAMPROC           glDeleteProgram      = NULL;
+PFNGLUSEPROGRAMPROC              glUseProgram         = NULL;
+PFNGLCREATESHADERPROC            glCreateShader       = NULL;
+PFNGLDELETESHADERPROC            glDeleteShader       = NULL;
+PFNGLSHADERSOURCEPROC            glShaderSource       = NULL;
+PFNGLCOMPILESHADERPROC           glCompileShader      = NULL;
+PFNGLGETSHADERIVPROC             glGetShaderiv        = NULL;
+PFNGLGETPROGRAMIVPROC            glGetProgramiv       = NULL;
+PFNGLATTACHSHADERPROC            glAttachShader       = NULL;
+PFNGLGETSHADERINFOLOGPROC        glGetShaderInfoLog   = NULL;
+PFNGLGETPROGRAMINFOLOGPROC       glGetProgramInfoLog  = NULL;
+PFNGLLINKPROGRAMPROC             glLinkProgram        = NULL;
+PFNGLGETUNIFORMLOCATIONPROC      glGetUniformLocation = NULL;
+PFNGLUNIFORM3FPROC               glUniform3f          = NULL;
+PFNGLUNIFORM4FPROC               glUniform4f          = NULL;
+PFNGLUNIFORM1FPROC               glUniform1f          = NULL;
+PFNGLUNIFORM1IPROC               glUniform1i          = NULL;
+PFNGLUNIFORM2FPROC               glUniform2f          = NULL;
+PFNGLGENFRAMEBUFFERSPROC         glGenFramebuffers    = NULL;
+PFNGLBINDFRAMEBUFFERPROC         glBindFramebuffer    = NULL;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC  glCheckFramebufferStatus = NULL;
+PFNGLGENRENDERBUFFERSPROC        glGenRenderbuffers   = NULL;
+PFNGLBINDRENDERBUFFERPROC        glBindRenderbuffer   = NULL;
+PFNGLRENDERBUFFERSTORAGEPROC     glRenderbufferStorage = NULL;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer = NULL;
+PFNGLFRAMEBUFFERTEXTURE2DPROC    glFramebufferTexture2D = NULL;
+PFNGLGENERATEMIPMAPPROC          glGenerateMipmap     = NULL;
+PFNGLGENQUERIESPROC              glGenQueries         = NULL;
+PFNGLBEGINQUERYPROC              glBeginQuery         = NULL;
+PFNGLENDQUERYPROC                glEndQuery           = NULL;
+PFNGLGETQUERYOBJECTIVPROC        glGetQueryObjectiv   = NULL;
+PFNGLGETQUERYOBJECTUI64VEXTPROC  glGetQueryObjectui64v = NULL;
+PFNGLGETPROGRAMBINARYPROC        glGetProgramBinary   = NULL;
+PFNGLPROGRAMBINARYPROC           glProgramBinary      = NULL;
+PFNGLPROGRAMPARAMETERIPROC       glProgramParameteri  = NULL;
+
+/* Some more global variables for convenience. This is C, and I'm lazy. */
+double t0 = 0.0;
+int frames = 0;
+char titlestring[200];
+
+GLuint permTextureID;
+GLuint gradTextureID;
+GLuint diffTextureID;
+GLuint sphereList;
+GLboolean updateTime = GL_TRUE;
+GLboolean animateObject = GL_TRUE;
+
+GLuint octaves = 8;
+
+/* Settings that can be changed from the command line, see parseArguments() */
+int windowWidth = 640;
+int windowHeight = 480;
+GLfloat frequency[3] = { 0.5f, 1.0f, 2.0f };
+GLfloat persistence = 0.5f;
+int sphereSegments = 20;
+GLboolean arithmeticNoise = GL_FALSE; // Texture-free snoise(), see test.frag
+GLboolean specialize = GL_FALSE;      // One unrolled program per octave count
+GLboolean litShading = GL_FALSE;      // Bump mapped lighting, see LIT_SHADING in test.frag
+int octavesPerPass = 0;               // Multi-pass rendering if > 0
+GLboolean halfAccum = GL_FALSE;       // RG16F rather than RG32F accumulation
+int cubemapSize = 0;                  // Bake the surface into a cubemap if > 0
+int numFrames = 0;                  // Frames to render, 0 picks a default
+double startTime = 0.0;             // Headless only: shader time of the first frame
+double timeStep = 1.0/60.0;         // Headless only: time step between frames
+const char *outputPrefix = "frame"; // Headless only: NULL to skip writing images
+
+GLboolean cpuCheck = GL_FALSE; // Compare noise.c with the GPU, see checkCPU()
+
+/* Benchmark sweep settings, see runBenchmark() */
+#define MAX_SWEEP 16
+GLboolean benchmark = GL_FALSE;
+int sweepWidths[MAX_SWEEP] = { 320, 640, 1280 };
+int sweepHeights[MAX_SWEEP] = { 240, 480, 720 };
+int numSweepSizes = 3;
+int sweepSegments[MAX_SWEEP] = { 10, 20, 40 };
+int numSweepSegments = 3;
+int sweepOctavesMin = 2;
+int sweepOctavesMax = 32;
+int benchmarkWarmup = 2; // Unmeasured frames after each settings change
+
+GLhandleARB programObj;
+GLint location_permTexture = -1; 
+GLint location_gradTexture = -1; 
+GLint location_diffTexture = -1; 
+GLint location_time = -1;
+GLint location_octavesIn = -1;
+GLint location_frequency = -1;
+GLint location_persistence = -1;
+GLint location_octaveAmplitude = -1;
+GLint location_octaveScale = -1;
+GLint location_accumTexture = -1;
+GLint location_accumScale = -1;
+GLint location_maxAmplitude = -1;
+GLint location_faceForward = -1;
+GLint location_faceRight = -1;
+GLint location_faceUp = -1;
+GLint location_planetMap = -1;
+
+char str[4096]; // For error messages from the GLSL compiler and linker
+
+/*
+ * printError() - Signal an error. MessageBox() is a Windows-specific function,
+ * rewrite this to print the error message to the console to make it portable!
+ */
+void printError(const char *errtype, const char *errmsg) {
+  fprintf(stderr, "%s: %s\n", errtype, errmsg);
+}
+
+
+#ifdef HEADLESS
+/*
+ * Minimal stand-ins for the GLFW calls used below, so the headless build
+ * runs without a display or GLFW. The context comes from EGL (Mesa's
+ * surfaceless platform, or a 1x1 pbuffer elsewhere) and everything is
+ * drawn into an offscreen framebuffer object, see initOffscreen().
+ */
+#define GLFW_WINDOW 0x00010001
+
+EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+EGLContext eglContext = EGL_NO_CONTEXT;
+EGLSurface eglSurface = EGL_NO_SURFACE;
+struct timespec startClock;
+GLuint offscreenFBO;
+GLuint offscreenColorRB;
+GLuint offscreenDepthRB;
+int offscreenWidth = 0;
+int offscreenHeight = 0;
+
+int glfwInit(void) {
+    clock_gettime(CLOCK_MONOTONIC, &startClock);
+    return GL_TRUE;
+}
+
+double glfwGetTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - startClock.tv_sec)
+         + 1.0e-9 * (double)(now.tv_nsec - startClock.tv_nsec);
+}
+
+int glfwOpenWindow(int width, int height, int redbits, int greenbits,
+                   int bluebits, int alphabits, int depthbits,
+                   int stencilbits, int mode) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay;
+    EGLConfig config;
+    EGLint numConfigs, major, minor;
+    const EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                     EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                     EGL_NONE };
+    const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+    // The framebuffer object has its own formats, and there is no window mode
+    (void)redbits; (void)greenbits; (void)bluebits; (void)alphabits;
+    (void)depthbits; (void)stencilbits; (void)mode;
+
+    // Prefer the Mesa surfaceless platform, it needs neither X nor a GPU.
+    getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay)
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if(eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        printError("EGL init error", "Cannot initialize an EGL display");
+        return GL_FALSE;
+    }
+    if(!eglBindAPI(EGL_OPENGL_API) ||
+       !eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs < 1)
+    {
+        printError("EGL init error", "No EGL config supports desktop OpenGL");
+        return GL_FALSE;
+    }
+    eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, NULL);
+    if(eglContext == EGL_NO_CONTEXT)
+    {
+        printError("EGL init error", "Cannot create an OpenGL context");
+        return GL_FALSE;
+    }
+    // The framebuffer object is the real render target, so the pbuffer
+    // is only there for drivers that can't bind a context without one.
+    if(!strstr(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+        eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+    if(!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+    {
+        printError("EGL init error", "Cannot make the OpenGL context current");
+        return GL_FALSE;
+    }
+    offscreenWidth = width;
+    offscreenHeight = height;
+    return GL_TRUE;
+}
+
+void glfwTerminate(void) {
+    if(eglDisplay == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(eglSurface != EGL_NO_SURFACE)
+        eglDestroySurface(eglDisplay, eglSurface);
+    if(eglContext != EGL_NO_CONTEXT)
+        eglDestroyContext(eglDisplay, eglContext);
+    eglTerminate(eglDisplay);
+    eglDisplay = EGL_NO_DISPLAY;
+}
+
+void glfwGetWindowSize(int *width, int *height) {
+    *width = offscreenWidth;
+    *height = offscreenHeight;
+}
+
+void glfwSetWindowSize(int width, int height) {
+    offscreenWidth = width;
+    offscreenHeight = height;
+    if(!offscreenFBO)
+        return; // Not created yet, initOffscreen() will use the new size
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColorRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+}
+
+void glfwSwapInterval(int interval) {
+    // There is no display to synchronize to.
+    (void)interval;
+}
+
+void glfwSwapBuffers(void) {
+    // Nothing to show, but wait like a real swap would, so that frame
+    // times cover the actual rendering.
+    glFinish();
+}
+
+int glfwExtensionSupported(const char *extension) {
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    size_t length = strlen(extension);
+    const char *where = extensions;
+    // Match whole space-separated names only, not prefixes of longer ones.
+    while(where && (where = strstr(where, extension)) != NULL)
+    {
+        if((where == extensions || where[-1] == ' ') &&
+           (where[length] == ' ' || where[length] == 0))
+            return GL_TRUE;
+        where += length;
+    }
+    return GL_FALSE;
+}
+
+void *glfwGetProcAddress(const char *procname) {
+    return (void*)eglGetProcAddress(procname);
+}
+#endif
+
+
+/*
+ * Override the Win32 filelength() function with
+ * a version that takes a Unix-style file handle as
+ * input instead of a file ID number, and which works
+ * on platforms other than Windows.
+ */
+long filelength(FILE *file) {
+    long numbytes;
+    long savedpos = ftell(file);
+    fseek(file, 0, SEEK_END);
+    numbytes = ftell(file);
+    fseek(file, savedpos, SEEK_SET);
+    return numbytes;
+}
+
+
+/*
+ * loadExtensions() - Load OpenGL extensions for anything above OpenGL
+ * version 1.1. (This is a requirement from Windows, not from OpenGL.)
+ */
+void loadExtensions() {
+    //These extension strings indicate that the OpenGL Shading Language
+    // and GLSL shader objects are supported.
+    if(!glfwExtensionSupported("GL_ARB_shading_language_100"))
+    {
+        printError("GL init error", "GL_ARB_shading_language_100 extension was not found");
+        return;
+    }
+    if(!glfwExtensionSupported("GL_ARB_shader_objects"))
+    {
+        printError("GL init error", "GL_ARB_shader_objects extension was not found");
+        return;
+    }
+    else
+    {
+#ifdef WIN32
+        glActiveTexture           = (PFNGLACTIVETEXTUREPROC)glfwGetProcAddress("glActiveTexture");
+        glBlendEquation           = (PFNGLBLENDEQUATIONPROC)glfwGetProcAddress("glBlendEquation");
+#endif
+        glCreateProgram           = (PFNGLCREATEPROGRAMPROC)glfwGetProcAddress("glCreateProgram");
+        glDeleteProgram           = (PFNGLDELETEPROGRAMPROC)glfwGetProcAddress("glDeleteProgram");
+        glUseProgram              = (PFNGLUSEPROGRAMPROC)glfwGetProcAddress("glUseProgram");
+        glCreateShader            = (PFNGLCREATESHADERPROC)glfwGetProcAddress("glCreateShader");
+        glDeleteShader            = (PFNGLDELETESHADERPROC)glfwGetProcAddress("glDeleteShader");
+        glShaderSource            = (PFNGLSHADERSOURCEPROC)glfwGetProcAddress("glShaderSource");
+        glCompileShader           = (PFNGLCOMPILESHADERPROC)glfwGetProcAddress("glCompileShader");
+        glGetShaderiv             = (PFNGLGETSHADERIVPROC)glfwGetProcAddress("glGetShaderiv");
+        glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)glfwGetProcAddress("glGetShaderInfoLog");
+        glAttachShader            = (PFNGLATTACHSHADERPROC)glfwGetProcAddress("glAttachShader");
+        glLinkProgram             = (PFNGLLINKPROGRAMPROC)glfwGetProcAddress("glLinkProgram");
+        glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)glfwGetProcAddress("glGetProgramiv");
+        glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)glfwGetProcAddress("glGetProgramInfoLog");
+        glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)glfwGetProcAddress("glGetUniformLocation");
+        glUniform3f               = (PFNGLUNIFORM3FPROC)glfwGetProcAddress("glUniform3f");
+        glUniform4f               = (PFNGLUNIFORM4FPROC)glfwGetProcAddress("glUniform4f");
+        glUniform1f               = (PFNGLUNIFORM1FPROC)glfwGetProcAddress("glUniform1f");
+        glUniform1i               = (PFNGLUNIFORM1IPROC)glfwGetProcAddress("glUniform1i");
+        glUniform2f               = (PFNGLUNIFORM2FPROC)glfwGetProcAddress("glUniform2f");
+
+        if(
+#ifdef WIN32
+            // Core since OpenGL 1.3 everywhere else, so always there
+            !glActiveTexture ||
+#endif
+            !glCreateProgram || !glDeleteProgram || !glUseProgram ||
+            !glCreateShader || !glDeleteShader || !glShaderSource || !glCompileShader || 
+            !glGetShaderiv || !glGetShaderInfoLog || !glAttachShader || !glLinkProgram ||
+            !glGetProgramiv || !glGetProgramInfoLog || !glGetUniformLocation ||
+            !glUniform4f || !glUniform2f || !glUniform1f || !glUniform1i )
+        {
+            printError("GL init error", "One or more required OpenGL functions were not found");
+            return;
+        }
+    }
+
+    // Framebuffer objects are optional for the windowed demo, but the
+    // headless build has nothing else to render into.
+    if(glfwExtensionSupported("GL_ARB_framebuffer_object"))
+    {
+        glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)glfwGetProcAddress("glGenFramebuffers");
+        glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)glfwGetProcAddress("glBindFramebuffer");
+        glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)glfwGetProcAddress("glCheckFramebufferStatus");
+        glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)glfwGetProcAddress("glGenRenderbuffers");
+        glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)glfwGetProcAddress("glBindRenderbuffer");
+        glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)glfwGetProcAddress("glRenderbufferStorage");
+        glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)glfwGetProcAddress("glFramebufferRenderbuffer");
+        glFramebufferTexture2D    = (PFNGLFRAMEBUFFERTEXTURE2DPROC)glfwGetProcAddress("glFramebufferTexture2D");
+        glGenerateMipmap          = (PFNGLGENERATEMIPMAPPROC)glfwGetProcAddress("glGenerateMipmap");
+    }
+
+    // Timer queries for the frame profiler, see initProfiler().
+    if(glfwExtensionSupported("GL_ARB_timer_query"))
+    {
+        glGenQueries              = (PFNGLGENQUERIESPROC)glfwGetProcAddress("glGenQueries");
+        glBeginQuery              = (PFNGLBEGINQUERYPROC)glfwGetProcAddress("glBeginQuery");
+        glEndQuery                = (PFNGLENDQUERYPROC)glfwGetProcAddress("glEndQuery");
+        glGetQueryObjectiv        = (PFNGLGETQUERYOBJECTIVPROC)glfwGetProcAddress("glGetQueryObjectiv");
+        glGetQueryObjectui64v     = (PFNGLGETQUERYOBJECTUI64VEXTPROC)glfwGetProcAddress("glGetQueryObjectui64v");
+    }
+
+    // Program binaries for the shader cache, see buildProgram().
+    if(glfwExtensionSupported("GL_ARB_get_program_binary"))
+    {
+        glGetProgramBinary        = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+        glProgramBinary           = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+        glProgramParameteri       = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+    }
+}
+
+
+/*
+ * readShaderFile(filename) - read a shader source string from a file
+ */
+unsigned char* readShaderFile(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if(file == NULL)
+    {
+        printError("ERROR", "Cannot open shader file!");
+  		  return 0;
+    }
+    int bytesinfile = filelength(file);
+    unsigned char *buffer = (unsigned char*)malloc(bytesinfile+1);
+    int bytesread = fread( buffer, 1, bytesinfile, file);
+    buffer[bytesread] = 0; // Terminate the string with 0
+    fclose(file);
+    
+    return buffer;
+}
+
+
+/*
+ * compileShader(type, source, defines) - compile one shader object.
+ * "defines" is inserted right after the #version line of the source, so
+ * the same file can be built in several specialized variants.
+ */
+GLuint compileShader(GLenum type, const char *source, const char *defines)
+{
+    GLuint shader;
+    GLint compiled;
+    const char *strings[3];
+    GLint lengths[3];
+    const char *rest = source;
+    const char *version = strstr(source, "#version");
+
+    // Everything up to and including the #version line has to come first.
+    if(version)
+    {
+        rest = strchr(version, '\n');
+        rest = rest ? rest + 1 : version + strlen(version);
+    }
+    strings[0] = source;  lengths[0] = (GLint)(rest - source);
+    strings[1] = defines; lengths[1] = (GLint)strlen(defines);
+    strings[2] = rest;    lengths[2] = (GLint)strlen(rest);
+
+    shader = glCreateShader(type);
+    glShaderSource( shader, 3, strings, lengths );
+    glCompileShader( shader );
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+    if(compiled == GL_FALSE)
+    {
+        glGetShaderInfoLog( shader, sizeof(str), NULL, str );
+        printError(type == GL_VERTEX_SHADER ? "Vertex shader compile error"
+                                            : "Fragment shader compile error", str);
+    }
+    return shader;
+}
+
+
+/*
+ * Program binary cache. Linked programs are saved with
+ * GL_ARB_get_program_binary under shaderCacheDir, named by a hash of
+ * the shader sources, the specialization defines and the GL_RENDERER
+ * and GL_VERSION strings. A file the driver no longer accepts (after a
+ * driver update, say) is deleted and the program is rebuilt from source.
+ */
+#define PROGRAM_CACHE_MAGIC "GLSLnoiseProgram"
+
+typedef struct {
+    char magic[16];
+    unsigned long long key;
+    GLenum format;
+    GLint length;
+} ProgramCacheHeader;
+
+const char *shaderCacheDir = "shadercache"; // NULL disables the cache
+
+/*
+ * hashString(hash, s) - FNV-1a, including the terminating zero so that
+ * consecutive strings can't run into each other.
+ */
+unsigned long long hashString(unsigned long long hash, const char *s)
+{
+    do {
+        hash ^= (unsigned char)*s;
+        hash *= 1099511628211ULL;
+    } while(*s++);
+    return hash;
+}
+
+void programCachePath(char *path, unsigned long long key)
+{
+    sprintf(path, "%.900s/%016llx.bin", shaderCacheDir, key);
+}
+
+/*
+ * loadProgramBinary(key) - create a program from the cache, or return 0
+ * if there is no usable cached binary for this key.
+ */
+GLuint loadProgramBinary(unsigned long long key)
+{
+    char path[1024];
+    ProgramCacheHeader header;
+    GLuint program = 0;
+    GLint linked = GL_FALSE;
+    void *binary;
+    FILE *file;
+
+    if(!shaderCacheDir || !glProgramBinary)
+        return 0;
+    programCachePath(path, key);
+    file = fopen(path, "rb");
+    if(file == NULL)
+        return 0;
+    if(fread(&header, sizeof(header), 1, file) != 1 ||
+       memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) ||
+       header.key != key || header.length <= 0 ||
+       filelength(file) != (long)(sizeof(header) + header.length))
+    {
+        fclose(file);
+        remove(path); // Truncated or foreign file
+        return 0;
+    }
+    binary = malloc(header.length);
+    if(fread(binary, 1, header.length, file) == (size_t)header.length)
+    {
+        program = glCreateProgram();
+        glProgramBinary( program, header.format, binary, header.length );
+        glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    }
+    free(binary);
+    fclose(file);
+
+    if(linked == GL_FALSE)
+    {
+        // Stale binary from an older driver or GPU, compile from source.
+        if(program)
+            glDeleteProgram(program);
+        remove(path);
+        return 0;
+    }
+    return program;
+}
+
+/*
+ * saveProgramBinary(program, key) - store a freshly linked program in
+ * the cache. Failures only cost us the next warm start, so they're quiet.
+ */
+void saveProgramBinary(GLuint program, unsigned long long key)
+{
+    char path[1024];
+    ProgramCacheHeader header;
+    GLint length = 0;
+    void *binary;
+    FILE *file;
+
+    if(!shaderCacheDir || !glGetProgramBinary)
+        return;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if(length <= 0)
+        return;
+    binary = malloc(length);
+    glGetProgramBinary( program, length, &length, &header.format, binary );
+
+#ifdef WIN32
+    _mkdir(shaderCacheDir);
+#else
+    mkdir(shaderCacheDir, 0755);
+#endif
+    programCachePath(path, key);
+    file = fopen(path, "wb");
+    if(file != NULL)
+    {
+        memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+        header.key = key;
+        header.length = length;
+        if(fwrite(&header, sizeof(header), 1, file) != 1 ||
+           fwrite(binary, 1, length, file) != (size_t)length)
+        {
+            fclose(file);
+            remove(path);
+        }
+        else
+            fclose(file);
+    }
+    free(binary);
+}
+
+
+/*
+ * buildProgram(vertfile, fragfile, defines) - load, compile and link a
+ * GLSL program, or fetch it from the program binary cache.
+ */
+GLuint buildProgram(const char *vertfile, const char *fragfile, const char *defines)
+{
+    unsigned long long key = 14695981039346656037ULL;
+    unsigned char *vertexSource, *fragmentSource;
+    GLuint program, vertex, fragment;
+    GLint linked;
+
+    vertexSource = readShaderFile(vertfile);
+    fragmentSource = readShaderFile(fragfile);
+    if(!vertexSource || !fragmentSource)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return 0;
+    }
+
+    key = hashString(key, (const char*)vertexSource);
+    key = hashString(key, (const char*)fragmentSource);
+    key = hashString(key, defines);
+    key = hashString(key, (const char*)glGetString(GL_RENDERER));
+    key = hashString(key, (const char*)glGetString(GL_VERSION));
+    program = loadProgramBinary(key);
+    if(program)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return program;
+    }
+
+    vertex = compileShader(GL_VERTEX_SHADER, (const char*)vertexSource, defines);
+    fragment = compileShader(GL_FRAGMENT_SHADER, (const char*)fragmentSource, defines);
+    free(vertexSource);
+    free(fragmentSource);
+
+    // Create a program object and attach the two compiled shaders.
+    program = glCreateProgram();
+    glAttachShader( program, vertex );
+    glAttachShader( program, fragment );
+    if(shaderCacheDir && glProgramParameteri)
+        glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+
+    // Link the program object and print out the info log.
+    glLinkProgram( program );
+    glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    // The program keeps what it needs, the shader objects can go.
+    glDeleteShader( vertex );
+    glDeleteShader( fragment );
+
+    if( linked == GL_FALSE )
+	{
+		glGetProgramInfoLog( program, sizeof(str), NULL, str );
+		printError("Program object linking error", str);
+	}
+    else
+        saveProgramBinary(program, key);
+    return program;
+}
+
+
+/*
+ * Program table. Every program is built from test.vert and test.frag,
+ * specialized by #defines: the pass it is used for (ShaderMode), the
+ * noise variant, and with -specialize the octave count, frequencies and
+ * persistence as constants, see test.frag. Constants give fbm() a fixed
+ * trip count that the compiler can unroll. Every combination built so
+ * far is kept here, so switching octaves with Q/E is just a lookup.
+ * Past MAX_PROGRAM_VARIANTS the oldest one not in use is deleted; the
+ * table only grows past it if the current frame uses every one.
+ */
+#define MAX_PROGRAM_VARIANTS 64
+
+typedef enum {
+    MODE_SCENE,      // Whole fbm() and colour lookup in one pass
+    MODE_ACCUMULATE, // A band of octaves into the float target
+    MODE_RESOLVE,    // Colour lookup of the accumulated octaves
+    MODE_BAKE,       // GetColour() into a cubemap face
+    MODE_CUBEMAP     // Sphere shaded from the baked cubemap
+} ShaderMode;
+
+const char *shaderModeDefines[] = {
+    "",
+    "#define FBM_ACCUMULATE\n",
+    "#define FBM_RESOLVE\n",
+    "#define CUBEMAP_BAKE\n",
+    ""
+};
+
+const char *shaderModeFiles[][2] = {
+    { "test.vert", "test.frag" },
+    { "test.vert", "test.frag" },
+    { "test.vert", "test.frag" },
+    { "cubeface.vert", "test.frag" },
+    { "test.vert", "cubemap.frag" }
+};
+
+typedef struct {
+    ShaderMode mode;
+    GLuint octaves;
+    GLfloat frequency[3];
+    GLfloat persistence;
+    GLboolean arithmetic;
+    GLboolean lit;
+    GLuint program;
+} ProgramVariant;
+
+ProgramVariant *programVariants = NULL;
+int numProgramVariants = 0;
+int programVariantSlots = 0; // Allocated in programVariants
+
+/*
+ * shaderDefines(defines, mode, octaves) - the #define block for a
+ * program with the current settings.
+ */
+void shaderDefines(char *defines, ShaderMode mode, GLuint octaves)
+{
+    strcpy(defines, shaderModeDefines[mode]);
+    if(arithmeticNoise)
+        strcat(defines, "#define ARITHMETIC_NOISE\n");
+    if(litShading && mode == MODE_SCENE)
+        strcat(defines, "#define LIT_SHADING\n");
+    if(specialize)
+        // %#g always prints a decimal point, so these stay float literals.
+        sprintf(defines + strlen(defines),
+                "#define FBM_OCTAVES %u\n"
+                "#define FBM_FREQUENCY vec3(%#.9g, %#.9g, %#.9g)\n"
+                "#define FBM_PERSISTENCE %#.9g\n",
+                octaves, frequency[0], frequency[1], frequency[2], persistence);
+}
+
+/*
+ * variantInUse(variant) - whether a program is one the current settings
+ * draw with: the same settings, and for a specialized program, the
+ * current octave count, or any band of them for the accumulation passes.
+ */
+int variantInUse(const ProgramVariant *variant)
+{
+    return variant->arithmetic == arithmeticNoise &&
+           variant->lit == litShading &&
+           variant->persistence == persistence &&
+           !memcmp(variant->frequency, frequency, sizeof(frequency)) &&
+           (variant->octaves == 0 || variant->octaves == octaves ||
+            variant->mode == MODE_ACCUMULATE);
+}
+
+/*
+ * getProgramVariant(mode, octaves) - find the program for this pass and
+ * octave count with the current settings, building it if needed. The
+ * octave count only matters for specialized programs.
+ */
+GLuint getProgramVariant(ShaderMode mode, GLuint octaves)
+{
+    char defines[512];
+    ProgramVariant *variant;
+    GLuint program;
+    int i, slots;
+
+    if(!specialize || mode == MODE_RESOLVE || mode == MODE_CUBEMAP)
+        octaves = 0;
+    for(i = 0; i < numProgramVariants; i++)
+    {
+        variant = &programVariants[i];
+        if(variant->mode == mode && variant->octaves == octaves &&
+           variant->arithmetic == arithmeticNoise &&
+           variant->lit == litShading &&
+           variant->persistence == persistence &&
+           !memcmp(variant->frequency, frequency, sizeof(frequency)))
+            return variant->program;
+    }
+
+    shaderDefines(defines, mode, octaves);
+    program = buildProgram(shaderModeFiles[mode][0], shaderModeFiles[mode][1], defines);
+    if(numProgramVariants >= MAX_PROGRAM_VARIANTS)
+    {
+        // Full, which only happens if the settings keep changing.
+        // Recycle the oldest entry this frame can't be drawing with,
+        // and if it could be drawing with all of them, keep them all.
+        for(i = 0; i < numProgramVariants && variantInUse(&programVariants[i]); i++)
+            ;
+        if(i < numProgramVariants)
+        {
+            glDeleteProgram(programVariants[i].program);
+            memmove(programVariants + i, programVariants + i + 1,
+                    (numProgramVariants-1 - i) * sizeof(ProgramVariant));
+            numProgramVariants--;
+        }
+    }
+    if(numProgramVariants == programVariantSlots)
+    {
+        slots = programVariantSlots ? 2*programVariantSlots : MAX_PROGRAM_VARIANTS;
+        variant = (ProgramVariant*)realloc(programVariants, slots * sizeof(ProgramVariant));
+        if(variant == NULL)
+        {
+            printError("Shader cache", "Out of memory, program not cached");
+            return program;
+        }
+        programVariants = variant;
+        programVariantSlots = slots;
+    }
+    variant = &programVariants[numProgramVariants++];
+    variant->mode = mode;
+    variant->octaves = octaves;
+    memcpy(variant->frequency, frequency, sizeof(frequency));
+    variant->persistence = persistence;
+    variant->arithmetic = arithmeticNoise;
+    variant->lit = litShading;
+    variant->program = program;
+    return program;
+}
+
+
+/*
+ * locateUniforms() - look up the uniform locations in programObj.
+ * Uniforms a program doesn't have (constants in specialized programs,
+ * or not used by its pass) stay at -1 and are skipped by useProgram().
+ */
+void locateUniforms() {
+	// Locate the uniform shader variables so we can set them later:
+    // a texture ID ("permTexture") and a float ("time").
+	location_permTexture = glGetUniformLocation( programObj, "permTexture" );
+    // This is not needed for the 2D and 3D noise variants.
+    location_gradTexture = glGetUniformLocation( programObj, "gradTexture" );
+	location_diffTexture = glGetUniformLocation( programObj, "diffuse" );
+	location_octavesIn = glGetUniformLocation( programObj, "octavesIn" );
+	location_frequency = glGetUniformLocation( programObj, "frequency" );
+	location_persistence = glGetUniformLocation( programObj, "persistenceIn" );
+    // This is not used for the 2D noise demo.
+    location_time = glGetUniformLocation( programObj, "time" );
+	location_octaveAmplitude = glGetUniformLocation( programObj, "octaveAmplitude" );
+	location_octaveScale = glGetUniformLocation( programObj, "octaveScale" );
+	location_accumTexture = glGetUniformLocation( programObj, "accumTexture" );
+	location_accumScale = glGetUniformLocation( programObj, "accumScale" );
+	location_maxAmplitude = glGetUniformLocation( programObj, "maxAmplitude" );
+	location_faceForward = glGetUniformLocation( programObj, "faceForward" );
+	location_faceRight = glGetUniformLocation( programObj, "faceRight" );
+	location_faceUp = glGetUniformLocation( programObj, "faceUp" );
+	location_planetMap = glGetUniformLocation( programObj, "planetMap" );
+}
+
+
+/*
+ * createShaders() - create, load, compile and link the GLSL shader objects.
+ */
+void createShaders() {
+    programObj = getProgramVariant(MODE_SCENE, octaves);
+    locateUniforms();
+	if(location_permTexture == -1 && !arithmeticNoise)
+    printError("Binding error","Failed to locate uniform variable 'permTexture'.");
+	/*
+    if(location_gradTexture == -1)
+      printError("Binding error","Failed to locate uniform variable 'gradTexture'.");
+	if(location_time == -1)
+      printError("Binding error", "Failed to locate uniform variable 'time'.");
+    */
+}
+
+
+/*
+ * Frame profiler. GPU time (GL_TIME_ELAPSED) and fragment shader
+ * invocations are measured around drawScene() with queries that live in
+ * a small ring. Results are read back a few frames later, once the GPU
+ * has them ready, so profiling never stalls the pipeline.
+ */
+#define PROFILE_RING 8       // Frames in flight before a query slot is reused
+#define PROFILE_SAMPLES 4096 // Most recent frames kept for the statistics
+
+typedef struct {
+    GLuint timeQuery;
+    GLuint statsQuery;
+    double cpuTime;     // Seconds spent submitting the frame on the CPU
+    double frameTime;   // Seconds since the previous frame was started, -1.0 if none
+    GLboolean pending;  // Queries issued but results not collected yet
+} FrameQueries;
+
+typedef struct {
+    double gpuMs;
+    double cpuMs;
+    double frameMs;     // NAN if there was no previous frame to time it from
+    double fragments;
+} FrameSample;
+
+GLboolean profileGPU = GL_FALSE;   // GL_ARB_timer_query is available
+GLboolean profileStats = GL_FALSE; // GL_ARB_pipeline_statistics_query is available
+FrameQueries profileRing[PROFILE_RING];
+FrameSample profileSamples[PROFILE_SAMPLES];
+int profileFrames = 0;   // Frames submitted so far
+int profileCount = 0;    // Samples collected so far (may exceed PROFILE_SAMPLES)
+int profileDropped = 0;  // Frames whose queries were still busy when reused
+double profileCpuStart = 0.0;
+double profileLastFrame = -1.0; // Start of the previous frame, -1.0 if none
+
+
+/*
+ * initProfiler() - create the query objects for the frame profiler.
+ */
+void initProfiler()
+{
+    int i;
+    profileGPU = glGenQueries && glGetQueryObjectui64v;
+    profileStats = profileGPU && glfwExtensionSupported("GL_ARB_pipeline_statistics_query");
+    for(i = 0; i < PROFILE_RING; i++)
+    {
+        if(profileGPU)
+            glGenQueries(1, &profileRing[i].timeQuery);
+        if(profileStats)
+            glGenQueries(1, &profileRing[i].statsQuery);
+        profileRing[i].pending = GL_FALSE;
+    }
+    if(!profileGPU)
+        printError("Profiler", "GL_ARB_timer_query not supported, reporting CPU times only");
+}
+
+
+/*
+ * collectProfile(wait) - move finished query results into the sample
+ * window. Busy queries are left alone unless "wait" is set.
+ */
+void collectProfile(GLboolean wait)
+{
+    int i;
+    for(i = 0; i < PROFILE_RING; i++)
+    {
+        FrameQueries *slot = &profileRing[i];
+        FrameSample *sample;
+        GLuint64EXT result;
+        GLint available = GL_TRUE;
+
+        if(!slot->pending)
+            continue;
+        if(profileGPU && !wait)
+        {
+            glGetQueryObjectiv(slot->timeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available && profileStats)
+                glGetQueryObjectiv(slot->statsQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        if(!available)
+            continue;
+
+        sample = &profileSamples[profileCount % PROFILE_SAMPLES];
+        sample->gpuMs = 0.0;
+        sample->fragments = 0.0;
+        if(profileGPU)
+        {
+            glGetQueryObjectui64v(slot->timeQuery, GL_QUERY_RESULT, &result);
+            sample->gpuMs = 1.0e-6 * (double)result;
+        }
+        if(profileStats)
+        {
+            glGetQueryObjectui64v(slot->statsQuery, GL_QUERY_RESULT, &result);
+            sample->fragments = (double)result;
+        }
+        sample->cpuMs = 1000.0 * slot->cpuTime;
+        // Nothing to time it from, after a start, reset or idle stretch
+        sample->frameMs = slot->frameTime < 0.0 ? NAN : 1000.0 * slot->frameTime;
+        slot->pending = GL_FALSE;
+        profileCount++;
+    }
+}
+
+
+/*
+ * beginFrameProfile() and endFrameProfile() - bracket the GL commands
+ * of one frame (the drawScene() call) with the profiler queries.
+ */
+void beginFrameProfile()
+{
+    FrameQueries *slot = &profileRing[profileFrames % PROFILE_RING];
+    double t = glfwGetTime();
+
+    collectProfile(GL_FALSE);
+    if(slot->pending)
+    {
+        // Still busy after PROFILE_RING frames; drop it rather than wait.
+        slot->pending = GL_FALSE;
+        profileDropped++;
+    }
+    slot->frameTime = (profileLastFrame < 0.0) ? -1.0 : t - profileLastFrame;
+    profileLastFrame = t;
+    profileCpuStart = t;
+    if(profileGPU)
+        glBeginQuery(GL_TIME_ELAPSED_EXT, slot->timeQuery);
+    if(profileStats)
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, slot->statsQuery);
+}
+
+void endFrameProfile()
+{
+    FrameQueries *slot = &profileRing[profileFrames % PROFILE_RING];
+
+    if(profileStats)
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    if(profileGPU)
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+    slot->cpuTime = glfwGetTime() - profileCpuStart;
+    slot->pending = GL_TRUE;
+    profileFrames++;
+}
+
+
+/*
+ * resetProfile() - wait for the outstanding queries, then throw away all
+ * samples so far. Used to measure one configuration at a time.
+ */
+void resetProfile()
+{
+    collectProfile(GL_TRUE);
+    profileCount = 0;
+    profileDropped = 0;
+    profileLastFrame = -1.0; // The wait isn't part of the next frame
+}
+
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * profileValues(field, recent, values) - copy one field of the "recent"
+ * newest samples into "values", sorted, leaving out NAN ones. Returns
+ * the number copied.
+ */
+int profileValues(size_t field, int recent, double *values)
+{
+    int i, n = 0, count = profileCount < PROFILE_SAMPLES ? profileCount : PROFILE_SAMPLES;
+    if(recent < count)
+        count = recent;
+    for(i = 0; i < count; i++)
+    {
+        const FrameSample *sample = &profileSamples[(profileCount - 1 - i) % PROFILE_SAMPLES];
+        double value = *(const double*)((const char*)sample + field);
+        if(!isnan(value))
+            values[n++] = value;
+    }
+    qsort(values, n, sizeof(double), compareDoubles);
+    return n;
+}
+
+double percentile(const double *sorted, int n, double p)
+{
+    int i = (int)ceil(p * n) - 1;
+    if(n <= 0) return 0.0;
+    return sorted[i < 0 ? 0 : (i >= n ? n-1 : i)];
+}
+
+
+/*
+ * printHistogram(file, name, field) - print p50/p95/p99 and a text
+ * histogram of one sample field over the whole sample window.
+ */
+void printHistogram(FILE *file, const char *name, size_t field)
+{
+    static double values[PROFILE_SAMPLES];
+    int bins[16] = {0};
+    int n, i, b, peak = 1;
+    double lo, hi, width;
+
+    n = profileValues(field, PROFILE_SAMPLES, values);
+    if(n == 0)
+        return;
+    fprintf(file, "%-6s p50 %8.3f ms  p95 %8.3f ms  p99 %8.3f ms  (min %.3f, max %.3f, %d frames)\n",
+            name, percentile(values, n, 0.50), percentile(values, n, 0.95),
+            percentile(values, n, 0.99), values[0], values[n-1], n);
+
+    // Bin up to p99 so a single hitch doesn't squash the whole histogram.
+    lo = values[0];
+    hi = percentile(values, n, 0.99);
+    width = (hi > lo) ? (hi - lo) / 16 : 1.0;
+    for(i = 0; i < n; i++)
+    {
+        b = (int)((values[i] - lo) / width);
+        bins[b < 0 ? 0 : (b > 15 ? 15 : b)]++;
+    }
+    for(b = 0; b < 16; b++)
+        if(bins[b] > peak) peak = bins[b];
+    for(b = 0; b < 16; b++)
+    {
+        fprintf(file, "  %8.3f ms %6d |", lo + b*width, bins[b]);
+        for(i = 0; i < (bins[b]*50 + peak-1) / peak; i++)
+            fputc('#', file);
+        fputc('\n', file);
+    }
+}
+
+
+/*
+ * reportProfile(file) - wait for the outstanding queries and print the
+ * frame time statistics collected so far.
+ */
+void reportProfile(FILE *file)
+{
+    static double values[PROFILE_SAMPLES];
+    int n;
+
+    collectProfile(GL_TRUE);
+    fprintf(file, "Frame profile, %u octaves (%d frames dropped):\n", octaves, profileDropped);
+    if(profileGPU)
+        printHistogram(file, "GPU", offsetof(FrameSample, gpuMs));
+    printHistogram(file, "CPU", offsetof(FrameSample, cpuMs));
+    printHistogram(file, "Frame", offsetof(FrameSample, frameMs));
+    if(profileStats)
+    {
+        n = profileValues(offsetof(FrameSample, fragments), PROFILE_SAMPLES, values);
+        if(n == 0)
+            return;
+        fprintf(file, "Fragment shader invocations per frame: p50 %.0f", percentile(values, n, 0.5));
+        if(profileGPU)
+        {
+            static double gpu[PROFILE_SAMPLES];
+            profileValues(offsetof(FrameSample, gpuMs), PROFILE_SAMPLES, gpu);
+            if(percentile(values, n, 0.5) > 0.0)
+                fprintf(file, ", %.2f ns per fragment",
+                        1.0e6 * percentile(gpu, n, 0.5) / percentile(values, n, 0.5));
+        }
+        fputc('\n', file);
+    }
+}
+
+
+#ifndef HEADLESS
+/*
+ * showProfile() - report frames per second and the GPU frame time
+ * percentiles (updated once per second) in the window title bar
+ */
+void showProfile() {
+
+    static double values[PROFILE_SAMPLES];
+    static int lastCount = 0;
+    double t, fps;
+    int n;
+    
+    // Get current time
+    t = glfwGetTime();  // Gets number of seconds since glfwInit()
+    // If one second has passed, or if this is the very first frame
+    if( (t-t0) > 1.0 || frames == 0 )
+    {
+        fps = (double)frames / (t-t0);
+        n = profileValues(offsetof(FrameSample, gpuMs), profileCount - lastCount, values);
+        sprintf(titlestring, "GLSL Perlin noise (%.1f FPS, GPU %.2f/%.2f/%.2f ms p50/p95/p99), %u octaves",
+                fps, percentile(values, n, 0.50), percentile(values, n, 0.95),
+                percentile(values, n, 0.99), octaves);
+        glfwSetWindowTitle(titlestring);
+        lastCount = profileCount;
+        t0 = t;
+        frames = 0;
+    }
+    frames ++;
+}
+#endif
+
+
+/*
+ * setupCamera() - set up the OpenGL projection and (model)view matrices
+ */
+void setupCamera() {
+
+    int width, height;
+    
+    // Get window size. It may start out different from the requested
+    // size, and will change if the user resizes the window.
+    glfwGetWindowSize( &width, &height );
+    if(height<=0) height=1; // Safeguard against iconified/closed window
+
+    // Set viewport. This is the pixel rectangle we want to draw into.
+    glViewport( 0, 0, width, height ); // The entire window
+
+    // Select and setup the projection matrix.
+    glMatrixMode(GL_PROJECTION); // "We want to edit the projection matrix"
+    glLoadIdentity(); // Reset the matrix to identity
+    // 45 degrees FOV, same aspect ratio as viewport, depth range 1 to 100
+    gluPerspective( 45.0f, (GLfloat)width/(GLfloat)height, 1.0f, 100.0f );
+
+    // Select and setup the modelview matrix.
+    glMatrixMode( GL_MODELVIEW ); // "We want to edit the modelview matrix"
+    glLoadIdentity(); // Reset the matrix to identity
+    // Look from 0,-4,0 towards 0,0,0 with Z as "up" in the image
+    gluLookAt( 0.0f, -4.0f, 0.0f,  // Eye position
+               0.0f, 0.0f, 0.0f,   // View point
+               0.0f, 0.0f, 1.0f ); // Up vector
+}
+
+
+/*
+ * drawTexturedSphere(r, segs) - Draw a sphere centered on the local
+ * origin, with radius "r" and approximated by "segs" polygon segments,
+ * with texture coordinates in a latitude-longitude mapping.
+ */
+void drawTexturedSphere(float r, int segs) {
+  int i, j;
+  float x, y, z, z1, z2, R, R1, R2;
+
+  // Top cap
+  glBegin(GL_TRIANGLE_FAN);
+  glNormal3f(0,0,1);
+  glTexCoord2f(0.5f,1.0f); // This is an ugly (u,v)-mapping singularity
+  glVertex3f(0,0,r);
+  z = cos(M_PI/segs);
+  R = sin(M_PI/segs);
+    for(i = 0; i <= 2*segs; i++) {
+      x = R*cos(i*2.0*M_PI/(2*segs));
+      y = R*sin(i*2.0*M_PI/(2*segs));
+      glNormal3f(x, y, z);
+      glTexCoord2f((float)i/(2*segs), 1.0f-1.0f/segs);
+      glVertex3f(r*x, r*y, r*z);
+    }
+  glEnd();  
+
+  // Height segments
+  for(j = 1; j < segs-1; j++) {
+    z1 = cos(j*M_PI/segs);
+    R1 = sin(j*M_PI/segs);
+    z2 = cos((j+1)*M_PI/segs);
+    R2 = sin((j+1)*M_PI/segs);
+    glBegin(GL_TRIANGLE_STRIP);
+    for(i = 0; i <= 2*segs; i++) {
+      x = R1*cos(i*2.0*M_PI/(2*segs));
+      y = R1*sin(i*2.0*M_PI/(2*segs));
+      glNormal3f(x, y, z1);
+      glTexCoord2f((float)i/(2*segs), 1.0f-(float)j/segs);
+      glVertex3f(r*x, r*y, r*z1);
+      x = R2*cos(i*2.0*M_PI/(2*segs));
+      y = R2*sin(i*2.0*M_PI/(2*segs));
+      glNormal3f(x, y, z2);
+      glTexCoord2f((float)i/(2*segs), 1.0f-(float)(j+1)/segs);
+      glVertex3f(r*x, r*y, r*z2);
+    }
+    glEnd();
+  }
+
+  // Bottom cap
+  glBegin(GL_TRIANGLE_FAN);
+  glNormal3f(0,0,-1);
+  glTexCoord2f(0.5f, 1.0f); // This is an ugly (u,v)-mapping singularity
+  glVertex3f(0,0,-r);
+  z = -cos(M_PI/segs);
+  R = sin(M_PI/segs);
+    for(i = 2*segs; i >= 0; i--) {
+      x = R*cos(i*2.0*M_PI/(2*segs));
+      y = R*sin(i*2.0*M_PI/(2*segs));
+      glNormal3f(x, y, z);
+      glTexCoord2f(1.0f-(float)i/(2*segs), 1.0f/segs);
+      glVertex3f(r*x, r*y, r*z);
+    }
+  glEnd();
+}
+
+
+/*
+ * initSphereList(GLuint *listID, GLdouble scale, int segs) - create a
+ * display list to render the sphere more efficently than calling lots
+ * of trigonometric functions for each frame.
+ * (A vertex array could be even faster, but I'm a bit lazy here.)
+ */
+void initSphereList(GLuint *listID, GLdouble scale, int segs)
+{
+  *listID = glGenLists(1);
+  
+  glNewList(*listID, GL_COMPILE);
+  drawTexturedSphere(scale, segs);
+  glEndList();
+}
+
+
+/*
+ * initPermTexture(GLuint *texID) - create and load a 2D texture for
+ * a combined index permutation and gradient lookup table.
+ * This texture is used for 2D and 3D noise, both classic and simplex.
+ */
+void initPermTexture(GLuint *texID)
+{
+  char *pixels;
+  int i,j;
+  
+  glGenTextures(1, texID); // Generate a unique texture ID
+  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 0
+
+  pixels = (char*)malloc( 256*256*4 );
+  for(i = 0; i<256; i++)
+    for(j = 0; j<256; j++) {
+      int offset = (i*256+j)*4;
+      char value = noisePermutation[(j+noisePermutation[i]) & 0xFF];
+      pixels[offset] = noiseGrad3[value & 0x0F][0] * 64 + 64;   // Gradient x
+      pixels[offset+1] = noiseGrad3[value & 0x0F][1] * 64 + 64; // Gradient y
+      pixels[offset+2] = noiseGrad3[value & 0x0F][2] * 64 + 64; // Gradient z
+      pixels[offset+3] = value;                     // Permuted index
+    }
+  
+  // GLFW texture loading functions won't work here - we need GL_NEAREST lookup.
+  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+}
+
+/*
+ * initGradTexture(GLuint *texID) - create and load a 2D texture
+ * for a 4D gradient lookup table. This is used for 4D noise only.
+ */
+void initGradTexture(GLuint *texID)
+{
+  char *pixels;
+  int i,j;
+  
+  glActiveTexture( GL_TEXTURE1 ); // Activate a different texture unit (unit 1)
+
+  glGenTextures(1, texID); // Generate a unique texture ID
+  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 2
+
+  pixels = (char*)malloc( 256*256*4 );
+  for(i = 0; i<256; i++)
+    for(j = 0; j<256; j++) {
+      int offset = (i*256+j)*4;
+      char value = noisePermutation[(j+noisePermutation[i]) & 0xFF];
+      pixels[offset] = noiseGrad4[value & 0x1F][0] * 64 + 64;   // Gradient x
+      pixels[offset+1] = noiseGrad4[value & 0x1F][1] * 64 + 64; // Gradient y
+      pixels[offset+2] = noiseGrad4[value & 0x1F][2] * 64 + 64; // Gradient z
+      pixels[offset+3] = noiseGrad4[value & 0x1F][3] * 64 + 64; // Gradient w
+    }
+  
+  // GLFW texture loading functions won't work here - we need GL_NEAREST lookup.
+  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+  glActiveTexture( GL_TEXTURE0 ); // Switch active texture unit back to 0 again
+}
+
+/*
+ * initDiffTexture(GLuint *texID) - create and load a 2D texture for
+ * a combined index permutation and gradient lookup table.
+ * This texture is used for 2D and 3D noise, both classic and simplex.
+ */
+void initDiffTexture(GLuint *texID)
+{
+  glActiveTexture( GL_TEXTURE2 ); // Activate a different texture unit (unit 2)
+  
+  glGenTextures(1, texID); // Generate a unique texture ID
+  glBindTexture(GL_TEXTURE_2D, *texID); // Bind the texture to texture unit 2
+  
+  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, 256, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, noiseColourRamp );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+  glActiveTexture( GL_TEXTURE0 ); // Switch active texture unit back to 0 again
+}
+
+
+
+/*
+ * drawScene(float t) - the actual drawing commands to render our scene.
+ */
+void drawScene(float t) {
+    glRotatef(30.0f, 1.0f, 0.0f, 0.0f); // Rotate the view somewhat
+    glPushMatrix(); // Transforms to animate the light:
+      glRotatef(30.0f*t, 0.0f, 0.0f, 1.0f);
+      glTranslatef(5.0f, 0.0f, 0.0f); // Orbit around Z, 5 units from origin
+      float lightpos0[4]={0.0f, 0.0f, 0.0f, 1.0f}; // Origin, in hom. coords
+      glLightfv(GL_LIGHT0, GL_POSITION, lightpos0); // Set light position
+    glPopMatrix(); // Revert to initial transform
+    glPushMatrix(); // Transforms to animate the object:
+      glRotatef(45.0f*t, 0.0f, 0.0f, 1.0f); // Spin around Z
+      glColor3f(1.0f, 1.0f, 1.0f); // White base color
+      // Enable lighting and the LIGHT0 we placed before
+      glEnable(GL_LIGHTING);
+      glEnable(GL_LIGHT0);
+      // We have now enabled lighting, so this object is lit.
+      glCallList(sphereList); // Draw a sphere using the display list
+    glPopMatrix(); // Revert to initial transform
+    // Disable lighting again, to prepare for next frame.
+    glDisable(GL_LIGHTING);
+    glDisable(GL_LIGHT0);
+}
+
+
+/*
+ * useProgram(program, time) - activate a program and set the uniforms
+ * that all the passes share.
+ */
+void useProgram(GLuint program, float time)
+{
+  	  // Use vertex and fragment shaders.
+	  if(program != programObj)
+	  {
+		programObj = program;
+		locateUniforms();
+	  }
+	  glUseProgram( programObj );
+	  // Update the uniform time variable.
+      if( location_time != -1 )
+    		glUniform1f( location_time, time );
+	  // Identify the textures to use.
+ 	  if( location_permTexture != -1 )
+  		glUniform1i( location_permTexture, 0 ); // Texture unit 0
+ 	  if( location_gradTexture != -1 )
+  		glUniform1i( location_gradTexture, 1 ); // Texture unit 1
+	  if( location_diffTexture != -1 )
+  		glUniform1i( location_diffTexture, 2 ); // Texture unit 2
+ 	  if( location_accumTexture != -1 )
+  		glUniform1i( location_accumTexture, 3 ); // Texture unit 3
+ 	  if( location_planetMap != -1 )
+  		glUniform1i( location_planetMap, 4 ); // Texture unit 4
+	  
+	  
+	  if( location_octavesIn != -1 )
+  		glUniform1i( location_octavesIn, octaves ); //
+	  if( location_frequency != -1 )
+  		glUniform3f( location_frequency, frequency[0], frequency[1], frequency[2] ); // 
+	  if( location_persistence != -1 )
+  		glUniform1f( location_persistence, persistence );
+}
+
+
+/*
+ * Multi-pass rendering. The octaves are split into bands of
+ * octavesPerPass, each band is drawn with its own (small) program and
+ * added into a float render target by blending, and a last pass turns
+ * the sums into colours. Every program stays small no matter how many
+ * octaves there are, which keeps 16-32 octaves within reach of drivers
+ * that choke on one huge fbm() loop.
+ */
+GLuint accumFBO = 0;
+GLuint accumDepthRB = 0;
+int accumWidth = 0;
+int accumHeight = 0;
+GLuint sceneFBO = 0; // Where the final image goes: the window, or offscreenFBO
+
+/*
+ * The sums are kept between frames, one texture per octave count:
+ * accumTextures[n] holds octaves 0 to n-1. While nothing but the octave
+ * count changes, Q/E start from the nearest sum already computed and
+ * add or subtract just the octaves in between, and going back to a count
+ * seen before costs no noise evaluation at all. Textures are only
+ * allocated for the counts actually visited.
+ */
+#define MAX_OCTAVES 32
+GLuint accumTextures[MAX_OCTAVES+1];
+GLboolean accumValid[MAX_OCTAVES+1];
+
+/* Everything besides the octave count that the cached sums depend on */
+typedef struct {
+    float t, time;
+    float frequency[3];
+    float persistence;
+    int arithmetic;
+} AccumState;
+AccumState accumState;
+
+/*
+ * invalidateAccum() - forget all the cached octave sums.
+ */
+void invalidateAccum()
+{
+    memset(accumValid, 0, sizeof(accumValid));
+}
+
+/*
+ * accumTexture(n) - the texture for the sum of n octaves, created on
+ * first use. It is left bound to texture unit 3.
+ */
+GLuint accumTexture(int n)
+{
+    glActiveTexture( GL_TEXTURE3 );
+    if(!accumTextures[n])
+    {
+        glGenTextures(1, &accumTextures[n]);
+        glBindTexture(GL_TEXTURE_2D, accumTextures[n]);
+        glTexImage2D( GL_TEXTURE_2D, 0, halfAccum ? GL_RG16F : GL_RG32F, accumWidth, accumHeight, 0, GL_RG, GL_FLOAT, NULL );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    }
+    else
+        glBindTexture(GL_TEXTURE_2D, accumTextures[n]);
+    glActiveTexture( GL_TEXTURE0 );
+    return accumTextures[n];
+}
+
+/*
+ * attachAccum(n) - bind the accumulation FBO, drawing into the sum of
+ * n octaves.
+ */
+void attachAccum(int n)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture(n), 0);
+}
+
+/*
+ * initAccumTarget(width, height) - (re)create the RG float targets the
+ * octave bands are added up in. Resizing drops all the cached sums.
+ */
+int initAccumTarget(int width, int height)
+{
+    int n;
+
+    if(width == accumWidth && height == accumHeight)
+        return GL_TRUE;
+    if(!glGenFramebuffers || !glFramebufferTexture2D)
+    {
+        printError("GL init error", "GL_ARB_framebuffer_object is required for multi-pass rendering");
+        octavesPerPass = 0;
+        return GL_FALSE;
+    }
+    if(!accumFBO)
+    {
+        glGenFramebuffers(1, &accumFBO);
+        glGenRenderbuffers(1, &accumDepthRB);
+    }
+    for(n = 0; n <= MAX_OCTAVES; n++)
+        if(accumTextures[n])
+        {
+            glDeleteTextures(1, &accumTextures[n]);
+            accumTextures[n] = 0;
+        }
+    invalidateAccum();
+    accumWidth = width;
+    accumHeight = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, accumDepthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    attachAccum(octaves);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, accumDepthRB);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printError("GL init error", "Float accumulation target is not supported, multi-pass disabled");
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        octavesPerPass = 0;
+        return GL_FALSE;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    return GL_TRUE;
+}
+
+/*
+ * maxAmplitude(octaves) - what fbm() divides by for this many octaves.
+ */
+float maxAmplitude(int octaves)
+{
+    float total = 0.0f, amplitude = 1.0f;
+    int i;
+    for(i = 0; i < octaves; i++)
+    {
+        total += amplitude;
+        amplitude *= persistence;
+    }
+    return total;
+}
+
+/*
+ * accumulateOctaves(first, count, t, time) - blend octaves first to
+ * first+count-1 into the bound accumulation target, octavesPerPass at a
+ * time (all at once without -multipass). The accumulation FBO must be
+ * bound, with blending on.
+ */
+void accumulateOctaves(int first, int count, float t, float time)
+{
+    float amplitude = 1.0f, scale = 1.0f;
+    int band, i;
+
+    // Step up to the first octave as fbm() does, not with pow(), so that
+    // the bands weigh each octave exactly as single-pass rendering does
+    for(i = 0; i < first; i++)
+    {
+        amplitude *= persistence;
+        scale *= 2.0f;
+    }
+    for(; count > 0; count -= band)
+    {
+        band = (octavesPerPass > 0 && count > octavesPerPass) ? octavesPerPass : count;
+        useProgram(getProgramVariant(MODE_ACCUMULATE, band), time);
+        if( location_octavesIn != -1 )
+            glUniform1i( location_octavesIn, band );
+        if( location_octaveAmplitude != -1 )
+            glUniform1f( location_octaveAmplitude, amplitude );
+        if( location_octaveScale != -1 )
+            glUniform1f( location_octaveScale, scale );
+        glPushMatrix();
+        drawScene(t);
+        glPopMatrix();
+        for(i = 0; i < band; i++)
+        {
+            amplitude *= persistence;
+            scale *= 2.0f;
+        }
+    }
+}
+
+/*
+ * updateAccum(n, t, time) - make accumTextures[n] hold the sum of n
+ * octaves, starting from the closest cached sum if there is one.
+ */
+void updateAccum(int n, float t, float time)
+{
+    int from = -1, i;
+
+    if(accumValid[n])
+        return;
+    for(i = 0; i <= MAX_OCTAVES; i++)
+        if(accumValid[i] && (from < 0 || abs(i - n) < abs(from - n)))
+            from = i;
+
+    glDepthFunc(GL_LEQUAL); // Later bands redraw the same surface
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_BLEND);
+    if(from < 0)
+    {
+        // Nothing to start from, add up all of the octaves.
+        attachAccum(n);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(0.0f, 0.1f, 0.3f, 1.0f);
+        accumulateOctaves(0, n, t, time);
+    }
+    else
+    {
+        // Copy the nearest sum, then add or take away the difference.
+        // The depth buffer still holds the surface from earlier passes.
+        attachAccum(from);
+        accumTexture(n);
+        glActiveTexture( GL_TEXTURE3 );
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, accumWidth, accumHeight);
+        glActiveTexture( GL_TEXTURE0 );
+        attachAccum(n);
+        if(from < n)
+            accumulateOctaves(from, n - from, t, time);
+        else
+        {
+            glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+            accumulateOctaves(n, from - n, t, time);
+            glBlendEquation(GL_FUNC_ADD);
+        }
+    }
+    glDisable(GL_BLEND);
+    glDepthFunc(GL_LESS);
+    accumValid[n] = GL_TRUE;
+}
+
+/*
+ * resolveOctaves(n, t, time) - draw the scene into sceneFBO, coloured
+ * from the sum of n octaves.
+ */
+void resolveOctaves(int n, float t, float time)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    accumTexture(n);
+    useProgram(getProgramVariant(MODE_RESOLVE, octaves), time);
+    if( location_accumScale != -1 )
+        glUniform2f( location_accumScale, 1.0f/accumWidth, 1.0f/accumHeight );
+    if( location_maxAmplitude != -1 )
+        glUniform1f( location_maxAmplitude, maxAmplitude(n) );
+    drawScene(t);
+}
+
+/*
+ * prepareAccum(t, time) - size the accumulation targets to the window,
+ * and drop the cached sums if anything but the octave count changed.
+ * Returns GL_FALSE if there is nothing to accumulate into.
+ */
+int prepareAccum(float t, float time)
+{
+    AccumState state;
+    int width, height;
+
+    glfwGetWindowSize( &width, &height );
+    if(!initAccumTarget(width, height))
+        return GL_FALSE;
+
+    memset(&state, 0, sizeof(state));
+    state.t = t;
+    state.time = time;
+    memcpy(state.frequency, frequency, sizeof(state.frequency));
+    state.persistence = persistence;
+    state.arithmetic = arithmeticNoise;
+    if(memcmp(&state, &accumState, sizeof(state)))
+    {
+        invalidateAccum();
+        accumState = state;
+    }
+    return GL_TRUE;
+}
+
+/*
+ * renderMultipass(t, time) - the multi-pass replacement for drawScene().
+ */
+void renderMultipass(float t, float time)
+{
+    if(!prepareAccum(t, time))
+        return;
+
+    updateAccum(octaves, t, time);
+
+    glPushMatrix();
+    resolveOctaves(octaves, t, time);
+    glPopMatrix();
+}
+
+
+/*
+ * Progressive refinement. With both the time and the rotation paused
+ * every frame is the same image, so rather than redrawing it in full
+ * the octaves are added progressiveBand at a time, coarsest first, on
+ * top of the sums kept for multi-pass rendering. Once all the octaves
+ * are in, sceneConverged() tells the caller to skip the frame, until
+ * anything changes and the refinement starts over.
+ */
+int progressiveBand = 2;             // Octaves added per frame, 0 for off
+int progressOctaves = 0;             // Octaves in the image so far
+GLboolean progressShown = GL_FALSE;  // The finished image is on screen
+
+/*
+ * refining() - whether renderScene() refines progressively right now.
+ * Lit shading needs the fbm() gradient, which the accumulation passes
+ * don't sum up, so it is always drawn in one pass.
+ */
+int refining()
+{
+    return progressiveBand > 0 && cubemapSize == 0 && !litShading && !updateTime && !animateObject;
+}
+
+/*
+ * sceneConverged() - true if the finished image is already on screen,
+ * and there is no need to draw the next frame at all.
+ */
+int sceneConverged()
+{
+    int width, height;
+
+    if(!refining() || !progressShown || progressOctaves != (int)octaves)
+        return GL_FALSE;
+    glfwGetWindowSize( &width, &height );
+    return width == accumWidth && height == accumHeight;
+}
+
+/*
+ * renderProgressive(t, time) - draw the next step of the refinement.
+ */
+void renderProgressive(float t, float time)
+{
+    int n;
+
+    if(!prepareAccum(t, time))
+    {
+        progressiveBand = 0; // No float targets, just draw it all
+        useProgram(getProgramVariant(MODE_SCENE, octaves), time);
+        drawScene(t);
+        return;
+    }
+    if(progressOctaves > 0 && !accumValid[progressOctaves])
+        progressOctaves = 0; // Something changed, back to the coarse image
+
+    n = (int)octaves;
+    if(progressOctaves < n && progressOctaves + progressiveBand < n)
+        n = progressOctaves + progressiveBand;
+    updateAccum(n, t, time);
+
+    glPushMatrix();
+    resolveOctaves(n, t, time);
+    glPopMatrix();
+    progressOctaves = n;
+    progressShown = n == (int)octaves;
+}
+
+#ifndef HEADLESS
+/*
+ * refreshWindow() - GLFW callback for when the window contents were
+ * lost, so a converged image has to be drawn again.
+ */
+void GLFWCALL refreshWindow(void)
+{
+    progressShown = GL_FALSE;
+}
+#endif
+
+
+/*
+ * Baked cubemap rendering. The surface colour only depends on the
+ * direction from the centre and the noise time, so GetColour() is baked
+ * into a cubemap once per time step and the sphere is drawn with a
+ * single cubemap lookup per pixel. The cost per frame no longer depends
+ * on the screen resolution, and spinning a paused planet is nearly free.
+ */
+GLuint cubeFBO = 0;
+GLuint cubeTextureID = 0;
+GLuint bakedProgram = 0; // What's in the cubemap right now
+float bakedTime = 0.0f;
+
+/* Centre, s and t directions of each face, in the GL cube map layout */
+const GLfloat cubeFaces[6][3][3] = {
+    { {  1, 0, 0 }, {  0, 0,-1 }, { 0,-1, 0 } }, // +X
+    { { -1, 0, 0 }, {  0, 0, 1 }, { 0,-1, 0 } }, // -X
+    { {  0, 1, 0 }, {  1, 0, 0 }, { 0, 0, 1 } }, // +Y
+    { {  0,-1, 0 }, {  1, 0, 0 }, { 0, 0,-1 } }, // -Y
+    { {  0, 0, 1 }, {  1, 0, 0 }, { 0,-1, 0 } }, // +Z
+    { {  0, 0,-1 }, { -1, 0, 0 }, { 0,-1, 0 } }  // -Z
+};
+
+/*
+ * initCubemap(GLuint *texID) - create the cubemap the surface is baked
+ * into, bound to texture unit 4, and the framebuffer to bake with.
+ */
+int initCubemap(GLuint *texID)
+{
+    int face;
+
+    if(!glGenFramebuffers || !glFramebufferTexture2D)
+    {
+        printError("GL init error", "GL_ARB_framebuffer_object is required for cubemap baking");
+        cubemapSize = 0;
+        return GL_FALSE;
+    }
+    glActiveTexture( GL_TEXTURE4 ); // Activate a different texture unit (unit 4)
+
+    glGenTextures(1, texID); // Generate a unique texture ID
+    glBindTexture(GL_TEXTURE_CUBE_MAP, *texID); // Bind the texture to texture unit 4
+    for(face = 0; face < 6; face++)
+        glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8,
+                      cubemapSize, cubemapSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+    // Mipmapped, since the whole planet often covers fewer pixels than a face.
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    if(glfwExtensionSupported("GL_ARB_seamless_cube_map"))
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+    glActiveTexture( GL_TEXTURE0 ); // Switch active texture unit back to 0 again
+
+    glGenFramebuffers(1, &cubeFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, cubeFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_CUBE_MAP_POSITIVE_X, *texID, 0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printError("GL init error", "Cannot render into a cubemap, baking disabled");
+        cubemapSize = 0;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    return cubemapSize > 0;
+}
+
+/*
+ * bakeCubemap(time) - render GetColour() into all six faces, unless the
+ * cubemap already holds this time step with the current settings.
+ */
+void bakeCubemap(float time)
+{
+    GLuint program = getProgramVariant(MODE_BAKE, octaves);
+    int face, width, height;
+
+    if(program == bakedProgram && time == bakedTime)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, cubeFBO);
+    glViewport( 0, 0, cubemapSize, cubemapSize );
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    useProgram(program, time);
+    for(face = 0; face < 6; face++)
+    {
+        const GLfloat (*axes)[3] = cubeFaces[face];
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeTextureID, 0);
+        glUniform3f( location_faceForward, axes[0][0], axes[0][1], axes[0][2] );
+        glUniform3f( location_faceRight, axes[1][0], axes[1][1], axes[1][2] );
+        glUniform3f( location_faceUp, axes[2][0], axes[2][1], axes[2][2] );
+        glBegin(GL_QUADS);
+        glVertex2f(-1.0f, -1.0f);
+        glVertex2f( 1.0f, -1.0f);
+        glVertex2f( 1.0f,  1.0f);
+        glVertex2f(-1.0f,  1.0f);
+        glEnd();
+    }
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glfwGetWindowSize( &width, &height );
+    glViewport( 0, 0, width, height );
+
+    glActiveTexture( GL_TEXTURE4 );
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glActiveTexture( GL_TEXTURE0 );
+
+    bakedProgram = program;
+    bakedTime = time;
+}
+
+
+/*
+ * preloadPrograms() - build the specialized programs of every octave
+ * count for the passes renderScene() draws with the current settings.
+ */
+void preloadPrograms()
+{
+    GLuint o;
+
+    if(cubemapSize > 0)
+    {
+        getProgramVariant(MODE_CUBEMAP, 0);
+        for(o = 2; o <= 32; o++)
+            getProgramVariant(MODE_BAKE, o);
+    }
+    else if(octavesPerPass > 0)
+    {
+        // The bands only go up to octavesPerPass, whatever the octaves
+        getProgramVariant(MODE_RESOLVE, 0);
+        for(o = 1; o <= (GLuint)octavesPerPass; o++)
+            getProgramVariant(MODE_ACCUMULATE, o);
+    }
+    else
+    {
+        for(o = 2; o <= 32; o++)
+            getProgramVariant(MODE_SCENE, o);
+    }
+}
+
+
+/*
+ * renderScene(double time) - a wrapper to drawScene() to switch shaders
+ * on and off. "time" drives both the animation and the shader noise.
+ */
+void renderScene( double time )
+{
+  static float t, noiseTime;
+  static int started = GL_FALSE;
+  if (animateObject || !started) t = (float)time; // Get elapsed time
+  if (updateTime || !started) noiseTime = (float)time;
+  started = GL_TRUE;
+
+  // Render with the shaders active, timing the GPU work.
+  beginFrameProfile();
+  if(cubemapSize > 0)
+  {
+    bakeCubemap(noiseTime);
+    useProgram(getProgramVariant(MODE_CUBEMAP, octaves), noiseTime);
+    drawScene(t);
+  }
+  else if(refining())
+  {
+    renderProgressive(t, noiseTime);
+  }
+  else if(octavesPerPass > 0)
+  {
+    renderMultipass(t, noiseTime);
+  }
+  else
+  {
+    useProgram(getProgramVariant(MODE_SCENE, octaves), noiseTime);
+    drawScene(t);
+  }
+  endFrameProfile();
+  if(!refining())
+    progressOctaves = 0;
+  // Deactivate the shaders.
+  glUseProgram(0);
+}
+
+
+/*
+ * profileMedian(field) - the p50 of one sample field over the window,
+ * NAN if it has none.
+ */
+double profileMedian(size_t field)
+{
+    static double values[PROFILE_SAMPLES];
+    int n = profileValues(field, PROFILE_SAMPLES, values);
+    return n > 0 ? percentile(values, n, 0.50) : NAN;
+}
+
+
+/*
+ * runBenchmark() - render every combination of the sweep sizes, sphere
+ * tessellations and octave counts without vsync, and print one CSV line
+ * of median frame times per combination. The "per_octave" columns are
+ * the marginal cost of the last octave added, relative to the line above.
+ */
+int runBenchmark()
+{
+    int size, segs, frame, width, height;
+    double gpu, cpu, total, lastGpu, lastTotal;
+
+    glfwSwapInterval(0); // Uncapped, we want the real cost of each frame
+    printf("width,height,segments,octaves,gpu_ms,cpu_ms,frame_ms,fragments,"
+           "gpu_ms_per_octave,frame_ms_per_octave\n");
+    for(size = 0; size < numSweepSizes; size++)
+    {
+        glfwSetWindowSize(sweepWidths[size], sweepHeights[size]);
+        for(segs = 0; segs < numSweepSegments; segs++)
+        {
+            glDeleteLists(sphereList, 1);
+            initSphereList(&sphereList, 1.0, sweepSegments[segs]);
+            lastGpu = lastTotal = -1.0;
+            for(octaves = sweepOctavesMin; octaves <= (GLuint)sweepOctavesMax; octaves++)
+            {
+                for(frame = -benchmarkWarmup; frame < numFrames; frame++)
+                {
+                    if(frame == 0)
+                        resetProfile();
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    setupCamera();
+                    renderScene(startTime + frame*timeStep);
+                    glfwSwapBuffers();
+                }
+                collectProfile(GL_TRUE);
+
+                // The window may not get exactly the size we asked for.
+                glfwGetWindowSize(&width, &height);
+                gpu = profileMedian(offsetof(FrameSample, gpuMs));
+                cpu = profileMedian(offsetof(FrameSample, cpuMs));
+                total = profileMedian(offsetof(FrameSample, frameMs));
+                printf("%d,%d,%d,%u,%.4f,%.4f,%.4f,%.0f,", width, height,
+                       sweepSegments[segs], octaves, gpu, cpu, total,
+                       profileMedian(offsetof(FrameSample, fragments)));
+                if(lastGpu >= 0.0)
+                    printf("%.4f,%.4f\n", gpu - lastGpu, total - lastTotal);
+                else
+                    printf(",\n");
+                fflush(stdout);
+                lastGpu = gpu;
+                lastTotal = total;
+            }
+        }
+    }
+    return GL_TRUE;
+}
+
+
+/*
+ * checkCPU() - bake the cubemap on the GPU, compute every texel again
+ * with getColour() from noise.c, and print how far apart they are.
+ * Returns GL_FALSE if any channel is off by more than one step.
+ */
+int checkCPU()
+{
+    unsigned char *pixels;
+    float p[3], rgb[3], x, y, len;
+    double sum = 0.0;
+    long count = 0, off = 0;
+    int face, i, j, k, diff, worst = 0;
+
+    if(arithmeticNoise)
+    {
+        printError("CPU check", "noise.c only has the texture noise, use -noise texture");
+        return GL_FALSE;
+    }
+    if(cubemapSize <= 0)
+        return GL_FALSE;
+    bakeCubemap((float)startTime);
+    glActiveTexture( GL_TEXTURE4 );
+
+    pixels = (unsigned char*)malloc( cubemapSize*cubemapSize*3 );
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for(face = 0; face < 6; face++)
+    {
+        const GLfloat (*axes)[3] = cubeFaces[face];
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        for(j = 0; j < cubemapSize; j++)
+            for(i = 0; i < cubemapSize; i++)
+            {
+                // The direction cubeface.vert interpolates to this texel
+                x = 2.0f * (i + 0.5f) / cubemapSize - 1.0f;
+                y = 2.0f * (j + 0.5f) / cubemapSize - 1.0f;
+                for(k = 0; k < 3; k++)
+                    p[k] = axes[0][k] + x * axes[1][k] + y * axes[2][k];
+                len = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+                for(k = 0; k < 3; k++)
+                    p[k] /= len;
+                getColour(p, octaves, frequency, persistence, (float)startTime, rgb);
+                for(k = 0; k < 3; k++)
+                {
+                    diff = abs((int)(rgb[k] * 255.0f + 0.5f) - pixels[(j*cubemapSize + i)*3 + k]);
+                    if(diff > worst) worst = diff;
+                    if(diff > 1) off++;
+                    sum += diff;
+                    count++;
+                }
+            }
+    }
+    free(pixels);
+    glActiveTexture( GL_TEXTURE0 );
+
+    printf("CPU vs GPU, 6 faces of %dx%d, %u octaves: max diff %d/255, mean %.4f/255, "
+           "%ld of %ld channels off by more than 1/255\n", cubemapSize, cubemapSize,
+           octaves, worst, sum / count, off, count);
+    return off == 0;
+}
+
+
+/*
+ * parseList(value, first, second, max) - parse a comma separated list of
+ * numbers, or of WxH sizes when "second" is not NULL. Returns the number
+ * of entries, or 0 if the list is malformed.
+ */
+int parseList(const char *value, int *first, int *second, int max)
+{
+    int n = 0, used;
+    while(n < max)
+    {
+        if(second ? sscanf(value, "%dx%d%n", &first[n], &second[n], &used) != 2
+                  : sscanf(value, "%d%n", &first[n], &used) != 1)
+            return 0;
+        if(first[n] <= 0 || (second && second[n] <= 0))
+            return 0;
+        n++;
+        value += used;
+        if(*value == 0)
+            return n;
+        if(*value++ != ',')
+            return 0;
+    }
+    return 0;
+}
+
+
+#ifdef HEADLESS
+/*
+ * initOffscreen() - create the framebuffer object that stands in for
+ * the window in the headless build, and leave it bound.
+ */
+int initOffscreen()
+{
+    if( !glGenFramebuffers || !glGenRenderbuffers )
+    {
+        printError("GL init error", "GL_ARB_framebuffer_object is required for headless rendering");
+        return GL_FALSE;
+    }
+    glGenRenderbuffers(1, &offscreenColorRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColorRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, offscreenWidth, offscreenHeight);
+    glGenRenderbuffers(1, &offscreenDepthRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, offscreenWidth, offscreenHeight);
+
+    glGenFramebuffers(1, &offscreenFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFBO);
+    sceneFBO = offscreenFBO;
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColorRB);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreenDepthRB);
+    if( glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        printError("GL init error", "Offscreen framebuffer is incomplete");
+        return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+
+/*
+ * writePPM(filename, width, height) - read back the current framebuffer
+ * and save it as a binary PPM image, the same format as out_rgb.h.
+ */
+int writePPM(const char *filename, int width, int height)
+{
+    unsigned char *pixels;
+    FILE *file;
+    int row;
+
+    pixels = (unsigned char*)malloc( width*height*3 );
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    glReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels );
+
+    file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        printError("ERROR", "Cannot open output image file!");
+        free(pixels);
+        return GL_FALSE;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    // OpenGL rows run bottom to top, PPM rows top to bottom.
+    for(row = height-1; row >= 0; row--)
+        fwrite(pixels + row*width*3, 1, width*3, file);
+    fclose(file);
+    free(pixels);
+    return GL_TRUE;
+}
+
+
+/*
+ * renderFrames() - the headless replacement for the interactive main
+ * loop: render numFrames frames at fixed time steps and write them out.
+ */
+int renderFrames()
+{
+    char filename[1024];
+    double t, elapsed;
+    int frame;
+
+    t = glfwGetTime();
+    for(frame = 0; frame < numFrames; frame++)
+    {
+        // A converged image is still in the framebuffer, write it again.
+        if(!sceneConverged())
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            setupCamera();
+            renderScene(startTime + frame*timeStep);
+        }
+        else
+            profileLastFrame = -1.0;
+
+        if(outputPrefix)
+        {
+            sprintf(filename, "%.1000s%04d.ppm", outputPrefix, frame);
+            if(!writePPM(filename, offscreenWidth, offscreenHeight))
+                return GL_FALSE;
+        }
+    }
+    glFinish();
+    elapsed = glfwGetTime() - t;
+
+    printf("%d frames at %dx%d, %u octaves: %.2f ms/frame\n", numFrames,
+           offscreenWidth, offscreenHeight, octaves, 1000.0*elapsed/numFrames);
+    reportProfile(stdout);
+    return GL_TRUE;
+}
+#endif
+
+
+/*
+ * parseArguments(argc, argv) - pick up render settings from the command
+ * line. Prints a usage message and returns GL_FALSE on anything unknown.
+ */
+int parseArguments(int argc, char *argv[])
+{
+    int i;
+    for(i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i+1 < argc) ? argv[i+1] : NULL;
+
+        if(!strcmp(arg, "-nooutput"))
+        {
+            outputPrefix = NULL;
+            continue;
+        }
+        if(!strcmp(arg, "-cpucheck"))
+        {
+            cpuCheck = GL_TRUE;
+            continue;
+        }
+        if(!strcmp(arg, "-benchmark"))
+        {
+            benchmark = GL_TRUE;
+            continue;
+        }
+        if(!strcmp(arg, "-specialize"))
+        {
+            specialize = GL_TRUE;
+            continue;
+        }
+        if(!strcmp(arg, "-pause"))
+        {
+            updateTime = GL_FALSE;
+            continue;
+        }
+        if(!strcmp(arg, "-norotate"))
+        {
+            animateObject = GL_FALSE;
+            continue;
+        }
+        if(!strcmp(arg, "-lit"))
+        {
+            litShading = GL_TRUE;
+            continue;
+        }
+        if(!strcmp(arg, "-halfaccum"))
+        {
+            halfAccum = GL_TRUE;
+            continue;
+        }
+        if(!strcmp(arg, "-noshadercache"))
+        {
+            shaderCacheDir = NULL;
+            continue;
+        }
+        if(value == NULL)
+            goto usage;
+        if(!strcmp(arg, "-size"))
+        {
+            if(sscanf(value, "%dx%d", &windowWidth, &windowHeight) != 2 ||
+               windowWidth <= 0 || windowHeight <= 0)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-octaves"))
+        {
+            octaves = (GLuint)atoi(value);
+            if(octaves < 2 || octaves > 32)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-frequency"))
+        {
+            if(sscanf(value, "%f,%f,%f", &frequency[0], &frequency[1], &frequency[2]) != 3)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-multipass"))
+        {
+            octavesPerPass = atoi(value);
+            if(octavesPerPass < 1)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-progressive"))
+        {
+            progressiveBand = atoi(value);
+            if(progressiveBand < 0)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-cubemap"))
+        {
+            cubemapSize = atoi(value);
+            if(cubemapSize < 1)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-persistence"))
+            persistence = (GLfloat)atof(value);
+        else if(!strcmp(arg, "-segments"))
+        {
+            sphereSegments = atoi(value);
+            if(sphereSegments < 3)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-sweep-sizes"))
+        {
+            numSweepSizes = parseList(value, sweepWidths, sweepHeights, MAX_SWEEP);
+            if(numSweepSizes == 0)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-sweep-segments"))
+        {
+            numSweepSegments = parseList(value, sweepSegments, NULL, MAX_SWEEP);
+            if(numSweepSegments == 0)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-sweep-octaves"))
+        {
+            if(sscanf(value, "%d-%d", &sweepOctavesMin, &sweepOctavesMax) != 2 ||
+               sweepOctavesMin < 2 || sweepOctavesMax > 32 ||
+               sweepOctavesMin > sweepOctavesMax)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-noise"))
+        {
+            if(!strcmp(value, "arithmetic"))
+                arithmeticNoise = GL_TRUE;
+            else if(!strcmp(value, "texture"))
+                arithmeticNoise = GL_FALSE;
+            else
+                goto usage;
+        }
+        else if(!strcmp(arg, "-shadercache"))
+            shaderCacheDir = value;
+        else if(!strcmp(arg, "-time"))
+            startTime = atof(value);
+        else if(!strcmp(arg, "-timestep"))
+            timeStep = atof(value);
+        else if(!strcmp(arg, "-frames"))
+        {
+            numFrames = atoi(value);
+            if(numFrames <= 0)
+                goto usage;
+        }
+        else if(!strcmp(arg, "-output"))
+            outputPrefix = value;
+        else
+            goto usage;
+        i++;
+    }
+    if(litShading && (octavesPerPass > 0 || cubemapSize > 0 || cpuCheck))
+    {
+        fprintf(stderr, "-lit only works with single-pass rendering\n");
+        goto usage;
+    }
+    if(numFrames == 0)
+        numFrames = benchmark ? 10 : 1;
+    return GL_TRUE;
+
+usage:
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -size WxH           render size (default 640x480)\n"
+        "  -octaves N          fbm octaves, 2 to 32 (default 8)\n"
+        "  -frequency X,Y,Z    fbm base frequencies (default 0.5,1.0,2.0)\n"
+        "  -persistence P      fbm amplitude falloff per octave (default 0.5)\n"
+        "  -specialize         compile octaves, frequency and persistence into\n"
+        "                      the shader, one unrolled program per octave count\n"
+        "  -multipass N        render N octaves per pass, summed in a float target\n"
+        "  -halfaccum          sum the passes in RG16F rather than RG32F\n"
+        "  -cubemap N          bake the surface into an NxN cubemap per time step\n"
+        "  -segments N         sphere tessellation (default 20)\n"
+        "  -pause              start with the noise time frozen (the S key)\n"
+        "  -norotate           start with the rotation stopped (the X key)\n"
+        "  -progressive N      when both are paused, add N octaves per frame\n"
+        "                      and stop drawing once done (default 2, 0 is off)\n"
+        "  -lit                light the surface, bump mapped by the analytic fbm\n"
+        "                      gradient (single-pass rendering only)\n"
+        "  -noise TYPE         \"texture\" (default) or \"arithmetic\" noise hashing\n"
+        "  -shadercache DIR    program binary cache (default \"shadercache\")\n"
+        "  -noshadercache      always compile the shaders from source\n"
+        "  -cpucheck           compare the CPU noise in noise.c with a GPU baked\n"
+        "                      cubemap (-cubemap N, default 128) and quit\n"
+        "Benchmark mode, prints CSV to stdout:\n"
+        "  -benchmark          time every combination of the settings below\n"
+        "  -sweep-sizes LIST   render sizes (default 320x240,640x480,1280x720)\n"
+        "  -sweep-segments LIST sphere tessellations (default 10,20,40)\n"
+        "  -sweep-octaves A-B  octave range (default 2-32)\n"
+        "  -frames N           measured frames per combination (default 10)\n"
+        "Headless build only:\n"
+        "  -frames N           number of frames to render (default 1)\n"
+        "  -time T             shader time of the first frame (default 0)\n"
+        "  -timestep DT        time step between frames (default 1/60)\n"
+        "  -output PREFIX      write frames to PREFIX0000.ppm, ... (default \"frame\")\n"
+        "  -nooutput           render only, don't write any images\n",
+        argv[0]);
+    return GL_FALSE;
+}
+
+
+/*
+ * main(argc, argv) - the standard C entry point for the program
+ */
+int main(int argc, char *argv[]) {
+
+    int running = GL_TRUE; // Main loop exits when this is set to GL_FALSE
+    
+    if( !parseArguments(argc, argv) )
+        return 1;
+
+    // Initialise GLFW
+    glfwInit();
+
+    // Open the OpenGL window
+    if( !glfwOpenWindow(windowWidth, windowHeight, 8,8,8,8, 32,0, GLFW_WINDOW) )
+    {
+        glfwTerminate(); // glfwOpenWindow failed, quit the program.
+        return 1;
+    }
+#ifndef HEADLESS
+    glfwSetWindowRefreshCallback(refreshWindow);
+#endif
+    
+    // Load the extensions for GLSL - note that this has to be done
+    // *after* the window has been opened, or we won't have a GL context
+    // to query for those extensions and connect to instances of them.
+    loadExtensions();
+
+#ifdef HEADLESS
+    // There is no window to draw into, so render into an FBO instead.
+    if( !initOffscreen() )
+    {
+        glfwTerminate();
+        return 1;
+    }
+#endif
+
+    // Create the two shaders
+    createShaders();
+
+    // Set up the GPU queries for the frame time display
+    initProfiler();
+
+    // Enable back face culling and Z buffering
+    glEnable(GL_CULL_FACE); // Cull away all back facing polygons
+    glEnable(GL_DEPTH_TEST); // Use the Z buffer
+
+    // Use a dark blue color with A=1 for the background color
+    glClearColor(0.0f, 0.1f, 0.3f, 1.0f);
+
+    glEnable(GL_TEXTURE_1D); // Enable 1D texturing
+    glEnable(GL_TEXTURE_2D); // Enable 2D texturing
+
+    // Create and load the textures (generated, not read from a file).
+    // The arithmetic noise variant doesn't need the lookup tables.
+    if( !arithmeticNoise )
+    {
+        initPermTexture(&permTextureID);
+        initGradTexture(&gradTextureID);
+    }
+	initDiffTexture(&diffTextureID);
+    if( cpuCheck && cubemapSize <= 0 )
+        cubemapSize = 128;
+    if( cubemapSize > 0 )
+        initCubemap(&cubeTextureID);
+    
+    // Compile a display list for the teapot, to render it more quickly
+    initSphereList(&sphereList, 1.0, sphereSegments);
+
+    if( cpuCheck )
+    {
+        running = checkCPU();
+        glfwTerminate();
+        return running ? 0 : 1;
+    }
+
+    if( benchmark )
+    {
+        running = runBenchmark();
+        glfwTerminate();
+        return running ? 0 : 1;
+    }
+
+#ifdef HEADLESS
+    // Render the requested frames and quit, there's nobody to press ESC.
+    running = renderFrames();
+    glfwTerminate();
+    return running ? 0 : 1;
+#else
+    glfwSwapInterval(1); // Wait for screen refresh between frames
+
+    // Build every octave count up front, so Q/E never stalls on a compile.
+    if( specialize )
+        preloadPrograms();
+    
+    // Main loop
+    while(running)
+    {
+        // Update the frames per second (FPS) and frame time display
+        showProfile();
+
+        // Nothing left to refine and nothing changed: leave the GPU alone.
+        if(sceneConverged())
+        {
+            glfwSleep(0.02);
+            glfwPollEvents();
+            profileLastFrame = -1.0; // Don't time the idle stretch as a frame
+        }
+        else
+        {
+            // Clear the color buffer and the depth buffer.
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // Set up the camera projection.
+            setupCamera();
+
+            // Draw the scene.
+            renderScene(glfwGetTime());
+
+            // Swap buffers, i.e. display the image and prepare for next frame.
+            glfwSwapBuffers();
+        }
+
+        // Decide whether to update the shader "time" variable or not
+        if(glfwGetKey('A')) updateTime = GL_TRUE;
+        if(glfwGetKey('S')) updateTime = GL_FALSE;
+        // Decide whether to animate the rotation for the scene or not
+        if(glfwGetKey('Z')) animateObject = GL_TRUE;
+        if(glfwGetKey('X')) animateObject = GL_FALSE;
+		
+        // Increase / Decrease the number of octaves used in the shader fbm noise
+		static float fLastTime = 0.0f;
+		const float currTime = (float)glfwGetTime();
+		if(currTime - fLastTime > 0.5f) {
+			if(glfwGetKey('Q')) {
+				if(octaves < 32) ++octaves;
+				fLastTime = currTime;
+			}
+			if(glfwGetKey('E')) {
+				if(octaves > 2) --octaves;
+				fLastTime = currTime;
+			}
+		}
+		
+
+        // Check if the ESC key was pressed or the window was closed.
+        if(glfwGetKey(GLFW_KEY_ESC) || !glfwGetWindowParam(GLFW_OPENED))
+          running = GL_FALSE;
+    }
+
+    // Print the frame time statistics for the whole run
+    reportProfile(stdout);
+
+    // Close the OpenGL window and terminate GLFW.
+    glfwTerminate();
+
+    return 0;
+#endif
+}
@@ -0,0 +1,19 @@
+#version 120
+
+/*
+ * Vertex shader for baking one face of the planet cubemap. The quad
+ * covers the whole face, and v_texCoord3D is the cube direction of each
+ * corner, so test.frag shades exactly what the sphere would show there.
+ */
+
+uniform vec3 faceForward; // Direction through the centre of the face
+uniform vec3 faceRight;   // Direction of increasing s on the face
+uniform vec3 faceUp;      // Direction of increasing t on the face
+
+varying vec3 v_texCoord3D;
+
+void main( void )
+{
+	gl_Position = vec4(gl_Vertex.xy, 0.0, 1.0);
+	v_texCoord3D = faceForward + gl_Vertex.x * faceRight + gl_Vertex.y * faceUp;
+}
@@ -0,0 +1,15 @@
+#version 120
+
+/*
+ * Shade the sphere from the baked planet cubemap: one texture lookup per
+ * pixel instead of two fbm() evaluations.
+ */
+
+uniform samplerCube planetMap;
+
+varying vec3 v_texCoord3D;
+
+void main(void)
+{
+	gl_FragColor = vec4(textureCube(planetMap, v_texCoord3D).rgb, 1.0);
+}
@@ -0,0 +1,346 @@
+/*
+ * 4D simplex noise and fbm on the CPU, a scalar port of test.frag.
+ * See noise.h for how closely this follows the GPU.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include "noise.h"
+#include "noise_internal.h"
+
+// colour ramp image
+#include "out_rgb.h"
+
+int noisePermutation[256]= {151,160,137,91,90,15,
+  131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+  190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
+  88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
+  77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+  102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
+  135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
+  5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+  223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
+  129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
+  251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
+  49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
+  138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180};
+
+/* These are Ken Perlin's proposed gradients for 3D noise. I kept them for
+   better consistency with the reference implementation, but there is really
+   no need to pad this to 16 gradients for this particular implementation.
+   If only the "proper" first 12 gradients are used, they can be extracted
+   from the noiseGrad4[][] array:
+   noiseGrad3[i][j] == noiseGrad4[i*2][j], 0<=i<=11, j=0,1,2
+*/
+int noiseGrad3[16][3] = {{0,1,1},{0,1,-1},{0,-1,1},{0,-1,-1},
+                   {1,0,1},{1,0,-1},{-1,0,1},{-1,0,-1},
+                   {1,1,0},{1,-1,0},{-1,1,0},{-1,-1,0}, // 12 cube edges
+                   {1,0,-1},{-1,0,-1},{0,-1,1},{0,1,1}}; // 4 more to make 16
+
+/* These are my own proposed gradients for 4D noise. They are the coordinates
+   of the midpoints of each of the 32 edges of a tesseract, just like the 3D
+   noise gradients are the midpoints of the 12 edges of a cube.
+*/
+int noiseGrad4[32][4]= {{0,1,1,1}, {0,1,1,-1}, {0,1,-1,1}, {0,1,-1,-1}, // 32 tesseract edges
+                   {0,-1,1,1}, {0,-1,1,-1}, {0,-1,-1,1}, {0,-1,-1,-1},
+                   {1,0,1,1}, {1,0,1,-1}, {1,0,-1,1}, {1,0,-1,-1},
+                   {-1,0,1,1}, {-1,0,1,-1}, {-1,0,-1,1}, {-1,0,-1,-1},
+                   {1,1,0,1}, {1,1,0,-1}, {1,-1,0,1}, {1,-1,0,-1},
+                   {-1,1,0,1}, {-1,1,0,-1}, {-1,-1,0,1}, {-1,-1,0,-1},
+                   {1,1,1,0}, {1,1,-1,0}, {1,-1,1,0}, {1,-1,-1,0},
+                   {-1,1,1,0}, {-1,1,-1,0}, {-1,-1,1,0}, {-1,-1,-1,0}};
+
+/* The ramp pixels, at the same offset into the PNM that the diffuse
+   texture is loaded from */
+const unsigned char *noiseColourRamp = MagickImage+12;
+
+/*
+ * permAt(x, y) - the permTexture alpha at column x, row y, as a texel
+ * index into the next lookup.
+ */
+static int permAt(int x, int y)
+{
+    return noisePermutation[(x + noisePermutation[y & 0xFF]) & 0xFF];
+}
+
+/*
+ * gradComponent(g) - a noiseGrad4[][] component after the round trip through
+ * gradTexture: stored as g*64+64, read back as c/255, scaled by 4 and
+ * offset by -1. This is not quite g, 1 comes out as 1.0078.
+ */
+static float gradComponent(int g)
+{
+    return (float)(g * 64 + 64) / 255.0f * 4.0f - 1.0f;
+}
+
+/*
+ * corner(i, Pf, gradient) - the contribution of the simplex corner with
+ * integer coordinates i, at offset Pf from the point. Unless gradient is
+ * NULL, the gradient of the contribution is added to it: with
+ * t = 0.6 - |Pf|^2 the corner adds t^4 (g.Pf), whose gradient is
+ * t^4 g - 8 t^3 (g.Pf) Pf.
+ */
+static float corner(const int i[4], const float Pf[4], float gradient[4])
+{
+    int xy, zw, *g, k;
+    float grad[4], n, t2;
+    float t = 0.6f - (Pf[0]*Pf[0] + Pf[1]*Pf[1] + Pf[2]*Pf[2] + Pf[3]*Pf[3]);
+
+    if(t < 0.0f)
+        return 0.0f;
+    // Two perm lookups, each giving a texture coordinate of value/255.
+    // The nearest texel to 255/255 is texel 256, which wraps to 0.
+    xy = permAt(i[0], i[1]);
+    zw = permAt(i[2], i[3]);
+    if(xy == 255) xy = 0;
+    if(zw == 255) zw = 0;
+    g = noiseGrad4[permAt(xy, zw) & 0x1F];
+    for(k = 0; k < 4; k++)
+        grad[k] = gradComponent(g[k]);
+    n = grad[0]*Pf[0] + grad[1]*Pf[1] + grad[2]*Pf[2] + grad[3]*Pf[3];
+    t2 = t * t;
+    if(gradient)
+        for(k = 0; k < 4; k++)
+            gradient[k] += t2 * t2 * grad[k] - 8.0f * t2 * t * n * Pf[k];
+    return t2 * t2 * n;
+}
+
+/*
+ * simplex4(x, y, z, w, gradient) - snoise4(), and its gradient unless
+ * gradient is NULL.
+ */
+static float simplex4(float x, float y, float z, float w, float gradient[4])
+{
+    float P[4], Pf0[4], Pf[4], s, t;
+    int Pi[4], i[4], rank[4], k, c;
+
+    // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+    P[0] = x; P[1] = y; P[2] = z; P[3] = w;
+    s = (x + y + z + w) * F4;
+    for(k = 0; k < 4; k++)
+        Pi[k] = (int)floorf(P[k] + s);
+    t = (float)(Pi[0] + Pi[1] + Pi[2] + Pi[3]) * G4;
+    for(k = 0; k < 4; k++)
+        Pf0[k] = P[k] - ((float)Pi[k] - t); // The distances from the cell origin
+
+    // Rank the components like simplex() does: rank[k] counts the other
+    // components that component k beats, ties going to the earlier one.
+    rank[0] = (Pf0[0] >= Pf0[1]) + (Pf0[0] >= Pf0[2]) + (Pf0[0] >= Pf0[3]);
+    rank[1] = (Pf0[0] <  Pf0[1]) + (Pf0[1] >= Pf0[2]) + (Pf0[1] >= Pf0[3]);
+    rank[2] = (Pf0[0] <  Pf0[2]) + (Pf0[1] <  Pf0[2]) + (Pf0[2] >= Pf0[3]);
+    rank[3] = (Pf0[0] <  Pf0[3]) + (Pf0[1] <  Pf0[3]) + (Pf0[2] <  Pf0[3]);
+
+    // Corner c (1 to 3) steps along every component ranked 4-c or higher,
+    // and lies c*G4 further along the unskewed diagonal.
+    if(gradient)
+        gradient[0] = gradient[1] = gradient[2] = gradient[3] = 0.0f;
+    s = corner(Pi, Pf0, gradient);
+    for(c = 1; c <= 3; c++)
+    {
+        for(k = 0; k < 4; k++)
+        {
+            int o = rank[k] >= 4 - c;
+            i[k] = Pi[k] + o;
+            Pf[k] = Pf0[k] - (float)o + (float)c * G4;
+        }
+        s += corner(i, Pf, gradient);
+    }
+    for(k = 0; k < 4; k++)
+    {
+        i[k] = Pi[k] + 1;
+        Pf[k] = Pf0[k] - (1.0f - 4.0f*G4);
+    }
+    s += corner(i, Pf, gradient);
+
+    // Sum up and scale the result to cover the range [-1,1]
+    if(gradient)
+        for(k = 0; k < 4; k++)
+            gradient[k] *= 27.0f;
+    return 27.0f * s;
+}
+
+float snoise4(float x, float y, float z, float w)
+{
+    return simplex4(x, y, z, w, NULL);
+}
+
+float snoise4Grad(float x, float y, float z, float w, float gradient[4])
+{
+    return simplex4(x, y, z, w, gradient);
+}
+
+/*
+ * saturate16(v) - v clamped to 16 bits, as the saturating SIMD adds do.
+ */
+static int saturate16(int v)
+{
+    return v < -32768 ? -32768 : v > 32767 ? 32767 : v;
+}
+
+/*
+ * mulhrs16(a, b) - pmulhrsw, the product of two Q15 numbers rounded to
+ * Q15. Never called with both a and b -32768, the one case that
+ * overflows.
+ */
+static int mulhrs16(int a, int b)
+{
+    return (a * b + 0x4000) >> 15;
+}
+
+/*
+ * cornerFixed(i, Pf) - corner() in fixed point, see noise_internal.h:
+ * the contribution of the corner with integer coordinates i, at Q15
+ * offsets Pf from the point, in Q17.
+ */
+static int cornerFixed(const int i[4], const int Pf[4])
+{
+    int t = RADIUS_FIXED, xy, zw, g, h, a = 0, sum = 0, k;
+
+    for(k = 0; k < 4; k++)
+        t = saturate16(t - mulhrs16(Pf[k], Pf[k]));
+    if(t < 0)
+        t = 0;
+    t = mulhrs16(t, t) << 1;
+    t = mulhrs16(t, t);
+    xy = permAt(i[0], i[1]);
+    zw = permAt(i[2], i[3]);
+    if(xy == 255) xy = 0;
+    if(zw == 255) zw = 0;
+    g = permAt(xy, zw) & 0x1F;
+    for(k = 0; k < 4; k++)
+    {
+        h = mulhrs16(t, Pf[k]);
+        sum += h;
+        a += noiseGrad4[g][k] * h;
+    }
+    return a + mulhrs16(a + sum, 128);
+}
+
+int snoise4Fixed(int x, int y, int z, int w)
+{
+    int P[4], Pi[4], Pf0[4], Pf[4], i[4], rank[4], s, n, k, c;
+
+    // Skew, with the products split to fit in 32 bits
+    P[0] = x; P[1] = y; P[2] = z; P[3] = w;
+    s = x + y + z + w;
+    s = (s >> 16) * F4_HIGH + (((s >> 16) * F4_LOW) >> 15) + (((s & 0xFFFF) * F4_HIGH) >> 16);
+    for(k = 0; k < 4; k++)
+        Pi[k] = (P[k] + s) >> 16;
+    s = Pi[0] + Pi[1] + Pi[2] + Pi[3];
+    s = s * G4_HIGH + ((s * G4_LOW) >> 15);
+    for(k = 0; k < 4; k++)
+        Pf0[k] = saturate16((P[k] - (Pi[k] << 16) + s) >> 1);
+
+    rank[0] = (Pf0[0] >= Pf0[1]) + (Pf0[0] >= Pf0[2]) + (Pf0[0] >= Pf0[3]);
+    rank[1] = (Pf0[0] <  Pf0[1]) + (Pf0[1] >= Pf0[2]) + (Pf0[1] >= Pf0[3]);
+    rank[2] = (Pf0[0] <  Pf0[2]) + (Pf0[1] <  Pf0[2]) + (Pf0[2] >= Pf0[3]);
+    rank[3] = (Pf0[0] <  Pf0[3]) + (Pf0[1] <  Pf0[3]) + (Pf0[2] <  Pf0[3]);
+
+    // The offset of corner c is c*G4, less 1 along the components it
+    // steps along, which fits in Q15 either way
+    n = 0;
+    for(c = 0; c <= 4; c++)
+    {
+        for(k = 0; k < 4; k++)
+        {
+            int o = rank[k] >= 4 - c;
+            i[k] = Pi[k] + o;
+            Pf[k] = saturate16(Pf0[k] + c * G4_Q15 - (o ? 32768 : 0));
+            if(Pf[k] < -32767)
+                Pf[k] = -32767;
+        }
+        n += cornerFixed(i, Pf);
+    }
+
+    // 27 * n, from Q17 to Q15
+    s = saturate16(n + n);
+    s = saturate16(saturate16(s + s) + s);
+    return saturate16(s + mulhrs16(n, 24576));
+}
+
+float fbm(const float position[3], int octaves, float frequency,
+          float persistence, float time)
+{
+    float total = 0.0f;
+    float maxAmplitude = 0.0f;
+    float amplitude = 1.0f;
+    int i;
+
+    for(i = 0; i < octaves; i++)
+    {
+        total += snoise4(position[0] * frequency, position[1] * frequency,
+                         position[2] * frequency, time) * amplitude;
+        frequency *= 2.0f;
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+    }
+    return total / maxAmplitude;
+}
+
+float fbmGrad(const float position[3], int octaves, float frequency,
+              float persistence, float time, float gradient[3])
+{
+    float total = 0.0f;
+    float maxAmplitude = 0.0f;
+    float amplitude = 1.0f;
+    float d[4];
+    int i, k;
+
+    gradient[0] = gradient[1] = gradient[2] = 0.0f;
+    for(i = 0; i < octaves; i++)
+    {
+        total += snoise4Grad(position[0] * frequency, position[1] * frequency,
+                             position[2] * frequency, time, d) * amplitude;
+        for(k = 0; k < 3; k++)
+            gradient[k] += d[k] * (amplitude * frequency);
+        frequency *= 2.0f;
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+    }
+    for(k = 0; k < 3; k++)
+        gradient[k] /= maxAmplitude;
+    return total / maxAmplitude;
+}
+
+void colourize(const float p[3], float n1, float n2, float rgb[3])
+{
+    // GL_LINEAR with GL_CLAMP_TO_EDGE on the 256x256 diffuse texture
+    float u = (n1*0.075f) * 256.0f - 0.5f;
+    float v = ((p[1] + 1.0f) * 0.5f + n2*0.075f) * 256.0f - 0.5f;
+    float fu = floorf(u), fv = floorf(v);
+    float a = u - fu, b = v - fv;
+    int x0 = (int)fu, y0 = (int)fv, x1 = x0 + 1, y1 = y0 + 1, k;
+
+    if(x0 < 0) x0 = 0; else if(x0 > 255) x0 = 255;
+    if(x1 < 0) x1 = 0; else if(x1 > 255) x1 = 255;
+    if(y0 < 0) y0 = 0; else if(y0 > 255) y0 = 255;
+    if(y1 < 0) y1 = 0; else if(y1 > 255) y1 = 255;
+    for(k = 0; k < 3; k++)
+    {
+        float c00 = noiseColourRamp[(y0*256 + x0)*3 + k];
+        float c10 = noiseColourRamp[(y0*256 + x1)*3 + k];
+        float c01 = noiseColourRamp[(y1*256 + x0)*3 + k];
+        float c11 = noiseColourRamp[(y1*256 + x1)*3 + k];
+        rgb[k] = ((c00 + (c10 - c00)*a) * (1.0f - b)
+                + (c01 + (c11 - c01)*a) * b) / 255.0f;
+    }
+}
+
+void getColour(const float p[3], int octaves, const float frequency[3],
+               float persistence, float time, float rgb[3])
+{
+    float p1[3], p2[3], n1, n2;
+    int k;
+
+    for(k = 0; k < 3; k++)
+    {
+        p1[k] = p[k] * 4.0f;
+        p2[k] = p[k] * 3.14159f;
+    }
+    n1 = fbm(p1, octaves, frequency[0], persistence, time);
+    n2 = fbm(p2, octaves, frequency[2], persistence, time);
+    colourize(p, n1, n2, rgb);
+}
@@ -0,0 +1,225 @@
+/*
+ * 4D simplex noise and fbm on the CPU.
+ *
+ * This is a plain C port of snoise(), fbm() and GetColour() from
+ * test.frag, using the same noisePermutation, noiseGrad3 and noiseGrad4
+ * tables that GLSLnoise.c loads into the permTexture and gradTexture
+ * lookup textures. It is the reference the shader and every faster CPU
+ * implementation is checked against.
+ *
+ * The port follows what the GPU actually computes, not the textbook
+ * algorithm: gradient components come out of an 8-bit texture as
+ * (c*64+64)/255*4-1 rather than exactly -1, 0 and 1, and a permuted
+ * index of 255 wraps around to gradient texel 0. Everything is done
+ * in single precision in the same order as the shader, so the two
+ * agree to within float rounding: snoise() to about 1e-6, and
+ * getColour() to 1/255 per channel, the bilinear filtering of the
+ * colour ramp being the largest source of difference (see -cpucheck
+ * in GLSLnoise.c).
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The lookup tables, see noise.c */
+extern int noisePermutation[256];
+extern int noiseGrad3[16][3];
+extern int noiseGrad4[32][4];
+
+/* The 256x256 RGB colour ramp that GetColour() looks up */
+extern const unsigned char *noiseColourRamp;
+
+/*
+ * snoise4(x, y, z, w) - 4D simplex noise in about [-1,1], the same as
+ * snoise(vec4(x, y, z, w)) with the lookup textures.
+ */
+float snoise4(float x, float y, float z, float w);
+
+/*
+ * snoise4Grad(x, y, z, w, gradient) - snoise4(), and its analytic
+ * gradient in gradient[4], summed from the same corners as the value:
+ * snoiseGrad() in test.frag. Between simplex cells the noise is smooth,
+ * so this is the limit of the finite differences, for a fraction of the
+ * cost of the four or five extra snoise4() calls they would take.
+ */
+float snoise4Grad(float x, float y, float z, float w, float gradient[4]);
+
+/*
+ * snoise4Fixed(x, y, z, w) - snoise4() in fixed point, for results that
+ * must not depend on the CPU or the compiler. The coordinates are 16.16
+ * (NOISE_FIXED_ONE is 1.0) and within +-NOISE_FIXED_RANGE, and the
+ * noise is Q15, 32767 for 1.0. It is all integer arithmetic, with every
+ * step defined down to the rounding (see noise_internal.h), so
+ * snoise4FixedBatch() gives the same bits with any kernel. It follows
+ * snoise4() to 2e-4 on average and 2e-3 at worst (3e-3 out at 4000,
+ * where the float coordinates themselves get coarse), mostly from the
+ * 16-bit precision of the corner offsets and falloff.
+ */
+#define NOISE_FIXED_ONE 65536
+#define NOISE_FIXED_RANGE (4096 * NOISE_FIXED_ONE)
+int snoise4Fixed(int x, int y, int z, int w);
+
+/*
+ * snoise4FixedBatch(x, y, z, w, out, count) - snoise4Fixed() of count
+ * points. The kernels work in 16-bit lanes, twice as many per register
+ * as the float ones.
+ */
+void snoise4FixedBatch(const int *x, const int *y, const int *z,
+                       const int *w, short *out, int count);
+
+/*
+ * snoise4Batch(x, y, z, w, out, count) - snoise4() of count points,
+ * given as separate arrays of coordinates, with the fastest kernel the
+ * CPU supports. The kernels agree with snoise4() to about 1e-6.
+ */
+void snoise4Batch(const float *x, const float *y, const float *z,
+                  const float *w, float *out, int count);
+
+/*
+ * fbmBatch(x, y, z, out, count, octaves, frequency, persistence, time)
+ * - fbm() of count points, given as separate arrays of coordinates.
+ * Points run through all their octaves a SIMD register at a time, and
+ * the few left over (or a small query on its own) get a lane for each
+ * of their octaves, so even a single point uses the whole kernel width.
+ */
+void fbmBatch(const float *x, const float *y, const float *z, float *out,
+              int count, int octaves, float frequency, float persistence,
+              float time);
+
+/* The settings of an fbm() query */
+typedef struct {
+    int octaves;
+    float frequency;
+    float persistence;
+    float time;
+} FbmParams;
+
+/*
+ * A cache of fbmEval() results, for servers that query the same points
+ * over and over: an entity standing still, a path being planned again.
+ * It is two-way set associative on the position. With a cellSize of 0
+ * a point comes back from it only if it was queried exactly; otherwise
+ * space is cut into cubes cellSize across, and every query in a cube
+ * gets fbm() at its centre, at most cellSize * 0.87 away, so nearby
+ * queries share one result. Either way it has to be recent enough not
+ * to have been pushed out by two others in the same set. Owned by the
+ * caller, one per thread, and set up with initFbmCache(); it forgets
+ * everything when the FbmParams change.
+ */
+#define FBM_CACHE_BITS 12
+#define FBM_CACHE_SIZE (1 << FBM_CACHE_BITS)
+
+typedef struct {
+    float x, y, z, value;
+} FbmCacheEntry;
+
+typedef struct {
+    FbmParams params;
+    float cellSize;
+    FbmCacheEntry entries[FBM_CACHE_SIZE];
+    unsigned long long hits, misses;
+} FbmCache;
+
+/*
+ * initFbmCache(cache, cellSize) - empty cache, zero its counters, and
+ * key it on exact positions if cellSize is 0, or on cubes cellSize across
+ */
+void initFbmCache(FbmCache *cache, float cellSize);
+
+/*
+ * fbmEval(points, count, params, cache, out) - fbmBatch() of the count
+ * points with coordinates points[0][i], points[1][i], points[2][i],
+ * looking them up in cache first unless it is NULL, which with a
+ * cellSize snaps them to their cube's centre. Nothing is
+ * allocated; the buffers are the caller's and needn't be aligned,
+ * though 64 bytes spares the kernels split loads.
+ */
+void fbmEval(const float *const points[3], int count, const FbmParams *params,
+             FbmCache *cache, float *out);
+
+/*
+ * snoise4Grid(x0, y0, z0, w, step, nx, ny, nz, out) - snoise4() of the
+ * nx*ny*nz grid of points (x0 + i*step, y0 + j*step, z0 + k*step, w),
+ * into out[(k*ny + j)*nx + i]. The grid is done in blocks of 8x8x8
+ * points, and where a block's simplex corners are on fewer lattice
+ * points than it has points, which is at low frequencies, their
+ * gradients are hashed once for the whole block, not once per point.
+ * Returns the gradients hashed per point, 5 without any reuse.
+ */
+float snoise4Grid(float x0, float y0, float z0, float w, float step,
+                  int nx, int ny, int nz, float *out);
+
+/*
+ * fbmGrid(x0, y0, z0, step, nx, ny, nz, out, octaves, frequency,
+ * persistence, time) - fbm() of the same grid, an octave at a time like
+ * snoise4Grid(). Returns the gradients hashed per point and octave.
+ */
+float fbmGrid(float x0, float y0, float z0, float step, int nx, int ny, int nz,
+              float *out, int octaves, float frequency, float persistence,
+              float time);
+
+/*
+ * initNoiseTables() - build the lookup tables the batch functions use,
+ * and pick their kernel: the widest one the CPU supports, or the one
+ * the NOISE_KERNEL environment variable names. The batch functions do
+ * this on first use, but call it first if they will be called from
+ * several threads.
+ */
+void initNoiseTables(void);
+
+/*
+ * setNoiseKernel(name) - use the kernel "scalar", "sse41", "avx2",
+ * "avx512" or "avx512vbmi", or the widest supported one for NULL.
+ * Returns 0 and leaves the kernel alone if this CPU can't run it.
+ */
+int setNoiseKernel(const char *name);
+
+/* noiseKernelName() - the name of the kernel in use */
+const char *noiseKernelName(void);
+
+/* noiseKernelNameAt(index) - the names of all kernels, then NULL */
+const char *noiseKernelNameAt(int index);
+
+/* noiseKernelSupported(name) - whether this CPU can run a kernel */
+int noiseKernelSupported(const char *name);
+
+/*
+ * fbm(position, octaves, frequency, persistence, time) - the same as
+ * fbm() in test.frag, with "time" as the fourth noise coordinate.
+ */
+float fbm(const float position[3], int octaves, float frequency,
+          float persistence, float time);
+
+/*
+ * fbmGrad(position, octaves, frequency, persistence, time, gradient) -
+ * fbm(), and its gradient with respect to position in gradient[3], as
+ * fbmGrad() in test.frag computes them.
+ */
+float fbmGrad(const float position[3], int octaves, float frequency,
+              float persistence, float time, float gradient[3]);
+
+/*
+ * colourize(p, n1, n2, rgb) - the colour ramp lookup of Colourize(),
+ * bilinearly filtered and clamped to the edges like the diffuse texture.
+ */
+void colourize(const float p[3], float n1, float n2, float rgb[3]);
+
+/*
+ * getColour(p, octaves, frequency, persistence, time, rgb) - the
+ * surface colour at p, as GetColour() computes it. Only frequency[0]
+ * and frequency[2] are used, as in the shader.
+ */
+void getColour(const float p[3], int octaves, const float frequency[3],
+               float persistence, float time, float rgb[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOISE_H */
@@ -0,0 +1,445 @@
+/*
+ * Simplex noise and fbm as header-only C++ templates.
+ *
+ * simplex<Dim, Scalar, Batch> is simplex noise in 2, 3 or 4 dimensions,
+ * in float or double, evaluated Batch points at a time, and
+ * fbm<Octaves, Persistence, Noise> sums Octaves octaves of it. What
+ * noise.c takes at run time are template parameters here, so the corner
+ * loop and the octave loop are unrolled at compile time, the loops over
+ * the batch have a fixed length for the compiler to vectorize, and the
+ * fbm amplitudes are constants. The perm and gradient tables are
+ * constexpr data, built by the compiler, with nothing to initialize.
+ *
+ * The 4D noise is snoise4(): it hashes through the two lookup textures
+ * and uses their rounded gradients like the shader, and in float it gives
+ * the same results as snoise4() and fbm(), bit for bit when built with
+ * -ffp-contract=off like the kernels (see the Makefile). The 2D and 3D
+ * noise are the textbook algorithm with Ken Perlin's 12 cube edge
+ * gradients, noiseGrad3[] in noise.c.
+ *
+ *   noise::simplex<4, float, 8>::point P;  // P[axis][lane]
+ *   noise::simplex<4, float, 8>::lanes n = noise::simplex<4, float, 8>::eval(P);
+ *   float f = noise::fbm<8>::eval({{{x}, {y}, {z}}}, 1.0f, time)[0];
+ *
+ * Needs C++17. Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef NOISE_HPP
+#define NOISE_HPP
+
+#include <array>
+#include <cmath>
+#include <ratio>
+#include <utility>
+#include <type_traits>
+
+namespace noise {
+
+namespace detail {
+
+/*
+ * unroll<N>(f) - f(std::integral_constant<int, 0>()) to f(... N-1 ...),
+ * one call after the other, with the index a constant in each.
+ */
+template <typename F, int... I>
+constexpr void unroll(F &&f, std::integer_sequence<int, I...>)
+{
+    (f(std::integral_constant<int, I>()), ...);
+}
+
+template <int N, typename F>
+constexpr void unroll(F &&f)
+{
+    unroll(f, std::make_integer_sequence<int, N>());
+}
+
+/* noisePermutation[] from noise.c */
+inline constexpr std::array<unsigned char, 256> perm = {{151,160,137,91,90,15,
+  131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+  190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
+  88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
+  77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+  102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
+  135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
+  5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+  223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
+  129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
+  251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
+  49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
+  138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180}};
+
+/*
+ * The constants of each dimension: the skewing and unskewing factors,
+ * (sqrt(Dim+1)-1)/Dim and (1-1/sqrt(Dim+1))/Dim, the squared radius of a
+ * corner's contribution, the scale that brings the sum to about [-1,1],
+ * and the number of gradients.
+ */
+template <int Dim> struct constants;
+
+template <> struct constants<2>
+{
+    static constexpr double F = 0.366025403784, G = 0.211324865405;
+    static constexpr double radius = 0.5, scale = 70.0;
+    static constexpr int gradients = 12;
+};
+
+template <> struct constants<3>
+{
+    static constexpr double F = 1.0 / 3.0, G = 1.0 / 6.0;
+    static constexpr double radius = 0.6, scale = 32.0;
+    static constexpr int gradients = 12;
+};
+
+template <> struct constants<4>
+{
+    static constexpr double F = 0.309016994375, G = 0.138196601125;
+    static constexpr double radius = 0.6, scale = 27.0;
+    static constexpr int gradients = 32;
+};
+
+/*
+ * makeGradients<Dim, Scalar>() - the gradients as gradients[k][i],
+ * component k of gradient i. They are the midpoints of the edges of a
+ * cube or tesseract, noiseGrad3[] and noiseGrad4[] in noise.c: gradient
+ * i is 0 on axis i >> (n-1) and +-1 on the others, the bits of i from
+ * the top down giving their signs, with 2D taking the first two
+ * components of 3D.
+ * The 4D components are as read back from gradTexture, see
+ * gradComponent() in noise.c.
+ */
+template <int Dim, typename Scalar>
+constexpr std::array<std::array<Scalar, constants<Dim>::gradients>, Dim> makeGradients()
+{
+    constexpr int n = Dim < 3 ? 3 : Dim;
+    std::array<std::array<Scalar, constants<Dim>::gradients>, Dim> gradients{};
+
+    for(int i = 0; i < constants<Dim>::gradients; i++)
+    {
+        int bit = n - 2;
+        for(int k = 0; k < n; k++)
+        {
+            int g = k == i >> (n - 1) ? 0 : (i >> bit--) & 1 ? -1 : 1;
+            if(k >= Dim)
+                continue;
+            if(Dim == 4)
+                gradients[k][i] = (Scalar)(g * 64 + 64) / (Scalar)255 * (Scalar)4 - (Scalar)1;
+            else
+                gradients[k][i] = (Scalar)g;
+        }
+    }
+    return gradients;
+}
+
+/*
+ * makePermTexels() - perm[] as the texel index the permTexture lookup
+ * selects next: 255 is the nearest texel to 255/255, which wraps to 0.
+ */
+constexpr std::array<unsigned char, 256> makePermTexels()
+{
+    std::array<unsigned char, 256> texels{};
+    for(int i = 0; i < 256; i++)
+        texels[i] = perm[i] == 255 ? 0 : perm[i];
+    return texels;
+}
+
+/* makeGradIndex<Dim>() - perm[] reduced to a gradient index */
+template <int Dim>
+constexpr std::array<unsigned char, 256> makeGradIndex()
+{
+    std::array<unsigned char, 256> index{};
+    for(int i = 0; i < 256; i++)
+        index[i] = perm[i] % constants<Dim>::gradients;
+    return index;
+}
+
+/* The tables, built at compile time */
+template <int Dim, typename Scalar>
+struct tables
+{
+    static constexpr auto gradients = makeGradients<Dim, Scalar>();
+    static constexpr auto gradIndex = makeGradIndex<Dim>();
+    static constexpr auto permTexels = makePermTexels();
+};
+
+/*
+ * makeAmplitudes<Octaves, Scalar>(persistence) - the amplitude of every
+ * octave, and their sum last, accumulated in the same order as fbm().
+ */
+template <int Octaves, typename Scalar>
+constexpr std::array<Scalar, Octaves + 1> makeAmplitudes(Scalar persistence)
+{
+    std::array<Scalar, Octaves + 1> amplitudes{};
+    Scalar amplitude = 1, maxAmplitude = 0;
+
+    for(int i = 0; i < Octaves; i++)
+    {
+        amplitudes[i] = amplitude;
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+    }
+    amplitudes[Octaves] = maxAmplitude;
+    return amplitudes;
+}
+
+} // namespace detail
+
+/*
+ * simplex<Dim, Scalar, Batch> - simplex noise in Dim dimensions, in about
+ * [-1,1]. A point is Dim coordinates of Batch lanes each, P[axis][lane].
+ */
+template <int Dim, typename Scalar = float, int Batch = 1>
+struct simplex
+{
+    static_assert(Dim >= 2 && Dim <= 4, "simplex noise is 2D, 3D or 4D");
+    static_assert(std::is_floating_point<Scalar>::value, "Scalar is float or double");
+    static_assert(Batch >= 1, "a batch has at least one lane");
+
+    static constexpr int dimensions = Dim;
+    static constexpr int batch = Batch;
+    typedef Scalar scalar;
+    typedef std::array<Scalar, Batch> lanes;
+    typedef std::array<lanes, Dim> point;
+
+    /* eval(P) - the noise at each lane of P */
+    static lanes eval(const point &P)
+    {
+        typedef detail::constants<Dim> C;
+        typedef detail::tables<Dim, Scalar> T;
+        const Scalar F = (Scalar)C::F, G = (Scalar)C::G;
+        std::array<std::array<int, Batch>, Dim> Pi, rank;
+        std::array<lanes, Dim> Pf0;
+        lanes s, sum;
+
+        // Skew the space to find the cell of Dim! simplices the point is in,
+        // and the offset from the cell origin
+        for(int l = 0; l < Batch; l++)
+        {
+            Scalar t = P[0][l];
+            for(int k = 1; k < Dim; k++)
+                t += P[k][l];
+            s[l] = t * F;
+        }
+        for(int l = 0; l < Batch; l++)
+        {
+            int i = 0;
+            for(int k = 0; k < Dim; k++)
+            {
+                Pi[k][l] = (int)std::floor(P[k][l] + s[l]);
+                i += Pi[k][l];
+            }
+            Scalar t = (Scalar)i * G;
+            for(int k = 0; k < Dim; k++)
+                Pf0[k][l] = P[k][l] - ((Scalar)Pi[k][l] - t);
+        }
+
+        // Rank the components: rank[k] counts the other components that
+        // component k beats, ties going to the earlier one
+        for(int k = 0; k < Dim; k++)
+            for(int l = 0; l < Batch; l++)
+                rank[k][l] = 0;
+        detail::unroll<Dim>([&](auto a) {
+            detail::unroll<Dim>([&](auto b) {
+                if constexpr (a < b)
+                    for(int l = 0; l < Batch; l++)
+                    {
+                        int beats = Pf0[a][l] >= Pf0[b][l];
+                        rank[a][l] += beats;
+                        rank[b][l] += 1 - beats;
+                    }
+            });
+        });
+
+        // Corner c steps along every component ranked Dim-c or higher, and
+        // lies c*G further along the unskewed diagonal
+        for(int l = 0; l < Batch; l++)
+            sum[l] = 0;
+        detail::unroll<Dim + 1>([&](auto c) {
+            std::array<std::array<int, Batch>, Dim> i;
+            std::array<lanes, Dim> Pf;
+
+            for(int k = 0; k < Dim; k++)
+                for(int l = 0; l < Batch; l++)
+                {
+                    if constexpr (c == 0)
+                    {
+                        i[k][l] = Pi[k][l];
+                        Pf[k][l] = Pf0[k][l];
+                    }
+                    else if constexpr (c == Dim)
+                    {
+                        i[k][l] = Pi[k][l] + 1;
+                        Pf[k][l] = Pf0[k][l] - ((Scalar)1 - (Scalar)Dim * G);
+                    }
+                    else
+                    {
+                        int o = rank[k][l] >= Dim - c;
+                        i[k][l] = Pi[k][l] + o;
+                        Pf[k][l] = Pf0[k][l] - (Scalar)o + (Scalar)c * G;
+                    }
+                }
+            for(int l = 0; l < Batch; l++)
+            {
+                int g = hash(i, l);
+                Scalar d = Pf[0][l] * Pf[0][l], n = T::gradients[0][g] * Pf[0][l];
+                for(int k = 1; k < Dim; k++)
+                {
+                    d += Pf[k][l] * Pf[k][l];
+                    n += T::gradients[k][g] * Pf[k][l];
+                }
+                Scalar t = (Scalar)C::radius - d;
+                t = t < 0 ? 0 : t;
+                t *= t;
+                sum[l] += t * t * n;
+            }
+        });
+
+        for(int l = 0; l < Batch; l++)
+            sum[l] *= (Scalar)C::scale;
+        return sum;
+    }
+
+    /*
+     * eval(coords, out, count) - the noise at count points, given as Dim
+     * separate arrays of coordinates, a batch at a time.
+     */
+    static void eval(const Scalar *const coords[Dim], Scalar *out, int count)
+    {
+        point P;
+        lanes n;
+
+        for(int i = 0; i < count; i += Batch)
+        {
+            int m = count - i < Batch ? count - i : Batch;
+            for(int k = 0; k < Dim; k++)
+                for(int l = 0; l < Batch; l++)
+                    P[k][l] = coords[k][i + (l < m ? l : 0)];
+            n = eval(P);
+            for(int l = 0; l < m; l++)
+                out[i + l] = n[l];
+        }
+    }
+
+    /* at(x, y, ...) - the noise at a single point */
+    template <typename... Coords>
+    static Scalar at(Coords... coords)
+    {
+        static_assert(sizeof...(Coords) == Dim, "one coordinate per dimension");
+        return simplex<Dim, Scalar, 1>::eval({{{(Scalar)coords}...}})[0];
+    }
+
+private:
+    /*
+     * hash(i, l) - the gradient index of lattice point i in lane l. In 4D
+     * this goes through the lookup textures the way snoise() does, in 2D
+     * and 3D it is Ken Perlin's perm[i + perm[j + perm[k]]].
+     */
+    static int hash(const std::array<std::array<int, Batch>, Dim> &i, int l)
+    {
+        typedef detail::tables<Dim, Scalar> T;
+
+        if constexpr (Dim == 4)
+        {
+            int xy = T::permTexels[(i[0][l] + detail::perm[i[1][l] & 0xFF]) & 0xFF];
+            int zw = T::permTexels[(i[2][l] + detail::perm[i[3][l] & 0xFF]) & 0xFF];
+            return T::gradIndex[(xy + detail::perm[zw]) & 0xFF];
+        }
+        else
+        {
+            int h = 0;
+            for(int k = Dim - 1; k > 0; k--)
+                h = detail::perm[(i[k][l] + h) & 0xFF];
+            return T::gradIndex[(i[0][l] + h) & 0xFF];
+        }
+    }
+};
+
+/*
+ * fbm<Octaves, Persistence, Noise> - Octaves octaves of Noise, each at
+ * twice the frequency of the last, with the amplitude scaled by the
+ * std::ratio Persistence, and the sum divided by the sum of amplitudes.
+ */
+template <int Octaves, typename Persistence = std::ratio<1, 2>, typename Noise = simplex<4>>
+struct fbm
+{
+    static_assert(Octaves >= 1, "fbm needs at least one octave");
+
+    typedef typename Noise::scalar scalar;
+    typedef typename Noise::lanes lanes;
+    typedef typename Noise::point point;
+    typedef std::array<lanes, Noise::dimensions - 1> position;
+
+    static constexpr auto amplitudes = detail::makeAmplitudes<Octaves, scalar>(
+        (scalar)Persistence::num / (scalar)Persistence::den);
+
+    /* eval(P, frequency) - fbm at each lane of P, every coordinate scaled */
+    static lanes eval(const point &P, scalar frequency)
+    {
+        return sum<Noise::dimensions>(P, frequency);
+    }
+
+    /*
+     * eval(P, frequency, time) - the same as fbm() in test.frag, with time
+     * as the last noise coordinate, the same in every octave.
+     */
+    static lanes eval(const position &P, scalar frequency, scalar time)
+    {
+        point Q;
+
+        for(int k = 0; k < Noise::dimensions - 1; k++)
+            Q[k] = P[k];
+        for(int l = 0; l < Noise::batch; l++)
+            Q[Noise::dimensions - 1][l] = time;
+        return sum<Noise::dimensions - 1>(Q, frequency);
+    }
+
+    /*
+     * eval(coords, out, count, frequency, time) - eval(P, frequency, time)
+     * of count points, given as separate arrays of coordinates, like
+     * fbmBatch().
+     */
+    static void eval(const scalar *const coords[Noise::dimensions - 1], scalar *out, int count,
+                     scalar frequency, scalar time)
+    {
+        position P;
+        lanes n;
+
+        for(int i = 0; i < count; i += Noise::batch)
+        {
+            int m = count - i < Noise::batch ? count - i : Noise::batch;
+            for(int k = 0; k < Noise::dimensions - 1; k++)
+                for(int l = 0; l < Noise::batch; l++)
+                    P[k][l] = coords[k][i + (l < m ? l : 0)];
+            n = eval(P, frequency, time);
+            for(int l = 0; l < m; l++)
+                out[i + l] = n[l];
+        }
+    }
+
+private:
+    /* sum<Scaled>(P, frequency) - fbm with the first Scaled coordinates scaled */
+    template <int Scaled>
+    static lanes sum(const point &P, scalar frequency)
+    {
+        lanes total;
+
+        for(int l = 0; l < Noise::batch; l++)
+            total[l] = 0;
+        detail::unroll<Octaves>([&](auto octave) {
+            point Q = P;
+            for(int k = 0; k < Scaled; k++)
+                for(int l = 0; l < Noise::batch; l++)
+                    Q[k][l] *= frequency;
+            lanes n = Noise::eval(Q);
+            for(int l = 0; l < Noise::batch; l++)
+                total[l] += n[l] * amplitudes[octave];
+            frequency *= 2;
+        });
+        for(int l = 0; l < Noise::batch; l++)
+            total[l] /= amplitudes[Octaves];
+        return total;
+    }
+};
+
+} // namespace noise
+
+#endif /* NOISE_HPP */
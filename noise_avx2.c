@@ -0,0 +1,384 @@
+/*
+ * snoise4() eight points at a time, with AVX2 and FMA. Build this file
+ * with -mavx2 -mfma; noise_batch.c only calls it on a CPU that has both.
+ *
+ * Every lane follows the scalar snoise4() step by step: the simplex
+ * ranking turns into six compares, and the corner branches into a
+ * max(t, 0). The hashing reads the flattened texture tables from
+ * noise_internal.h with 32-bit gathers, masked down to bytes. Only the
+ * dot products use FMA; the skew must round exactly like snoise4() (see
+ * the Makefile), as 4D simplex noise jumps slightly where a point moves
+ * into the next simplex. The results match snoise4() to about 1e-6.
+ *
+ * fbmBatchAVX2() runs every octave of eight points before moving on to
+ * the next eight, with the coordinates, frequency, amplitude and sum
+ * all in registers. It only takes whole groups of eight; fbmBatch()
+ * does the rest. snoise4CachedAVX2() reads the gradients of a grid
+ * block's lattice points from a NoiseCache instead of hashing them.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <immintrin.h>
+
+#include "noise.h"
+#include "noise_internal.h"
+
+/*
+ * texel(table, x, y) - gather the byte table entries at column x & 255,
+ * row y & 255.
+ */
+static inline __m256i texel(const unsigned char *table, __m256i x, __m256i y)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i index = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(y, mask), 8),
+                                    _mm256_and_si256(x, mask));
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, index, 1), mask);
+}
+
+/*
+ * cacheIndex(cache, x, y, z, w) - the entries of cache for the lattice
+ * points (x,y,z,w).
+ */
+static inline __m256i cacheIndex(const NoiseCache *cache, __m256i x, __m256i y, __m256i z, __m256i w)
+{
+    __m256i index = _mm256_sub_epi32(x, _mm256_set1_epi32(cache->origin[0]));
+    index = _mm256_or_si256(index, _mm256_sll_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(cache->origin[1])),
+                                                    _mm_cvtsi32_si128(cache->shift[1])));
+    index = _mm256_or_si256(index, _mm256_sll_epi32(_mm256_sub_epi32(z, _mm256_set1_epi32(cache->origin[2])),
+                                                    _mm_cvtsi32_si128(cache->shift[2])));
+    return _mm256_or_si256(index, _mm256_sll_epi32(_mm256_sub_epi32(w, _mm256_set1_epi32(cache->origin[3])),
+                                                   _mm_cvtsi32_si128(cache->shift[3])));
+}
+
+/*
+ * corner(cache, x, y, z, w, px, py, pz, pw) - the contributions of eight
+ * simplex corners with integer coordinates (x,y,z,w), at offsets
+ * (px,py,pz,pw). The gradients are hashed, or read from cache if it
+ * isn't NULL.
+ */
+static inline __m256 corner(const NoiseCache *cache, __m256i x, __m256i y, __m256i z, __m256i w,
+                            __m256 px, __m256 py, __m256 pz, __m256 pw)
+{
+    const float *gradients[4];
+    __m256i g;
+    __m256 t, d;
+    int k;
+
+    if(cache)
+    {
+        g = cacheIndex(cache, x, y, z, w);
+        for(k = 0; k < 4; k++)
+            gradients[k] = cache->gradients[k];
+    }
+    else
+    {
+        __m256i xy = texel(noisePermTexels, x, y);
+        __m256i zw = texel(noisePermTexels, z, w);
+        g = texel(noiseGradTexels, xy, zw);
+        for(k = 0; k < 4; k++)
+            gradients[k] = noiseGradients[k];
+    }
+
+    t = _mm256_mul_ps(px, px);
+    t = _mm256_fmadd_ps(py, py, t);
+    t = _mm256_fmadd_ps(pz, pz, t);
+    t = _mm256_fmadd_ps(pw, pw, t);
+    t = _mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(0.6f), t), _mm256_setzero_ps());
+    t = _mm256_mul_ps(t, t);
+    t = _mm256_mul_ps(t, t);
+
+    d = _mm256_mul_ps(_mm256_i32gather_ps(gradients[0], g, 4), px);
+    d = _mm256_fmadd_ps(_mm256_i32gather_ps(gradients[1], g, 4), py, d);
+    d = _mm256_fmadd_ps(_mm256_i32gather_ps(gradients[2], g, 4), pz, d);
+    d = _mm256_fmadd_ps(_mm256_i32gather_ps(gradients[3], g, 4), pw, d);
+    return _mm256_mul_ps(t, d);
+}
+
+/*
+ * snoise8(cache, x, y, z, w) - snoise4() of eight points, with the
+ * gradients from cache if it isn't NULL.
+ */
+static inline __m256 snoise8(const NoiseCache *cache, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 s, t, fx, fy, fz, fw, n;
+    __m256i ix, iy, iz, iw, c01, c02, c03, c12, c13, c23;
+    __m256i r0, r1, r2, r3, o0, o1, o2, o3, limit;
+    int c;
+
+    // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+    s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), w), _mm256_set1_ps(F4));
+    fx = _mm256_floor_ps(_mm256_add_ps(x, s));
+    fy = _mm256_floor_ps(_mm256_add_ps(y, s));
+    fz = _mm256_floor_ps(_mm256_add_ps(z, s));
+    fw = _mm256_floor_ps(_mm256_add_ps(w, s));
+    t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(fx, fy), fz), fw), _mm256_set1_ps(G4));
+    ix = _mm256_cvttps_epi32(fx);
+    iy = _mm256_cvttps_epi32(fy);
+    iz = _mm256_cvttps_epi32(fz);
+    iw = _mm256_cvttps_epi32(fw);
+    // The distances from the cell origin
+    x = _mm256_sub_ps(x, _mm256_sub_ps(fx, t));
+    y = _mm256_sub_ps(y, _mm256_sub_ps(fy, t));
+    z = _mm256_sub_ps(z, _mm256_sub_ps(fz, t));
+    w = _mm256_sub_ps(w, _mm256_sub_ps(fw, t));
+
+    // Rank the components like simplex(). A true compare is -1, so the
+    // counts of components beaten come out negated, or offset by one
+    // for the "less than" side of a compare.
+    c01 = _mm256_castps_si256(_mm256_cmp_ps(x, y, _CMP_GE_OQ));
+    c02 = _mm256_castps_si256(_mm256_cmp_ps(x, z, _CMP_GE_OQ));
+    c03 = _mm256_castps_si256(_mm256_cmp_ps(x, w, _CMP_GE_OQ));
+    c12 = _mm256_castps_si256(_mm256_cmp_ps(y, z, _CMP_GE_OQ));
+    c13 = _mm256_castps_si256(_mm256_cmp_ps(y, w, _CMP_GE_OQ));
+    c23 = _mm256_castps_si256(_mm256_cmp_ps(z, w, _CMP_GE_OQ));
+    r0 = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_add_epi32(_mm256_add_epi32(c01, c02), c03));
+    r1 = _mm256_sub_epi32(_mm256_add_epi32(_mm256_set1_epi32(1), c01), _mm256_add_epi32(c12, c13));
+    r2 = _mm256_sub_epi32(_mm256_add_epi32(_mm256_set1_epi32(2), _mm256_add_epi32(c02, c12)), c23);
+    r3 = _mm256_add_epi32(_mm256_set1_epi32(3), _mm256_add_epi32(_mm256_add_epi32(c03, c13), c23));
+
+    n = corner(cache, ix, iy, iz, iw, x, y, z, w);
+    for(c = 1; c <= 3; c++)
+    {
+        // Step along every component ranked 4-c or higher
+        __m256 g = _mm256_set1_ps((float)c * G4);
+        limit = _mm256_set1_epi32(3 - c);
+        o0 = _mm256_cmpgt_epi32(r0, limit);
+        o1 = _mm256_cmpgt_epi32(r1, limit);
+        o2 = _mm256_cmpgt_epi32(r2, limit);
+        o3 = _mm256_cmpgt_epi32(r3, limit);
+        n = _mm256_add_ps(n, corner(cache,
+            _mm256_sub_epi32(ix, o0), _mm256_sub_epi32(iy, o1),
+            _mm256_sub_epi32(iz, o2), _mm256_sub_epi32(iw, o3),
+            _mm256_add_ps(_mm256_sub_ps(x, _mm256_and_ps(_mm256_castsi256_ps(o0), one)), g),
+            _mm256_add_ps(_mm256_sub_ps(y, _mm256_and_ps(_mm256_castsi256_ps(o1), one)), g),
+            _mm256_add_ps(_mm256_sub_ps(z, _mm256_and_ps(_mm256_castsi256_ps(o2), one)), g),
+            _mm256_add_ps(_mm256_sub_ps(w, _mm256_and_ps(_mm256_castsi256_ps(o3), one)), g)));
+    }
+    o0 = _mm256_set1_epi32(1);
+    s = _mm256_set1_ps(1.0f - 4.0f*G4);
+    n = _mm256_add_ps(n, corner(cache,
+        _mm256_add_epi32(ix, o0), _mm256_add_epi32(iy, o0),
+        _mm256_add_epi32(iz, o0), _mm256_add_epi32(iw, o0),
+        _mm256_sub_ps(x, s), _mm256_sub_ps(y, s),
+        _mm256_sub_ps(z, s), _mm256_sub_ps(w, s)));
+
+    // Sum up and scale the result to cover the range [-1,1]
+    return _mm256_mul_ps(n, _mm256_set1_ps(27.0f));
+}
+
+void snoise4BatchAVX2(const float *x, const float *y, const float *z,
+                      const float *w, float *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, snoise8(NULL, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i),
+                                          _mm256_loadu_ps(z + i), _mm256_loadu_ps(w + i)));
+    // The last few points one at a time
+    snoise4BatchScalar(x + i, y + i, z + i, w + i, out + i, count - i);
+}
+
+void snoise4CachedAVX2(const NoiseCache *cache, const float *x, const float *y,
+                       const float *z, const float *w, float *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, snoise8(cache, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i),
+                                          _mm256_loadu_ps(z + i), _mm256_loadu_ps(w + i)));
+    snoise4BatchScalar(x + i, y + i, z + i, w + i, out + i, count - i);
+}
+
+void fbmBatchAVX2(const float *x, const float *y, const float *z, float *out,
+                  int count, int octaves, float frequency, float persistence,
+                  float time)
+{
+    __m256 px, py, pz, w, f, amplitude, total;
+    float maxAmplitude = 0.0f, a = 1.0f;
+    int i, o;
+
+    for(o = 0; o < octaves; o++)
+    {
+        maxAmplitude += a;
+        a *= persistence;
+    }
+    w = _mm256_set1_ps(time);
+    for(i = 0; i + 8 <= count; i += 8)
+    {
+        px = _mm256_loadu_ps(x + i);
+        py = _mm256_loadu_ps(y + i);
+        pz = _mm256_loadu_ps(z + i);
+        f = _mm256_set1_ps(frequency);
+        amplitude = _mm256_set1_ps(1.0f);
+        total = _mm256_setzero_ps();
+        for(o = 0; o < octaves; o++)
+        {
+            total = _mm256_add_ps(total, _mm256_mul_ps(snoise8(NULL,
+                _mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_mul_ps(pz, f), w), amplitude));
+            f = _mm256_add_ps(f, f);
+            amplitude = _mm256_mul_ps(amplitude, _mm256_set1_ps(persistence));
+        }
+        _mm256_storeu_ps(out + i, _mm256_div_ps(total, _mm256_set1_ps(maxAmplitude)));
+    }
+}
+
+/*
+ * cellFixed(x, y, z, w, Pi, Pf) - the 32-bit steps of snoise4Fixed()
+ * for eight points: their lattice cells in Pi[] and their Q15 offsets
+ * from the cell origins in Pf[], both still in 32-bit lanes.
+ */
+static inline void cellFixed(__m256i x, __m256i y, __m256i z, __m256i w,
+                             __m256i Pi[4], __m256i Pf[4])
+{
+    __m256i P[4], s, hi;
+    int k;
+
+    P[0] = x; P[1] = y; P[2] = z; P[3] = w;
+    s = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(x, y), z), w);
+    hi = _mm256_srai_epi32(s, 16);
+    s = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(hi, _mm256_set1_epi32(F4_HIGH)),
+                                          _mm256_srai_epi32(_mm256_mullo_epi32(hi, _mm256_set1_epi32(F4_LOW)), 15)),
+                         _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_and_si256(s, _mm256_set1_epi32(0xFFFF)),
+                                                              _mm256_set1_epi32(F4_HIGH)), 16));
+    for(k = 0; k < 4; k++)
+        Pi[k] = _mm256_srai_epi32(_mm256_add_epi32(P[k], s), 16);
+    s = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(Pi[0], Pi[1]), Pi[2]), Pi[3]);
+    s = _mm256_add_epi32(_mm256_mullo_epi32(s, _mm256_set1_epi32(G4_HIGH)),
+                         _mm256_srai_epi32(_mm256_mullo_epi32(s, _mm256_set1_epi32(G4_LOW)), 15));
+    for(k = 0; k < 4; k++)
+        Pf[k] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_sub_epi32(P[k], _mm256_slli_epi32(Pi[k], 16)), s), 1);
+}
+
+/*
+ * pack16(a, b) - the 32-bit lanes of a then b, saturated to 16 bits, in
+ * order: vpackssdw interleaves the two 128-bit halves.
+ */
+static inline __m256i pack16(__m256i a, __m256i b)
+{
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+}
+
+/*
+ * texel16(table, x, y) - texel() of 16-bit lanes, as two gathers.
+ */
+static inline __m256i texel16(const unsigned char *table, __m256i x, __m256i y)
+{
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    __m256i index = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(y, mask), 8),
+                                    _mm256_and_si256(x, mask));
+    __m256i low = _mm256_i32gather_epi32((const int*)table,
+                                         _mm256_cvtepu16_epi32(_mm256_castsi256_si128(index)), 1);
+    __m256i high = _mm256_i32gather_epi32((const int*)table,
+                                          _mm256_cvtepu16_epi32(_mm256_extracti128_si256(index, 1)), 1);
+    return pack16(_mm256_and_si256(low, _mm256_set1_epi32(0xFF)),
+                  _mm256_and_si256(high, _mm256_set1_epi32(0xFF)));
+}
+
+/*
+ * gradSign(k, g, high) - noiseGrad4[g][k] as the sign of each lane, see
+ * noise_sse41.c.
+ */
+static inline __m256i gradSign(int k, __m256i g, __m256i high)
+{
+    __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)noiseGradSigns[k]));
+    __m256i upper = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(noiseGradSigns[k] + 16)));
+    return _mm256_blendv_epi8(_mm256_shuffle_epi8(low, g), _mm256_shuffle_epi8(upper, g), high);
+}
+
+/*
+ * cornerFixed(x, y, z, w, px, py, pz, pw) - the Q17 contributions of
+ * sixteen simplex corners with integer coordinates (x,y,z,w), at Q15
+ * offsets (px,py,pz,pw), all in 16-bit lanes.
+ */
+static inline __m256i cornerFixed(__m256i x, __m256i y, __m256i z, __m256i w,
+                                  __m256i px, __m256i py, __m256i pz, __m256i pw)
+{
+    __m256i g = texel16(noiseGradTexels, texel16(noisePermTexels, x, y),
+                        texel16(noisePermTexels, z, w));
+    __m256i high, t, h, a, sum;
+
+    t = _mm256_subs_epi16(_mm256_set1_epi16(RADIUS_FIXED), _mm256_mulhrs_epi16(px, px));
+    t = _mm256_subs_epi16(t, _mm256_mulhrs_epi16(py, py));
+    t = _mm256_subs_epi16(t, _mm256_mulhrs_epi16(pz, pz));
+    t = _mm256_subs_epi16(t, _mm256_mulhrs_epi16(pw, pw));
+    t = _mm256_max_epi16(t, _mm256_setzero_si256());
+    t = _mm256_slli_epi16(_mm256_mulhrs_epi16(t, t), 1);
+    t = _mm256_mulhrs_epi16(t, t);
+
+    g = _mm256_or_si256(g, _mm256_slli_epi16(g, 8));
+    high = _mm256_slli_epi16(g, 3);
+    sum = h = _mm256_mulhrs_epi16(t, px);
+    a = _mm256_sign_epi16(h, gradSign(0, g, high));
+    sum = _mm256_add_epi16(sum, h = _mm256_mulhrs_epi16(t, py));
+    a = _mm256_add_epi16(a, _mm256_sign_epi16(h, gradSign(1, g, high)));
+    sum = _mm256_add_epi16(sum, h = _mm256_mulhrs_epi16(t, pz));
+    a = _mm256_add_epi16(a, _mm256_sign_epi16(h, gradSign(2, g, high)));
+    sum = _mm256_add_epi16(sum, h = _mm256_mulhrs_epi16(t, pw));
+    a = _mm256_add_epi16(a, _mm256_sign_epi16(h, gradSign(3, g, high)));
+    return _mm256_add_epi16(a, _mm256_mulhrs_epi16(_mm256_add_epi16(a, sum), _mm256_set1_epi16(128)));
+}
+
+/*
+ * snoise4Fixed16(x, y, z, w) - snoise4Fixed() of the sixteen points at
+ * x, y, z and w, the same steps as in noise_sse41.c.
+ */
+static inline __m256i snoise4Fixed16(const int *x, const int *y, const int *z, const int *w)
+{
+    __m256i Pi0[4], Pi1[4], Pf0[4], Pf1[4], Pi[4], Pf[4], r[4], step[4], p[4];
+    __m256i d01, d02, d03, d12, d13, d23, n, s, offset;
+    int c, k;
+
+    cellFixed(_mm256_loadu_si256((const __m256i*)x), _mm256_loadu_si256((const __m256i*)y),
+              _mm256_loadu_si256((const __m256i*)z), _mm256_loadu_si256((const __m256i*)w), Pi0, Pf0);
+    cellFixed(_mm256_loadu_si256((const __m256i*)(x + 8)), _mm256_loadu_si256((const __m256i*)(y + 8)),
+              _mm256_loadu_si256((const __m256i*)(z + 8)), _mm256_loadu_si256((const __m256i*)(w + 8)),
+              Pi1, Pf1);
+    for(k = 0; k < 4; k++)
+    {
+        Pi[k] = pack16(Pi0[k], Pi1[k]);
+        Pf[k] = pack16(Pf0[k], Pf1[k]);
+    }
+
+    d01 = _mm256_cmpgt_epi16(Pf[1], Pf[0]);
+    d02 = _mm256_cmpgt_epi16(Pf[2], Pf[0]);
+    d03 = _mm256_cmpgt_epi16(Pf[3], Pf[0]);
+    d12 = _mm256_cmpgt_epi16(Pf[2], Pf[1]);
+    d13 = _mm256_cmpgt_epi16(Pf[3], Pf[1]);
+    d23 = _mm256_cmpgt_epi16(Pf[3], Pf[2]);
+    r[0] = _mm256_add_epi16(_mm256_set1_epi16(3), _mm256_add_epi16(_mm256_add_epi16(d01, d02), d03));
+    r[1] = _mm256_sub_epi16(_mm256_add_epi16(_mm256_set1_epi16(2), _mm256_add_epi16(d12, d13)), d01);
+    r[2] = _mm256_sub_epi16(_mm256_add_epi16(_mm256_set1_epi16(1), d23), _mm256_add_epi16(d02, d12));
+    r[3] = _mm256_sub_epi16(_mm256_setzero_si256(), _mm256_add_epi16(_mm256_add_epi16(d03, d13), d23));
+
+    n = _mm256_setzero_si256();
+    for(c = 0; c <= 4; c++)
+    {
+        for(k = 0; k < 4; k++)
+        {
+            step[k] = _mm256_cmpgt_epi16(r[k], _mm256_set1_epi16(3 - c));
+            offset = _mm256_add_epi16(_mm256_set1_epi16(c * G4_Q15),
+                                      _mm256_and_si256(step[k], _mm256_set1_epi16(-32768)));
+            p[k] = _mm256_max_epi16(_mm256_adds_epi16(Pf[k], offset), _mm256_set1_epi16(-32767));
+        }
+        n = _mm256_add_epi16(n, cornerFixed(
+            _mm256_sub_epi16(Pi[0], step[0]), _mm256_sub_epi16(Pi[1], step[1]),
+            _mm256_sub_epi16(Pi[2], step[2]), _mm256_sub_epi16(Pi[3], step[3]),
+            p[0], p[1], p[2], p[3]));
+    }
+
+    s = _mm256_adds_epi16(n, n);
+    s = _mm256_adds_epi16(_mm256_adds_epi16(s, s), s);
+    return _mm256_adds_epi16(s, _mm256_mulhrs_epi16(n, _mm256_set1_epi16(24576)));
+}
+
+void snoise4FixedBatchAVX2(const int *x, const int *y, const int *z,
+                           const int *w, short *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 16 <= count; i += 16)
+        _mm256_storeu_si256((__m256i*)(out + i), snoise4Fixed16(x + i, y + i, z + i, w + i));
+    snoise4FixedBatchScalar(x + i, y + i, z + i, w + i, out + i, count - i);
+}
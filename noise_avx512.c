@@ -0,0 +1,525 @@
+/*
+ * snoise4() sixteen points at a time, with AVX-512F. Build this file
+ * with -mavx512f; noise_batch.c only calls it on a CPU that has it.
+ *
+ * The same steps as noise_avx2.c, but the compares give mask registers:
+ * the ranks are counted with masked adds, the corner offsets are masked
+ * adds and subtracts, and instead of clamping t at zero, a corner only
+ * gathers and adds its contribution in the lanes where t > 0. A corner
+ * outside the radius of all sixteen points costs no lookups at all, and
+ * the last few points are masked loads and stores, not a scalar loop.
+ * fbmBatchAVX512() and snoise4CachedAVX512() are their noise_avx2.c
+ * counterparts, sixteen lanes wide.
+ *
+ * Built again with -mavx512bw -mavx512vbmi, this file makes the
+ * snoise4BatchAVX512VBMI() kernel, which does without gathers. The
+ * 256 bytes of noisePermutation[] fit in four registers, so vpermi2b
+ * (two 128-byte halves, blended on bit 7 of the index) replaces each
+ * table lookup, and the double hash perm[(x + perm[y]) & 255] is two of
+ * those and an add. The 32-entry gradient tables fit in two registers
+ * each, for vpermt2ps. Hashing a corner then never touches memory, and
+ * the tables are loaded once per call, not once per octave.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <immintrin.h>
+
+#include "noise.h"
+#include "noise_internal.h"
+
+/*
+ * cacheIndex(cache, x, y, z, w) - the entries of cache for the lattice
+ * points (x,y,z,w).
+ */
+static inline __m512i cacheIndex(const NoiseCache *cache, __m512i x, __m512i y, __m512i z, __m512i w)
+{
+    __m512i index = _mm512_sub_epi32(x, _mm512_set1_epi32(cache->origin[0]));
+    index = _mm512_or_si512(index, _mm512_sll_epi32(_mm512_sub_epi32(y, _mm512_set1_epi32(cache->origin[1])),
+                                                    _mm_cvtsi32_si128(cache->shift[1])));
+    index = _mm512_or_si512(index, _mm512_sll_epi32(_mm512_sub_epi32(z, _mm512_set1_epi32(cache->origin[2])),
+                                                    _mm_cvtsi32_si128(cache->shift[2])));
+    return _mm512_or_si512(index, _mm512_sll_epi32(_mm512_sub_epi32(w, _mm512_set1_epi32(cache->origin[3])),
+                                                   _mm_cvtsi32_si128(cache->shift[3])));
+}
+
+#ifdef __AVX512VBMI__
+#define SNOISE4_BATCH snoise4BatchAVX512VBMI
+#define SNOISE4_CACHED snoise4CachedVBMI
+#define CACHED_STORAGE static // The grid functions don't use it, see noise_batch.c
+#define FBM_BATCH fbmBatchAVX512VBMI
+
+/* The tables, in registers */
+typedef struct {
+    __m512i perm[4];         // noisePermutation[], 64 entries each
+    __m512 gradients[4][2];  // noiseGradients[k], 16 entries each
+    const NoiseCache *cache; // Or NULL
+} Lookup;
+
+/*
+ * initLookup(lookup, cache) - load the tables.
+ */
+static inline void initLookup(Lookup *lookup, const NoiseCache *cache)
+{
+    int k;
+    lookup->cache = cache;
+    for(k = 0; k < 4; k++)
+    {
+        lookup->perm[k] = _mm512_loadu_si512(noisePerm + 64*k);
+        lookup->gradients[k][0] = _mm512_loadu_ps(noiseGradients[k]);
+        lookup->gradients[k][1] = _mm512_loadu_ps(noiseGradients[k] + 16);
+    }
+}
+
+/*
+ * permute(lookup, i) - perm[i & 255]. Only the low byte of each lane is
+ * an index; the other bytes look up something and are masked off.
+ */
+static inline __m512i permute(const Lookup *lookup, __m512i i)
+{
+    __m512i low = _mm512_permutex2var_epi8(lookup->perm[0], i, lookup->perm[1]);
+    __m512i high = _mm512_permutex2var_epi8(lookup->perm[2], i, lookup->perm[3]);
+    return _mm512_and_si512(_mm512_mask_blend_epi8(_mm512_movepi8_mask(i), low, high),
+                            _mm512_set1_epi32(0xFF));
+}
+
+/*
+ * texel(lookup, x, y) - the permTexture texel at column x, row y, with
+ * 255 wrapped to 0 like noisePermTexels[].
+ */
+static inline __m512i texel(const Lookup *lookup, __m512i x, __m512i y)
+{
+    __m512i value = permute(lookup, _mm512_add_epi32(x, permute(lookup, y)));
+    return _mm512_maskz_mov_epi32(_mm512_cmpneq_epi32_mask(value, _mm512_set1_epi32(255)), value);
+}
+
+/*
+ * hash(lookup, active, x, y, z, w) - the noiseGrad4[] indices of the corners
+ * with integer coordinates (x,y,z,w).
+ */
+static inline __m512i hash(const Lookup *lookup, __mmask16 active,
+                           __m512i x, __m512i y, __m512i z, __m512i w)
+{
+    __m512i xy, zw;
+
+    if(lookup->cache)
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active,
+                                           cacheIndex(lookup->cache, x, y, z, w),
+                                           lookup->cache->hashes, 4);
+    xy = texel(lookup, x, y);
+    zw = texel(lookup, z, w);
+    return _mm512_and_si512(permute(lookup, _mm512_add_epi32(xy, permute(lookup, zw))),
+                            _mm512_set1_epi32(0x1F));
+}
+
+/*
+ * gradient(lookup, active, g, k) - component k of the gradients g.
+ */
+static inline __m512 gradient(const Lookup *lookup, __mmask16 active, __m512i g, int k)
+{
+    (void)active; // A permute reads every lane anyway
+    return _mm512_permutex2var_ps(lookup->gradients[k][0], g, lookup->gradients[k][1]);
+}
+
+#else
+#define SNOISE4_BATCH snoise4BatchAVX512
+#define SNOISE4_CACHED snoise4CachedAVX512
+#define CACHED_STORAGE
+#define FBM_BATCH fbmBatchAVX512
+
+/* The tables stay in memory, and are gathered from */
+typedef struct {
+    const unsigned char *permTexels;
+    const unsigned char *gradTexels;
+    const float *gradients[4];  // noiseGradients, or the cache's
+    const NoiseCache *cache;    // Or NULL
+} Lookup;
+
+/*
+ * initLookup(lookup, cache) - point at the tables.
+ */
+static inline void initLookup(Lookup *lookup, const NoiseCache *cache)
+{
+    int k;
+    lookup->permTexels = noisePermTexels;
+    lookup->gradTexels = noiseGradTexels;
+    lookup->cache = cache;
+    for(k = 0; k < 4; k++)
+        lookup->gradients[k] = cache ? cache->gradients[k] : noiseGradients[k];
+}
+
+/*
+ * texel(table, active, x, y) - gather the byte table entries at column
+ * x & 255, row y & 255, in the active lanes.
+ */
+static inline __m512i texel(const unsigned char *table, __mmask16 active, __m512i x, __m512i y)
+{
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+    __m512i index = _mm512_or_si512(_mm512_slli_epi32(_mm512_and_si512(y, mask), 8),
+                                    _mm512_and_si512(x, mask));
+    return _mm512_and_si512(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active, index,
+                                                        (const int*)table, 1), mask);
+}
+
+/*
+ * hash(lookup, active, x, y, z, w) - where lookup->gradients[] has the
+ * gradients of the corners with integer coordinates (x,y,z,w).
+ */
+static inline __m512i hash(const Lookup *lookup, __mmask16 active,
+                           __m512i x, __m512i y, __m512i z, __m512i w)
+{
+    __m512i xy, zw;
+
+    if(lookup->cache)
+        return cacheIndex(lookup->cache, x, y, z, w);
+    xy = texel(lookup->permTexels, active, x, y);
+    zw = texel(lookup->permTexels, active, z, w);
+    return texel(lookup->gradTexels, active, xy, zw);
+}
+
+/*
+ * gradient(lookup, active, g, k) - component k of the gradients g.
+ */
+static inline __m512 gradient(const Lookup *lookup, __mmask16 active, __m512i g, int k)
+{
+    return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), active, g, lookup->gradients[k], 4);
+}
+#endif
+
+/*
+ * corner(lookup, n, x, y, z, w, px, py, pz, pw) - add the contributions
+ * of sixteen simplex corners with integer coordinates (x,y,z,w), at
+ * offsets (px,py,pz,pw), to n.
+ */
+static inline __m512 corner(const Lookup *lookup, __m512 n, __m512i x, __m512i y, __m512i z, __m512i w,
+                            __m512 px, __m512 py, __m512 pz, __m512 pw)
+{
+    __m512i g;
+    __m512 t, d;
+    __mmask16 active;
+
+    t = _mm512_mul_ps(px, px);
+    t = _mm512_fmadd_ps(py, py, t);
+    t = _mm512_fmadd_ps(pz, pz, t);
+    t = _mm512_fmadd_ps(pw, pw, t);
+    t = _mm512_sub_ps(_mm512_set1_ps(0.6f), t);
+    active = _mm512_cmp_ps_mask(t, _mm512_setzero_ps(), _CMP_GT_OQ);
+    if(!active)
+        return n;
+    t = _mm512_mul_ps(t, t);
+    t = _mm512_mul_ps(t, t);
+
+    g = hash(lookup, active, x, y, z, w);
+    d = _mm512_mul_ps(gradient(lookup, active, g, 0), px);
+    d = _mm512_fmadd_ps(gradient(lookup, active, g, 1), py, d);
+    d = _mm512_fmadd_ps(gradient(lookup, active, g, 2), pz, d);
+    d = _mm512_fmadd_ps(gradient(lookup, active, g, 3), pw, d);
+    return _mm512_mask3_fmadd_ps(t, d, n, active);
+}
+
+/*
+ * countIf(r, m) - add one to r in the lanes set in m.
+ */
+static inline __m512i countIf(__m512i r, __mmask16 m)
+{
+    return _mm512_mask_add_epi32(r, m, r, _mm512_set1_epi32(1));
+}
+
+/*
+ * snoise16(lookup, x, y, z, w) - snoise4() of sixteen points.
+ */
+static inline __m512 snoise16(const Lookup *lookup, __m512 x, __m512 y, __m512 z, __m512 w)
+{
+    const __m512i ione = _mm512_set1_epi32(1);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    __m512 s, t, fx, fy, fz, fw, n;
+    __m512i ix, iy, iz, iw, r0, r1, r2, r3, limit;
+    __mmask16 c01, c02, c03, c12, c13, c23, o0, o1, o2, o3;
+    int c;
+
+    // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+    s = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_add_ps(x, y), z), w), _mm512_set1_ps(F4));
+    fx = _mm512_floor_ps(_mm512_add_ps(x, s));
+    fy = _mm512_floor_ps(_mm512_add_ps(y, s));
+    fz = _mm512_floor_ps(_mm512_add_ps(z, s));
+    fw = _mm512_floor_ps(_mm512_add_ps(w, s));
+    t = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_add_ps(fx, fy), fz), fw), _mm512_set1_ps(G4));
+    ix = _mm512_cvttps_epi32(fx);
+    iy = _mm512_cvttps_epi32(fy);
+    iz = _mm512_cvttps_epi32(fz);
+    iw = _mm512_cvttps_epi32(fw);
+    // The distances from the cell origin
+    x = _mm512_sub_ps(x, _mm512_sub_ps(fx, t));
+    y = _mm512_sub_ps(y, _mm512_sub_ps(fy, t));
+    z = _mm512_sub_ps(z, _mm512_sub_ps(fz, t));
+    w = _mm512_sub_ps(w, _mm512_sub_ps(fw, t));
+
+    // Rank the components like simplex(): count the components each one
+    // beats, ties going to the earlier one.
+    c01 = _mm512_cmp_ps_mask(x, y, _CMP_GE_OQ);
+    c02 = _mm512_cmp_ps_mask(x, z, _CMP_GE_OQ);
+    c03 = _mm512_cmp_ps_mask(x, w, _CMP_GE_OQ);
+    c12 = _mm512_cmp_ps_mask(y, z, _CMP_GE_OQ);
+    c13 = _mm512_cmp_ps_mask(y, w, _CMP_GE_OQ);
+    c23 = _mm512_cmp_ps_mask(z, w, _CMP_GE_OQ);
+    r0 = countIf(countIf(countIf(_mm512_setzero_si512(), c01), c02), c03);
+    r1 = countIf(countIf(countIf(_mm512_setzero_si512(), (__mmask16)~c01), c12), c13);
+    r2 = countIf(countIf(countIf(_mm512_setzero_si512(), (__mmask16)~c02), (__mmask16)~c12), c23);
+    r3 = countIf(countIf(countIf(_mm512_setzero_si512(), (__mmask16)~c03), (__mmask16)~c13), (__mmask16)~c23);
+
+    n = corner(lookup, _mm512_setzero_ps(), ix, iy, iz, iw, x, y, z, w);
+    for(c = 1; c <= 3; c++)
+    {
+        // Step along every component ranked 4-c or higher
+        __m512 g = _mm512_set1_ps((float)c * G4);
+        limit = _mm512_set1_epi32(3 - c);
+        o0 = _mm512_cmpgt_epi32_mask(r0, limit);
+        o1 = _mm512_cmpgt_epi32_mask(r1, limit);
+        o2 = _mm512_cmpgt_epi32_mask(r2, limit);
+        o3 = _mm512_cmpgt_epi32_mask(r3, limit);
+        n = corner(lookup, n,
+            _mm512_mask_add_epi32(ix, o0, ix, ione), _mm512_mask_add_epi32(iy, o1, iy, ione),
+            _mm512_mask_add_epi32(iz, o2, iz, ione), _mm512_mask_add_epi32(iw, o3, iw, ione),
+            _mm512_add_ps(_mm512_mask_sub_ps(x, o0, x, one), g),
+            _mm512_add_ps(_mm512_mask_sub_ps(y, o1, y, one), g),
+            _mm512_add_ps(_mm512_mask_sub_ps(z, o2, z, one), g),
+            _mm512_add_ps(_mm512_mask_sub_ps(w, o3, w, one), g));
+    }
+    s = _mm512_set1_ps(1.0f - 4.0f*G4);
+    n = corner(lookup, n,
+        _mm512_add_epi32(ix, ione), _mm512_add_epi32(iy, ione),
+        _mm512_add_epi32(iz, ione), _mm512_add_epi32(iw, ione),
+        _mm512_sub_ps(x, s), _mm512_sub_ps(y, s),
+        _mm512_sub_ps(z, s), _mm512_sub_ps(w, s));
+
+    // Sum up and scale the result to cover the range [-1,1]
+    return _mm512_mul_ps(n, _mm512_set1_ps(27.0f));
+}
+
+CACHED_STORAGE void SNOISE4_CACHED(const NoiseCache *cache, const float *x, const float *y,
+                                   const float *z, const float *w, float *out, int count)
+{
+    Lookup lookup;
+    __mmask16 lanes;
+    int i;
+
+    initLookup(&lookup, cache);
+    for(i = 0; i < count; i += 16)
+    {
+        // Past the end, repeat the first point, which has its corners in
+        // cache too
+        lanes = count - i >= 16 ? 0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+        _mm512_mask_storeu_ps(out + i, lanes, snoise16(&lookup,
+            _mm512_mask_loadu_ps(_mm512_set1_ps(x[i]), lanes, x + i),
+            _mm512_mask_loadu_ps(_mm512_set1_ps(y[i]), lanes, y + i),
+            _mm512_mask_loadu_ps(_mm512_set1_ps(z[i]), lanes, z + i),
+            _mm512_mask_loadu_ps(_mm512_set1_ps(w[i]), lanes, w + i)));
+    }
+}
+
+void SNOISE4_BATCH(const float *x, const float *y, const float *z,
+                   const float *w, float *out, int count)
+{
+    SNOISE4_CACHED(NULL, x, y, z, w, out, count);
+}
+
+void FBM_BATCH(const float *x, const float *y, const float *z, float *out,
+               int count, int octaves, float frequency, float persistence,
+               float time)
+{
+    Lookup lookup;
+    __m512 px, py, pz, w, f, amplitude, total;
+    float maxAmplitude = 0.0f, a = 1.0f;
+    int i, o;
+
+    initLookup(&lookup, NULL);
+    for(o = 0; o < octaves; o++)
+    {
+        maxAmplitude += a;
+        a *= persistence;
+    }
+    w = _mm512_set1_ps(time);
+    for(i = 0; i + 16 <= count; i += 16)
+    {
+        px = _mm512_loadu_ps(x + i);
+        py = _mm512_loadu_ps(y + i);
+        pz = _mm512_loadu_ps(z + i);
+        f = _mm512_set1_ps(frequency);
+        amplitude = _mm512_set1_ps(1.0f);
+        total = _mm512_setzero_ps();
+        for(o = 0; o < octaves; o++)
+        {
+            total = _mm512_add_ps(total, _mm512_mul_ps(snoise16(&lookup,
+                _mm512_mul_ps(px, f), _mm512_mul_ps(py, f), _mm512_mul_ps(pz, f), w), amplitude));
+            f = _mm512_add_ps(f, f);
+            amplitude = _mm512_mul_ps(amplitude, _mm512_set1_ps(persistence));
+        }
+        _mm512_storeu_ps(out + i, _mm512_div_ps(total, _mm512_set1_ps(maxAmplitude)));
+    }
+}
+
+#ifdef __AVX512VBMI__
+/*
+ * cellFixed(x, y, z, w, Pi, Pf) - the 32-bit steps of snoise4Fixed()
+ * for sixteen points: their lattice cells in Pi[] and their Q15 offsets
+ * from the cell origins in Pf[], both still in 32-bit lanes.
+ */
+static inline void cellFixed(__m512i x, __m512i y, __m512i z, __m512i w,
+                             __m512i Pi[4], __m512i Pf[4])
+{
+    __m512i P[4], s, hi;
+    int k;
+
+    P[0] = x; P[1] = y; P[2] = z; P[3] = w;
+    s = _mm512_add_epi32(_mm512_add_epi32(_mm512_add_epi32(x, y), z), w);
+    hi = _mm512_srai_epi32(s, 16);
+    s = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(hi, _mm512_set1_epi32(F4_HIGH)),
+                                          _mm512_srai_epi32(_mm512_mullo_epi32(hi, _mm512_set1_epi32(F4_LOW)), 15)),
+                         _mm512_srai_epi32(_mm512_mullo_epi32(_mm512_and_si512(s, _mm512_set1_epi32(0xFFFF)),
+                                                              _mm512_set1_epi32(F4_HIGH)), 16));
+    for(k = 0; k < 4; k++)
+        Pi[k] = _mm512_srai_epi32(_mm512_add_epi32(P[k], s), 16);
+    s = _mm512_add_epi32(_mm512_add_epi32(_mm512_add_epi32(Pi[0], Pi[1]), Pi[2]), Pi[3]);
+    s = _mm512_add_epi32(_mm512_mullo_epi32(s, _mm512_set1_epi32(G4_HIGH)),
+                         _mm512_srai_epi32(_mm512_mullo_epi32(s, _mm512_set1_epi32(G4_LOW)), 15));
+    for(k = 0; k < 4; k++)
+        Pf[k] = _mm512_srai_epi32(_mm512_add_epi32(_mm512_sub_epi32(P[k], _mm512_slli_epi32(Pi[k], 16)), s), 1);
+}
+
+/*
+ * pack16(a, b) - the 32-bit lanes of a then b, saturated to 16 bits, in
+ * order: vpackssdw interleaves the four 128-bit quarters.
+ */
+static inline __m512i pack16(__m512i a, __m512i b)
+{
+    return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7),
+                                    _mm512_packs_epi32(a, b));
+}
+
+/*
+ * permute16(lookup, i) - permute() of 16-bit lanes.
+ */
+static inline __m512i permute16(const Lookup *lookup, __m512i i)
+{
+    __m512i low = _mm512_permutex2var_epi8(lookup->perm[0], i, lookup->perm[1]);
+    __m512i high = _mm512_permutex2var_epi8(lookup->perm[2], i, lookup->perm[3]);
+    return _mm512_and_si512(_mm512_mask_blend_epi8(_mm512_movepi8_mask(i), low, high),
+                            _mm512_set1_epi16(0xFF));
+}
+
+/*
+ * texel16(lookup, x, y) - texel() of 16-bit lanes.
+ */
+static inline __m512i texel16(const Lookup *lookup, __m512i x, __m512i y)
+{
+    __m512i value = permute16(lookup, _mm512_add_epi16(x, permute16(lookup, y)));
+    return _mm512_maskz_mov_epi16(_mm512_cmpneq_epi16_mask(value, _mm512_set1_epi16(255)), value);
+}
+
+/*
+ * cornerFixed(lookup, signs, x, y, z, w, p) - the Q17 contributions of
+ * 32 simplex corners with integer coordinates (x,y,z,w), at Q15 offsets
+ * p[], all in 16-bit lanes. signs[k] is noiseGradSigns[k] in words, for
+ * vpermw.
+ */
+static inline __m512i cornerFixed(const Lookup *lookup, const __m512i signs[4],
+                                  __m512i x, __m512i y, __m512i z, __m512i w, const __m512i p[4])
+{
+    __m512i xy = texel16(lookup, x, y), zw = texel16(lookup, z, w), g, t, h, a, sum;
+    int k;
+
+    g = _mm512_and_si512(permute16(lookup, _mm512_add_epi16(xy, permute16(lookup, zw))),
+                         _mm512_set1_epi16(0x1F));
+    t = _mm512_set1_epi16(RADIUS_FIXED);
+    for(k = 0; k < 4; k++)
+        t = _mm512_subs_epi16(t, _mm512_mulhrs_epi16(p[k], p[k]));
+    t = _mm512_max_epi16(t, _mm512_setzero_si512());
+    t = _mm512_slli_epi16(_mm512_mulhrs_epi16(t, t), 1);
+    t = _mm512_mulhrs_epi16(t, t);
+
+    a = sum = _mm512_setzero_si512();
+    for(k = 0; k < 4; k++)
+    {
+        h = _mm512_mulhrs_epi16(t, p[k]);
+        sum = _mm512_add_epi16(sum, h);
+        // There is no vpsignw for 512 bits; times -1, 0 or 1 is as exact
+        a = _mm512_add_epi16(a, _mm512_mullo_epi16(h, _mm512_permutexvar_epi16(g, signs[k])));
+    }
+    return _mm512_add_epi16(a, _mm512_mulhrs_epi16(_mm512_add_epi16(a, sum), _mm512_set1_epi16(128)));
+}
+
+/*
+ * snoise4Fixed32(lookup, signs, x, y, z, w, count) - snoise4Fixed() of
+ * the first count (up to 32) points at x, y, z and w, the same steps as
+ * in noise_sse41.c.
+ */
+static inline __m512i snoise4Fixed32(const Lookup *lookup, const __m512i signs[4],
+                                     const int *x, const int *y, const int *z, const int *w,
+                                     int count)
+{
+    const __m512i one = _mm512_set1_epi16(1);
+    __mmask16 first = count >= 16 ? 0xFFFF : (__mmask16)((1u << count) - 1);
+    __mmask16 second = count >= 32 ? 0xFFFF : count <= 16 ? 0 : (__mmask16)((1u << (count - 16)) - 1);
+    __m512i Pi0[4], Pi1[4], Pf0[4], Pf1[4], Pi[4], Pf[4], r[4], p[4], i[4], n, s;
+    __mmask32 step;
+    int a, b, c, k;
+
+    cellFixed(_mm512_maskz_loadu_epi32(first, x), _mm512_maskz_loadu_epi32(first, y),
+              _mm512_maskz_loadu_epi32(first, z), _mm512_maskz_loadu_epi32(first, w), Pi0, Pf0);
+    cellFixed(_mm512_maskz_loadu_epi32(second, x + 16), _mm512_maskz_loadu_epi32(second, y + 16),
+              _mm512_maskz_loadu_epi32(second, z + 16), _mm512_maskz_loadu_epi32(second, w + 16),
+              Pi1, Pf1);
+    for(k = 0; k < 4; k++)
+    {
+        Pi[k] = pack16(Pi0[k], Pi1[k]);
+        Pf[k] = pack16(Pf0[k], Pf1[k]);
+        r[k] = _mm512_setzero_si512();
+    }
+
+    // Rank the components with masked adds, like snoise16()
+    for(a = 0; a < 4; a++)
+        for(b = a + 1; b < 4; b++)
+        {
+            __mmask32 beats = _mm512_cmpge_epi16_mask(Pf[a], Pf[b]);
+            r[a] = _mm512_mask_add_epi16(r[a], beats, r[a], one);
+            r[b] = _mm512_mask_add_epi16(r[b], ~beats, r[b], one);
+        }
+
+    n = _mm512_setzero_si512();
+    for(c = 0; c <= 4; c++)
+    {
+        for(k = 0; k < 4; k++)
+        {
+            step = _mm512_cmpgt_epi16_mask(r[k], _mm512_set1_epi16(3 - c));
+            i[k] = _mm512_mask_add_epi16(Pi[k], step, Pi[k], one);
+            p[k] = _mm512_max_epi16(_mm512_adds_epi16(Pf[k], _mm512_mask_blend_epi16(step,
+                                        _mm512_set1_epi16(c * G4_Q15),
+                                        _mm512_set1_epi16(c * G4_Q15 - 32768))),
+                                    _mm512_set1_epi16(-32767));
+        }
+        n = _mm512_add_epi16(n, cornerFixed(lookup, signs, i[0], i[1], i[2], i[3], p));
+    }
+
+    s = _mm512_adds_epi16(n, n);
+    s = _mm512_adds_epi16(_mm512_adds_epi16(s, s), s);
+    return _mm512_adds_epi16(s, _mm512_mulhrs_epi16(n, _mm512_set1_epi16(24576)));
+}
+
+void snoise4FixedBatchAVX512VBMI(const int *x, const int *y, const int *z,
+                                 const int *w, short *out, int count)
+{
+    Lookup lookup;
+    __m512i signs[4];
+    int i, k;
+
+    initLookup(&lookup, NULL);
+    for(k = 0; k < 4; k++)
+        signs[k] = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)noiseGradSigns[k]));
+    for(i = 0; i < count; i += 32)
+    {
+        int lanes = count - i < 32 ? count - i : 32;
+        _mm512_mask_storeu_epi16(out + i, lanes == 32 ? 0xFFFFFFFFu : (1u << lanes) - 1,
+                                 snoise4Fixed32(&lookup, signs, x + i, y + i, z + i, w + i, lanes));
+    }
+}
+#endif
@@ -0,0 +1,671 @@
+/*
+ * The batch entry points of the CPU noise, and the choice of kernel
+ * behind them.
+ *
+ * Each SIMD kernel lives in its own file, built for its own instruction
+ * set. The widest one the CPU and OS support is picked the first time
+ * it is needed, from cpuid, unless the NOISE_KERNEL environment variable
+ * names another one ("scalar", "sse41", "avx2", "avx512" or
+ * "avx512vbmi").
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "noise.h"
+#include "noise_internal.h"
+
+unsigned char noisePerm[256];
+unsigned char noisePermTexels[NOISE_TEXELS + 4];
+unsigned char noiseGradTexels[NOISE_TEXELS + 4];
+float noiseGradients[4][32];
+signed char noiseGradSigns[4][32];
+
+typedef void (*BatchKernel)(const float *x, const float *y, const float *z,
+                            const float *w, float *out, int count);
+typedef void (*CachedKernel)(const NoiseCache *cache, const float *x, const float *y,
+                             const float *z, const float *w, float *out, int count);
+typedef void (*FbmKernel)(const float *x, const float *y, const float *z, float *out,
+                          int count, int octaves, float frequency, float persistence,
+                          float time);
+typedef void (*FixedKernel)(const int *x, const int *y, const int *z,
+                            const int *w, short *out, int count);
+
+/* CPU features a kernel needs, see cpuFeatures() */
+#define CPU_SSE41   1
+#define CPU_AVX2    2  // With FMA, and the OS saving the YMM registers
+#define CPU_AVX512  4  // AVX-512F, and the OS saving the ZMM registers
+#define CPU_VBMI    8  // AVX-512BW and AVX-512VBMI
+
+typedef struct {
+    const char *name;
+    BatchKernel snoise;
+    CachedKernel cached;  // Or NULL to hash every corner in the grid functions too
+    FbmKernel fbm;        // Whole groups of width points only, or NULL
+    FixedKernel fixed;    // All the same bits, in 16-bit lanes
+    int width;
+    int features;
+} Kernel;
+
+/* Narrowest first, the last supported one is the default */
+static const Kernel kernels[] = {
+    { "scalar", snoise4BatchScalar, NULL, NULL, snoise4FixedBatchScalar, 1, 0 },
+    { "sse41", snoise4BatchSSE41, NULL, fbmBatchSSE41, snoise4FixedBatchSSE41, 4, CPU_SSE41 },
+    { "avx2", snoise4BatchAVX2, snoise4CachedAVX2, fbmBatchAVX2, snoise4FixedBatchAVX2, 8,
+      CPU_SSE41 | CPU_AVX2 },
+    // AVX-512F has no 16-bit lanes, so the fixed-point noise stays AVX2
+    { "avx512", snoise4BatchAVX512, snoise4CachedAVX512, fbmBatchAVX512, snoise4FixedBatchAVX2, 16,
+      CPU_SSE41 | CPU_AVX2 | CPU_AVX512 },
+    // Hashing in registers beats reading the corner cache, so no cached grid
+    { "avx512vbmi", snoise4BatchAVX512VBMI, NULL, fbmBatchAVX512VBMI,
+      snoise4FixedBatchAVX512VBMI, 16, CPU_SSE41 | CPU_AVX2 | CPU_AVX512 | CPU_VBMI },
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static const Kernel *kernel = NULL;
+
+/*
+ * cpuid(leaf, subleaf, regs) - regs[] = eax, ebx, ecx, edx.
+ */
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int*)regs, leaf, subleaf);
+#elif defined(__x86_64__) || defined(__i386__)
+    if(!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#else
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+/*
+ * xgetbv0() - the register states the OS saves on a context switch.
+ */
+static unsigned long long xgetbv0(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * cpuFeatures() - the CPU_* features of this CPU and OS.
+ */
+static int cpuFeatures(void)
+{
+    unsigned leaf1[4], leaf7[4];
+    unsigned long long xcr0 = 0;
+    int features = 0;
+
+    cpuid(0, 0, leaf1);
+    if(leaf1[0] < 7)
+        leaf7[0] = leaf7[1] = leaf7[2] = leaf7[3] = 0;
+    else
+        cpuid(7, 0, leaf7);
+    cpuid(1, 0, leaf1);
+
+    if(leaf1[2] & (1u << 19))
+        features |= CPU_SSE41;
+    if(leaf1[2] & (1u << 27)) // OSXSAVE, xgetbv is there
+        xcr0 = xgetbv0();
+    if((leaf1[2] & (1u << 12)) && (leaf1[2] & (1u << 28)) && // FMA, AVX
+       (leaf7[1] & (1u << 5)) && (xcr0 & 0x06) == 0x06)      // AVX2, XMM+YMM state
+        features |= CPU_AVX2;
+    if((leaf7[1] & (1u << 16)) && (xcr0 & 0xE6) == 0xE6)    // AVX-512F, opmask+ZMM state
+        features |= CPU_AVX512;
+    if((leaf7[1] & (1u << 30)) && (leaf7[2] & (1u << 1)))   // AVX-512BW, AVX-512VBMI
+        features |= CPU_VBMI;
+    return features;
+}
+
+static int tablesReady = 0;
+
+/*
+ * buildTables() - fill in the flattened texture tables described in
+ * noise_internal.h.
+ */
+static void buildTables(void)
+{
+    int i, j, k;
+
+    if(tablesReady)
+        return;
+    for(i = 0; i < 256; i++)
+        noisePerm[i] = noisePermutation[i];
+    for(i = 0; i < 256; i++)
+        for(j = 0; j < 256; j++)
+        {
+            int value = noisePermutation[(j + noisePermutation[i]) & 0xFF];
+            noisePermTexels[i*256 + j] = value == 255 ? 0 : value;
+            noiseGradTexels[i*256 + j] = value & 0x1F;
+        }
+    // Stored as g*64+64 in 8 bits, read back as c/255*4-1, see noise.c
+    for(i = 0; i < 32; i++)
+        for(k = 0; k < 4; k++)
+        {
+            noiseGradients[k][i] = (float)(noiseGrad4[i][k] * 64 + 64) / 255.0f * 4.0f - 1.0f;
+            noiseGradSigns[k][i] = (signed char)noiseGrad4[i][k];
+        }
+    tablesReady = 1;
+}
+
+void initNoiseTables(void)
+{
+    const char *name;
+
+    if(kernel)
+        return;
+    name = getenv("NOISE_KERNEL");
+    if(name && *name && !setNoiseKernel(name))
+        fprintf(stderr, "NOISE_KERNEL: \"%s\" is not supported here, using the default\n", name);
+    if(!kernel)
+        setNoiseKernel(NULL);
+}
+
+int setNoiseKernel(const char *name)
+{
+    int features = cpuFeatures(), k;
+
+    for(k = NUM_KERNELS - 1; k >= 0; k--)
+        if((kernels[k].features & features) == kernels[k].features &&
+           (!name || !strcmp(kernels[k].name, name)))
+            break;
+    if(k < 0)
+        return 0;
+    buildTables();
+    kernel = &kernels[k];
+    return 1;
+}
+
+const char *noiseKernelName(void)
+{
+    initNoiseTables();
+    return kernel->name;
+}
+
+const char *noiseKernelNameAt(int index)
+{
+    return index >= 0 && index < NUM_KERNELS ? kernels[index].name : NULL;
+}
+
+int noiseKernelSupported(const char *name)
+{
+    int features = cpuFeatures(), k;
+
+    for(k = 0; k < NUM_KERNELS; k++)
+        if(!strcmp(kernels[k].name, name))
+            return (kernels[k].features & features) == kernels[k].features;
+    return 0;
+}
+
+void snoise4BatchScalar(const float *x, const float *y, const float *z,
+                        const float *w, float *out, int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+        out[i] = snoise4(x[i], y[i], z[i], w[i]);
+}
+
+void snoise4Batch(const float *x, const float *y, const float *z,
+                  const float *w, float *out, int count)
+{
+    initNoiseTables();
+    kernel->snoise(x, y, z, w, out, count);
+}
+
+void snoise4FixedBatchScalar(const int *x, const int *y, const int *z,
+                             const int *w, short *out, int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+        out[i] = (short)snoise4Fixed(x[i], y[i], z[i], w[i]);
+}
+
+void snoise4FixedBatch(const int *x, const int *y, const int *z,
+                       const int *w, short *out, int count)
+{
+    initNoiseTables();
+    kernel->fixed(x, y, z, w, out, count);
+}
+
+/* Lanes per kernel call in fbmPacked(), small enough for the stack */
+#define FBM_CHUNK 256
+
+/*
+ * fbmPacked(x, y, z, out, count, octaves, frequency, persistence, time)
+ * - fbmBatch() with every octave of every point in a lane of its own, so
+ * that a few points still fill the SIMD lanes: 3 points of 8 octaves
+ * are 24 lanes of noise, not 8 calls of 3 lanes. Each point still adds
+ * up its octaves in order, like fbm().
+ */
+static void fbmPacked(const float *x, const float *y, const float *z, float *out,
+                      int count, int octaves, float frequency, float persistence,
+                      float time)
+{
+    float px[FBM_CHUNK], py[FBM_CHUNK], pz[FBM_CHUNK], pw[FBM_CHUNK];
+    float n[FBM_CHUNK], amplitudes[FBM_CHUNK];
+    int points[FBM_CHUNK];
+    float f = frequency, amplitude = 1.0f, maxAmplitude = 0.0f;
+    int i, o, size, lane;
+
+    for(i = 0; i < count; i++)
+        out[i] = 0.0f;
+    for(lane = 0; lane < FBM_CHUNK; lane++)
+        pw[lane] = time;
+    i = o = 0;
+    while(i < count)
+    {
+        for(size = 0; size < FBM_CHUNK && i < count; size++)
+        {
+            px[size] = x[i] * f;
+            py[size] = y[i] * f;
+            pz[size] = z[i] * f;
+            amplitudes[size] = amplitude;
+            points[size] = i;
+            f *= 2.0f;
+            amplitude *= persistence;
+            if(++o == octaves)
+            {
+                i++;
+                o = 0;
+                f = frequency;
+                amplitude = 1.0f;
+            }
+        }
+        kernel->snoise(px, py, pz, pw, n, size);
+        for(lane = 0; lane < size; lane++)
+            out[points[lane]] += n[lane] * amplitudes[lane];
+    }
+
+    amplitude = 1.0f;
+    for(o = 0; o < octaves; o++)
+    {
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+    }
+    for(i = 0; i < count; i++)
+        out[i] /= maxAmplitude;
+}
+
+void fbmBatch(const float *x, const float *y, const float *z, float *out,
+              int count, int octaves, float frequency, float persistence,
+              float time)
+{
+    float position[3];
+    int done = 0;
+
+    initNoiseTables();
+    if(count <= 0)
+        return;
+    if(octaves <= 0)
+    {
+        // Whatever fbm() makes of that
+        for(done = 0; done < count; done++)
+        {
+            position[0] = x[done];
+            position[1] = y[done];
+            position[2] = z[done];
+            out[done] = fbm(position, octaves, frequency, persistence, time);
+        }
+        return;
+    }
+    // Whole groups of points octave by octave in registers, then the
+    // rest packed into lanes by octave
+    if(kernel->fbm)
+    {
+        done = count - count % kernel->width;
+        kernel->fbm(x, y, z, out, done, octaves, frequency, persistence, time);
+    }
+    fbmPacked(x + done, y + done, z + done, out + done, count - done,
+              octaves, frequency, persistence, time);
+}
+
+void initFbmCache(FbmCache *cache, float cellSize)
+{
+    int i;
+
+    cache->cellSize = cellSize > 0.0f ? cellSize : 0.0f;
+    // NaN never equals a query, so an entry with one is empty
+    for(i = 0; i < FBM_CACHE_SIZE; i++)
+        cache->entries[i].x = NAN;
+    cache->params.octaves = -1;
+    cache->hits = cache->misses = 0;
+}
+
+/*
+ * cacheSlot(x, y, z) - the first of the two FbmCache entries the point
+ * (x,y,z) can be in, the one used last.
+ */
+static int cacheSlot(float x, float y, float z)
+{
+    unsigned bits[3], h;
+
+    memcpy(&bits[0], &x, sizeof(float));
+    memcpy(&bits[1], &y, sizeof(float));
+    memcpy(&bits[2], &z, sizeof(float));
+    h = bits[0] * 0x9E3779B1u ^ bits[1] * 0x85EBCA77u ^ bits[2] * 0xC2B2AE3Du;
+    return (int)((h ^ (h >> 15)) * 0x2C1B3C6Du >> (33 - FBM_CACHE_BITS)) * 2;
+}
+
+void fbmEval(const float *const points[3], int count, const FbmParams *params,
+             FbmCache *cache, float *out)
+{
+    float x[FBM_CHUNK], y[FBM_CHUNK], z[FBM_CHUNK], n[FBM_CHUNK];
+    int index[FBM_CHUNK], slots[FBM_CHUNK];
+    FbmCacheEntry *entry;
+    float px, py, pz, scale;
+    int i, k, size, misses = 0;
+
+    if(!cache)
+    {
+        fbmBatch(points[0], points[1], points[2], out, count, params->octaves,
+                 params->frequency, params->persistence, params->time);
+        return;
+    }
+    if(cache->params.octaves != params->octaves || cache->params.frequency != params->frequency ||
+       cache->params.persistence != params->persistence || cache->params.time != params->time)
+    {
+        for(k = 0; k < FBM_CACHE_SIZE; k++)
+            cache->entries[k].x = NAN;
+        cache->params = *params;
+    }
+
+    // Answer what the cache has, and gather the rest into chunks
+    scale = cache->cellSize > 0.0f ? 1.0f / cache->cellSize : 0.0f;
+    i = 0;
+    while(i < count)
+    {
+        for(size = 0; size < FBM_CHUNK && i < count; i++)
+        {
+            int slot;
+
+            px = points[0][i];
+            py = points[1][i];
+            pz = points[2][i];
+            if(scale > 0.0f)
+            {
+                // The centre of the cube, which stands in for the point
+                px = (floorf(px * scale) + 0.5f) * cache->cellSize;
+                py = (floorf(py * scale) + 0.5f) * cache->cellSize;
+                pz = (floorf(pz * scale) + 0.5f) * cache->cellSize;
+            }
+            slot = cacheSlot(px, py, pz);
+            entry = &cache->entries[slot];
+            if(entry[0].x == px && entry[0].y == py && entry[0].z == pz)
+            {
+                out[i] = entry[0].value;
+                continue;
+            }
+            if(entry[1].x == px && entry[1].y == py && entry[1].z == pz)
+            {
+                FbmCacheEntry hit = entry[1];
+                entry[1] = entry[0];
+                entry[0] = hit;
+                out[i] = hit.value;
+                continue;
+            }
+            x[size] = px;
+            y[size] = py;
+            z[size] = pz;
+            index[size] = i;
+            slots[size++] = slot;
+        }
+        fbmBatch(x, y, z, n, size, params->octaves, params->frequency,
+                 params->persistence, params->time);
+        for(k = 0; k < size; k++)
+        {
+            out[index[k]] = n[k];
+            entry = &cache->entries[slots[k]];
+            // The same point twice in a chunk misses twice, but goes in once
+            if(entry[0].x == x[k] && entry[0].y == y[k] && entry[0].z == z[k])
+                continue;
+            entry[1] = entry[0];
+            entry[0].x = x[k];
+            entry[0].y = y[k];
+            entry[0].z = z[k];
+            entry[0].value = n[k];
+        }
+        misses += size;
+    }
+    cache->hits += count - misses;
+    cache->misses += misses;
+}
+
+/* Grid points along each side of a block in the grid functions */
+#define GRID_BLOCK 8
+/* Grid points per kernel call when they go in order */
+#define GRID_ROW 256
+
+/*
+ * buildCache(cache, low, high, limit) - hash the lattice points from
+ * low[] to high[] into cache. Returns how many that was, or 0 if they
+ * don't fit or there are more than limit of them.
+ */
+static int buildCache(NoiseCache *cache, const int low[4], const int high[4], int limit)
+{
+    int shift = 0, count = 1, a, c, i, j, k, l, xy, zw, g, e;
+
+    for(a = 0; a < 4; a++)
+    {
+        if(high[a] < low[a])
+            return 0;
+        count *= high[a] - low[a] + 1;
+        cache->origin[a] = low[a];
+        cache->shift[a] = shift;
+        while((1 << (shift - cache->shift[a])) < high[a] - low[a] + 1)
+            shift++;
+        if((1 << shift) > NOISE_CACHE_SIZE || count > limit)
+            return 0;
+    }
+
+    for(l = low[3]; l <= high[3]; l++)
+        for(k = low[2]; k <= high[2]; k++)
+        {
+            zw = noisePermTexels[((l & 0xFF) << 8) | (k & 0xFF)];
+            for(j = low[1]; j <= high[1]; j++)
+                for(i = low[0]; i <= high[0]; i++)
+                {
+                    xy = noisePermTexels[((j & 0xFF) << 8) | (i & 0xFF)];
+                    g = noiseGradTexels[(zw << 8) | xy];
+                    e = (i - low[0]) | (j - low[1]) << cache->shift[1] |
+                        (k - low[2]) << cache->shift[2] | (l - low[3]) << cache->shift[3];
+                    cache->hashes[e] = g;
+                    for(c = 0; c < 4; c++)
+                        cache->gradients[c][e] = noiseGradients[c][g];
+                }
+        }
+    return count;
+}
+
+/*
+ * gridRows(x0, y0, z0, w, step, nx, ny, nz, scale, amplitude, out, add) -
+ * gridOctave() without the cache, in the order of out, and straight into
+ * it unless it adds to it.
+ */
+static double gridRows(float x0, float y0, float z0, float w, float step,
+                       int nx, int ny, int nz, float scale, float amplitude,
+                       float *out, int add)
+{
+    float px[GRID_ROW], py[GRID_ROW], pz[GRID_ROW], pw[GRID_ROW], n[GRID_ROW];
+    float y = y0 * scale, z = z0 * scale, *dest;
+    int count = nx*ny*nz, start, size, m, i = 0, j = 0, k = 0;
+
+    for(m = 0; m < GRID_ROW; m++)
+        pw[m] = w;
+    for(start = 0; start < count; start += size)
+    {
+        size = count - start < GRID_ROW ? count - start : GRID_ROW;
+        for(m = 0; m < size; m++)
+        {
+            px[m] = (x0 + i * step) * scale;
+            py[m] = y;
+            pz[m] = z;
+            if(++i == nx)
+            {
+                i = 0;
+                if(++j == ny)
+                {
+                    j = 0;
+                    k++;
+                    z = (z0 + k * step) * scale;
+                }
+                y = (y0 + j * step) * scale;
+            }
+        }
+        dest = out + start;
+        if(add)
+        {
+            kernel->snoise(px, py, pz, pw, n, size);
+            for(m = 0; m < size; m++)
+                dest[m] += n[m] * amplitude;
+        }
+        else
+        {
+            kernel->snoise(px, py, pz, pw, dest, size);
+            if(amplitude != 1.0f)
+                for(m = 0; m < size; m++)
+                    dest[m] *= amplitude;
+        }
+    }
+    return 5.0 * count;
+}
+
+/*
+ * gridOctave(x0, y0, z0, w, step, nx, ny, nz, scale, amplitude, out, add)
+ * - amplitude * snoise4() of the grid points times scale, w unscaled,
+ * into out, or added to out. Returns how many corner gradients it hashed.
+ */
+static double gridOctave(float x0, float y0, float z0, float w, float step,
+                         int nx, int ny, int nz, float scale, float amplitude,
+                         float *out, int add)
+{
+    float px[GRID_BLOCK*GRID_BLOCK*GRID_BLOCK], py[GRID_BLOCK*GRID_BLOCK*GRID_BLOCK];
+    float pz[GRID_BLOCK*GRID_BLOCK*GRID_BLOCK], pw[GRID_BLOCK*GRID_BLOCK*GRID_BLOCK];
+    float n[GRID_BLOCK*GRID_BLOCK*GRID_BLOCK];
+    float cx[GRID_BLOCK], cy[GRID_BLOCK], cz[GRID_BLOCK];
+    NoiseCache cache;
+    float low[3], high[3], s;
+    int lattice[2][4];
+    int bx, by, bz, sx, sy, sz, i, j, k, size, hashed;
+    double hashes = 0.0;
+
+    // A block more than a lattice cell across has more corners than points
+    if(!kernel->cached || !(fabsf(step * scale) * GRID_BLOCK <= 1.0f))
+        return gridRows(x0, y0, z0, w, step, nx, ny, nz, scale, amplitude, out, add);
+
+    for(size = 0; size < GRID_BLOCK*GRID_BLOCK*GRID_BLOCK; size++)
+        pw[size] = w;
+    for(bz = 0; bz < nz; bz += GRID_BLOCK)
+    for(by = 0; by < ny; by += GRID_BLOCK)
+    for(bx = 0; bx < nx; bx += GRID_BLOCK)
+    {
+        sx = nx - bx < GRID_BLOCK ? nx - bx : GRID_BLOCK;
+        sy = ny - by < GRID_BLOCK ? ny - by : GRID_BLOCK;
+        sz = nz - bz < GRID_BLOCK ? nz - bz : GRID_BLOCK;
+        for(i = 0; i < sx; i++)
+            cx[i] = (x0 + (bx + i) * step) * scale;
+        for(j = 0; j < sy; j++)
+            cy[j] = (y0 + (by + j) * step) * scale;
+        for(k = 0; k < sz; k++)
+            cz[k] = (z0 + (bz + k) * step) * scale;
+        size = 0;
+        for(k = 0; k < sz; k++)
+            for(j = 0; j < sy; j++)
+                for(i = 0; i < sx; i++, size++)
+                {
+                    px[size] = cx[i];
+                    py[size] = cy[j];
+                    pz[size] = cz[k];
+                }
+
+        // The block's first and last points bound its skewed coordinates,
+        // as rounding never reverses an order, and so the lattice points
+        // of its simplex corners
+        low[0] = fminf(cx[0], cx[sx - 1]); high[0] = fmaxf(cx[0], cx[sx - 1]);
+        low[1] = fminf(cy[0], cy[sy - 1]); high[1] = fmaxf(cy[0], cy[sy - 1]);
+        low[2] = fminf(cz[0], cz[sz - 1]); high[2] = fmaxf(cz[0], cz[sz - 1]);
+        s = (low[0] + low[1] + low[2] + w) * F4;
+        lattice[0][0] = (int)floorf(low[0] + s);
+        lattice[0][1] = (int)floorf(low[1] + s);
+        lattice[0][2] = (int)floorf(low[2] + s);
+        lattice[0][3] = (int)floorf(w + s);
+        s = (high[0] + high[1] + high[2] + w) * F4;
+        lattice[1][0] = (int)floorf(high[0] + s) + 1;
+        lattice[1][1] = (int)floorf(high[1] + s) + 1;
+        lattice[1][2] = (int)floorf(high[2] + s) + 1;
+        lattice[1][3] = (int)floorf(w + s) + 1;
+        hashed = buildCache(&cache, lattice[0], lattice[1], size);
+        if(hashed)
+            kernel->cached(&cache, px, py, pz, pw, n, size);
+        else
+        {
+            kernel->snoise(px, py, pz, pw, n, size);
+            hashed = 5 * size;
+        }
+        hashes += hashed;
+
+        size = 0;
+        for(k = bz; k < bz + sz; k++)
+            for(j = by; j < by + sy; j++, size += sx)
+            {
+                float *row = out + (k*ny + j)*nx + bx;
+                if(add)
+                    for(i = 0; i < sx; i++)
+                        row[i] += n[size + i] * amplitude;
+                else
+                    for(i = 0; i < sx; i++)
+                        row[i] = n[size + i] * amplitude;
+            }
+    }
+    return hashes;
+}
+
+float snoise4Grid(float x0, float y0, float z0, float w, float step,
+                  int nx, int ny, int nz, float *out)
+{
+    initNoiseTables();
+    if(nx <= 0 || ny <= 0 || nz <= 0)
+        return 0.0f;
+    return (float)(gridOctave(x0, y0, z0, w, step, nx, ny, nz, 1.0f, 1.0f, out, 0) /
+                   ((double)nx*ny*nz));
+}
+
+float fbmGrid(float x0, float y0, float z0, float step, int nx, int ny, int nz,
+              float *out, int octaves, float frequency, float persistence,
+              float time)
+{
+    float amplitude = 1.0f, maxAmplitude = 0.0f;
+    double hashes = 0.0;
+    int i, o;
+
+    initNoiseTables();
+    if(nx <= 0 || ny <= 0 || nz <= 0 || octaves <= 0)
+        return 0.0f;
+    for(o = 0; o < octaves; o++)
+    {
+        hashes += gridOctave(x0, y0, z0, time, step, nx, ny, nz, frequency, amplitude, out, o > 0);
+        frequency *= 2.0f;
+        maxAmplitude += amplitude;
+        amplitude *= persistence;
+    }
+    for(i = 0; i < nx*ny*nz; i++)
+        out[i] /= maxAmplitude;
+    return (float)(hashes / ((double)nx*ny*nz*octaves));
+}
@@ -0,0 +1,138 @@
+/*
+ * Shared between noise.c and the SIMD kernels, not part of the API.
+ *
+ * The kernels don't walk noisePermutation[] the way snoise4() does. They read
+ * flattened copies of the two lookup textures instead, with all of the
+ * GPU quirks already applied, so each corner takes three table lookups
+ * (gathers) plus the gradient components:
+ *
+ *   noisePermTexels[y*256 + x]  the permTexture texel at column x, row y,
+ *                               as the texel index it selects next
+ *                               (255 already wrapped to 0)
+ *   noiseGradTexels[y*256 + x]  the noiseGrad4[] index of the gradTexture
+ *                               texel at column x, row y
+ *   noiseGradients[k][i]        component k of noiseGrad4[i], as read back
+ *                               from the texture
+ *   noiseGradSigns[k][i]        noiseGrad4[i][k], -1, 0 or 1, for the
+ *                               fixed-point kernels
+ *
+ * The byte tables are padded so that a 32-bit gather at the last entry
+ * stays inside the array. noisePerm[] is noisePermutation[] in bytes,
+ * for kernels that keep it in registers and hash without any gathers.
+ */
+
+#ifndef NOISE_INTERNAL_H
+#define NOISE_INTERNAL_H
+
+#define NOISE_TEXELS (256*256)
+
+extern unsigned char noisePerm[256];
+extern unsigned char noisePermTexels[NOISE_TEXELS + 4];
+extern unsigned char noiseGradTexels[NOISE_TEXELS + 4];
+extern float noiseGradients[4][32];
+extern signed char noiseGradSigns[4][32];
+
+// The skewing and unskewing factors are hairy again for the 4D case
+// This is (sqrt(5.0)-1.0)/4.0
+#define F4 0.309016994375f
+// This is (5.0-sqrt(5.0))/20.0
+#define G4 0.138196601125f
+
+/*
+ * The fixed-point noise, snoise4Fixed(). Every step is an operation that
+ * the 16-bit SIMD lanes have, saturating where it says so, and the
+ * kernels do exactly these in the same order:
+ *
+ *   s = (x+y+z+w) * F4, in 16.16
+ *   Pi = (P + s) >> 16, the lattice cell
+ *   Pf0 = (P - (Pi << 16) + (Pi.x+Pi.y+Pi.z+Pi.w) * G4) >> 1, in Q15
+ *         (Q0.15, 32768 is 1.0), saturated to 16 bits
+ *
+ * with F4 and G4 to 31 bits, as a Q16 high part and a 15-bit low part,
+ * so that the products fit in 32 bits: sum*F4 is
+ * hi*F4_HIGH + (hi*F4_LOW >> 15) + (lo*F4_HIGH >> 16), hi and lo being
+ * the sum's integer and fractional parts. Rounding them to Q16 would
+ * misplace points by up to 1e-5 per lattice unit from the origin.
+ *
+ * and then for each corner, in 16 bits:
+ *
+ *   Pf = max(Pf0 +sat offset, -32767), offset = c*G4 or c*G4 - 1 in Q15
+ *   t = RADIUS_FIXED -sat Pf.x^2 -sat ... -sat Pf.w^2, clamped at 0
+ *   t4 = ((t^2) << 1)^2, t^4 in Q17
+ *   h = t4 * Pf, A = sum of h signed by noiseGrad4[], H = sum of h
+ *   n += A + (A + H) * 128 / 32768
+ *
+ * where a product is pmulhrsw's (a*b + 0x4000) >> 15. The gradients
+ * that come out of gradTexture are (256*g + 1)/255, not g, which is what
+ * the (A + H)/256 term makes up for. The result is 6.75 * n, the 27 of
+ * snoise4() from Q17 to Q15, saturated.
+ */
+#define F4_HIGH 20251       // F4 * 2^31 = F4_HIGH << 15 | F4_LOW
+#define F4_LOW 24174
+#define G4_HIGH 9056        // G4 * 2^31 = G4_HIGH << 15 | G4_LOW
+#define G4_LOW 27933
+#define G4_Q15 4528
+#define RADIUS_FIXED 19661  // 0.6 in Q15
+
+/*
+ * The gradients of a box of lattice points, hashed once for a block of
+ * grid samples (see snoise4Grid()). Lattice point (i,j,k,l) is entry
+ *
+ *   (i - origin[0]) | (j - origin[1]) << shift[1] |
+ *   (k - origin[2]) << shift[2] | (l - origin[3]) << shift[3]
+ *
+ * as its noiseGrad4[] index in hashes[], and as the components of that
+ * gradient in gradients[].
+ */
+#define NOISE_CACHE_SIZE 512
+
+typedef struct {
+    int origin[4];
+    int shift[4];
+    int hashes[NOISE_CACHE_SIZE];
+    float gradients[4][NOISE_CACHE_SIZE];
+} NoiseCache;
+
+/* The batch kernels, one per instruction set, see noise_batch.c */
+void snoise4BatchScalar(const float *x, const float *y, const float *z,
+                        const float *w, float *out, int count);
+void snoise4BatchSSE41(const float *x, const float *y, const float *z,
+                       const float *w, float *out, int count);
+void snoise4BatchAVX2(const float *x, const float *y, const float *z,
+                      const float *w, float *out, int count);
+void snoise4BatchAVX512(const float *x, const float *y, const float *z,
+                        const float *w, float *out, int count);
+void snoise4BatchAVX512VBMI(const float *x, const float *y, const float *z,
+                            const float *w, float *out, int count);
+
+/* The snoise4FixedBatch() kernels */
+void snoise4FixedBatchScalar(const int *x, const int *y, const int *z,
+                             const int *w, short *out, int count);
+void snoise4FixedBatchSSE41(const int *x, const int *y, const int *z,
+                            const int *w, short *out, int count);
+void snoise4FixedBatchAVX2(const int *x, const int *y, const int *z,
+                           const int *w, short *out, int count);
+void snoise4FixedBatchAVX512VBMI(const int *x, const int *y, const int *z,
+                                 const int *w, short *out, int count);
+
+/* snoise4Batch() of points whose corners are all in cache */
+void snoise4CachedAVX2(const NoiseCache *cache, const float *x, const float *y,
+                       const float *z, const float *w, float *out, int count);
+void snoise4CachedAVX512(const NoiseCache *cache, const float *x, const float *y,
+                         const float *z, const float *w, float *out, int count);
+
+/* fbmBatch() of the whole SIMD-width groups of points, the rest is left */
+void fbmBatchSSE41(const float *x, const float *y, const float *z, float *out,
+                   int count, int octaves, float frequency, float persistence,
+                   float time);
+void fbmBatchAVX2(const float *x, const float *y, const float *z, float *out,
+                  int count, int octaves, float frequency, float persistence,
+                  float time);
+void fbmBatchAVX512(const float *x, const float *y, const float *z, float *out,
+                    int count, int octaves, float frequency, float persistence,
+                    float time);
+void fbmBatchAVX512VBMI(const float *x, const float *y, const float *z, float *out,
+                        int count, int octaves, float frequency, float persistence,
+                        float time);
+
+#endif /* NOISE_INTERNAL_H */
@@ -0,0 +1,519 @@
+/*
+ * The work-stealing thread pool of noise_pool.h.
+ *
+ * The deques are Chase and Lev's: the owner pushes and pops at the
+ * bottom without locking, and thieves take from the top with a
+ * compare-and-swap, which also settles the race for the last task. They
+ * are fixed in size; a worker that finds its deque full stops splitting
+ * and runs the whole range itself. A task is a range of a job, and the
+ * job counts down the items still to be done, so whoever is waiting on
+ * it knows when it is finished, however it was split and stolen.
+ *
+ * Helper threads spin looking for tasks while any parallelFor() is
+ * running, and sleep on a condition variable between them. The
+ * outermost parallelFor() waits for them all to go back to sleep before
+ * it returns, so their stats are settled for getNoisePoolStats().
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_setaffinity_np()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "noise_pool.h"
+
+#define MAX_WORKERS 1024
+#define DEQUE_SIZE 1024 // A power of two, and far more than log2(count) deep
+#define SPINS_BEFORE_YIELD 64
+
+typedef struct {
+    NoiseTaskFunc func;
+    void *arg;
+    int grain;
+    _Atomic int pending; // Items not done yet
+} NoiseJob;
+
+/*
+ * A deque slot. Thieves may read one while the owner is writing it, but
+ * then their compare-and-swap on top fails and they throw it away; the
+ * fields are atomic only so that reading it isn't a data race.
+ */
+typedef struct {
+    _Atomic(NoiseJob *) job;
+    _Atomic int begin, end;
+} NoiseTask;
+
+typedef struct {
+    // Written by thieves, kept off the owner's cache line
+    _Alignas(64) _Atomic long top;
+    _Alignas(64) _Atomic long bottom;
+    NoiseTask tasks[DEQUE_SIZE];
+    NoisePool *pool;
+    pthread_t thread;
+    int id;
+    unsigned random;
+    double idleSince; // When it last ran out of tasks, 0 while busy
+    NoisePoolStats stats;
+} NoiseWorker;
+
+struct NoisePool {
+    NoiseWorker *workers;
+    int numWorkers;
+    _Atomic int activeJobs; // Outermost parallelFor() calls going on
+    _Atomic int quit;
+    int parked; // Helpers asleep, under lock
+    pthread_mutex_t lock;
+    pthread_cond_t wake, allParked;
+};
+
+/* The pool and worker of the calling thread, if it is one */
+static _Thread_local NoisePool *currentPool = NULL;
+static _Thread_local int currentWorker = -1;
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*
+ * pushTask(worker, job, begin, end) - add a task at the bottom of the
+ * worker's own deque. Returns 0 if it is full.
+ */
+static int pushTask(NoiseWorker *worker, NoiseJob *job, int begin, int end)
+{
+    long b = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&worker->top, memory_order_acquire);
+    NoiseTask *task = &worker->tasks[b & (DEQUE_SIZE - 1)];
+
+    if(b - t >= DEQUE_SIZE)
+        return 0;
+    atomic_store_explicit(&task->job, job, memory_order_relaxed);
+    atomic_store_explicit(&task->begin, begin, memory_order_relaxed);
+    atomic_store_explicit(&task->end, end, memory_order_relaxed);
+    // Publishes the task, and the job behind it, to the thieves
+    atomic_store_explicit(&worker->bottom, b + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * popTask(worker, task) - take the newest task off the bottom of the
+ * worker's own deque. Returns 0 if there are none.
+ */
+static int popTask(NoiseWorker *worker, NoiseTask *task)
+{
+    long b = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    long t;
+    NoiseTask *slot = &worker->tasks[b & (DEQUE_SIZE - 1)];
+    int found = 1;
+
+    atomic_store_explicit(&worker->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    if(t > b)
+    {
+        // Empty
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_init(&task->job, atomic_load_explicit(&slot->job, memory_order_relaxed));
+    atomic_init(&task->begin, atomic_load_explicit(&slot->begin, memory_order_relaxed));
+    atomic_init(&task->end, atomic_load_explicit(&slot->end, memory_order_relaxed));
+    if(t == b)
+    {
+        // The last one, which a thief may be taking too
+        found = atomic_compare_exchange_strong_explicit(&worker->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+    }
+    return found;
+}
+
+/*
+ * stealTask(victim, task) - take the oldest task off the top of another
+ * worker's deque. Returns 0 if there are none, or another thief or the
+ * owner got there first.
+ */
+static int stealTask(NoiseWorker *victim, NoiseTask *task)
+{
+    long t = atomic_load_explicit(&victim->top, memory_order_acquire);
+    long b;
+    NoiseTask *slot = &victim->tasks[t & (DEQUE_SIZE - 1)];
+
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+    if(t >= b)
+        return 0;
+    atomic_init(&task->job, atomic_load_explicit(&slot->job, memory_order_relaxed));
+    atomic_init(&task->begin, atomic_load_explicit(&slot->begin, memory_order_relaxed));
+    atomic_init(&task->end, atomic_load_explicit(&slot->end, memory_order_relaxed));
+    return atomic_compare_exchange_strong_explicit(&victim->top, &t, t + 1,
+               memory_order_seq_cst, memory_order_relaxed);
+}
+
+/*
+ * stopIdling(worker) - count the idle time up to now, on finding a task,
+ * going to sleep or going back to the caller.
+ */
+static void stopIdling(NoiseWorker *worker)
+{
+    if(worker->idleSince > 0.0)
+    {
+        worker->stats.idle += now() - worker->idleSince;
+        worker->idleSince = 0.0;
+    }
+}
+
+/*
+ * runTask(worker, task) - split the task down to its job's grain,
+ * leaving the upper halves on the deque, then run what is left.
+ */
+static void runTask(NoiseWorker *worker, NoiseTask *task)
+{
+    NoiseJob *job = atomic_load_explicit(&task->job, memory_order_relaxed);
+    int begin = atomic_load_explicit(&task->begin, memory_order_relaxed);
+    int end = atomic_load_explicit(&task->end, memory_order_relaxed);
+    int middle;
+    double start;
+
+    stopIdling(worker);
+    while(end - begin > job->grain)
+    {
+        middle = begin + (end - begin) / 2;
+        if(!pushTask(worker, job, middle, end))
+            break;
+        end = middle;
+    }
+    start = now();
+    job->func(job->arg, begin, end, worker->id);
+    worker->stats.busy += now() - start;
+    worker->stats.tasks++;
+    worker->stats.items += end - begin;
+    atomic_fetch_sub_explicit(&job->pending, end - begin, memory_order_release);
+}
+
+/*
+ * findTask(worker, task) - a task from the worker's own deque, or else
+ * from a random other one, trying each of them once. Returns 0 and
+ * starts counting idle time, and a failed steal, if there are none.
+ */
+static int findTask(NoiseWorker *worker, NoiseTask *task)
+{
+    NoisePool *pool = worker->pool;
+    int i, victim;
+
+    if(popTask(worker, task))
+        return 1;
+    if(pool->numWorkers > 1)
+    {
+        // xorshift, so the thieves don't all pick the same victims
+        worker->random ^= worker->random << 13;
+        worker->random ^= worker->random >> 17;
+        worker->random ^= worker->random << 5;
+        victim = (int)(worker->random % (unsigned)(pool->numWorkers - 1));
+        for(i = 0; i < pool->numWorkers - 1; i++, victim++)
+        {
+            if(victim >= pool->numWorkers - 1)
+                victim = 0;
+            // Skip over the worker itself
+            if(stealTask(&pool->workers[victim < worker->id ? victim : victim + 1], task))
+            {
+                worker->stats.steals++;
+                return 1;
+            }
+        }
+    }
+    if(worker->idleSince == 0.0)
+    {
+        // Once per stretch of looking, not once per try
+        if(pool->numWorkers > 1)
+            worker->stats.failedSteals++;
+        worker->idleSince = now();
+    }
+    return 0;
+}
+
+/*
+ * pinThread(thread, index, allowed) - bind a thread to the index-th of
+ * the allowed cores, wrapping around.
+ */
+static void pinThread(pthread_t thread, int index, const cpu_set_t *allowed)
+{
+    cpu_set_t one;
+    int cpu, count = 0, target;
+
+    if(CPU_COUNT(allowed) == 0)
+        return;
+    target = index % CPU_COUNT(allowed);
+    for(cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if(CPU_ISSET(cpu, allowed) && count++ == target)
+        {
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(thread, sizeof(one), &one);
+            return;
+        }
+    }
+}
+
+/*
+ * workerLoop(arg) - a helper thread: look for tasks while there is a
+ * parallelFor() going on, sleep while there isn't.
+ */
+static void *workerLoop(void *arg)
+{
+    NoiseWorker *worker = (NoiseWorker*)arg;
+    NoisePool *pool = worker->pool;
+    NoiseTask task;
+    int spins = 0;
+
+    currentPool = pool;
+    currentWorker = worker->id;
+    while(!atomic_load(&pool->quit))
+    {
+        if(atomic_load(&pool->activeJobs) == 0)
+        {
+            stopIdling(worker);
+            pthread_mutex_lock(&pool->lock);
+            if(++pool->parked == pool->numWorkers - 1)
+                pthread_cond_signal(&pool->allParked);
+            while(atomic_load(&pool->activeJobs) == 0 && !atomic_load(&pool->quit))
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            pool->parked--;
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+        if(findTask(worker, &task))
+        {
+            runTask(worker, &task);
+            spins = 0;
+        }
+        else if(++spins >= SPINS_BEFORE_YIELD)
+        {
+            sched_yield();
+            spins = 0;
+        }
+    }
+    stopIdling(worker);
+    return NULL;
+}
+
+NoisePool *createNoisePool(int threads, int pin)
+{
+    NoisePool *pool;
+    cpu_set_t allowed;
+    int i;
+
+    if(threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads < 1)
+        threads = 1;
+    if(threads > MAX_WORKERS)
+        threads = MAX_WORKERS;
+    // Before the calling thread is pinned to just one of them
+    if(!pin || sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        pin = 0;
+
+    pool = (NoisePool*)calloc(1, sizeof(NoisePool));
+    if(pool == NULL)
+        return NULL;
+    // The deques want their cache line alignment
+    pool->workers = (NoiseWorker*)aligned_alloc(64, threads * sizeof(NoiseWorker));
+    if(pool->workers == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, threads * sizeof(NoiseWorker));
+    pool->numWorkers = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->allParked, NULL);
+    for(i = 0; i < threads; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].random = 2654435761u * (i + 1);
+    }
+
+    currentPool = pool;
+    currentWorker = 0;
+    if(pin)
+        pinThread(pthread_self(), 0, &allowed);
+    for(i = 1; i < threads; i++)
+    {
+        if(pthread_create(&pool->workers[i].thread, NULL, workerLoop, &pool->workers[i]) != 0)
+        {
+            pool->numWorkers = i;
+            destroyNoisePool(pool);
+            return NULL;
+        }
+        if(pin)
+            pinThread(pool->workers[i].thread, i, &allowed);
+    }
+    return pool;
+}
+
+void destroyNoisePool(NoisePool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->quit, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for(i = 1; i < pool->numWorkers; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+    if(currentPool == pool)
+    {
+        currentPool = NULL;
+        currentWorker = -1;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->allParked);
+    free(pool->workers);
+    free(pool);
+}
+
+int noisePoolWorkers(const NoisePool *pool)
+{
+    return pool->numWorkers;
+}
+
+void parallelFor(NoisePool *pool, int count, int grain, NoiseTaskFunc func,
+                 void *arg)
+{
+    NoiseWorker *worker;
+    NoiseJob job;
+    NoiseTask task;
+    int outermost, spins = 0;
+
+    if(count <= 0)
+        return;
+    if(currentPool != pool)
+    {
+        // Not one of the workers
+        func(arg, 0, count, 0);
+        return;
+    }
+    worker = &pool->workers[currentWorker];
+    job.func = func;
+    job.arg = arg;
+    job.grain = grain < 1 ? 1 : grain;
+    atomic_init(&job.pending, count);
+
+    // A call from inside a task finds the helpers awake already
+    outermost = currentWorker == 0 && atomic_load(&pool->activeJobs) == 0;
+    if(outermost)
+    {
+        pthread_mutex_lock(&pool->lock);
+        atomic_store(&pool->activeJobs, 1);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    atomic_init(&task.job, &job);
+    atomic_init(&task.begin, 0);
+    atomic_init(&task.end, count);
+    runTask(worker, &task);
+    // Help out, with this job or any other, until this one is done
+    while(atomic_load_explicit(&job.pending, memory_order_acquire) > 0)
+    {
+        if(findTask(worker, &task))
+        {
+            runTask(worker, &task);
+            spins = 0;
+        }
+        else if(++spins >= SPINS_BEFORE_YIELD)
+        {
+            // Let the helpers finishing the job have the core
+            sched_yield();
+            spins = 0;
+        }
+    }
+    stopIdling(worker);
+
+    if(outermost)
+    {
+        // Wait for the helpers to stop counting, or they race the stats
+        atomic_store(&pool->activeJobs, 0);
+        pthread_mutex_lock(&pool->lock);
+        while(pool->parked < pool->numWorkers - 1)
+            pthread_cond_wait(&pool->allParked, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+typedef struct {
+    NoiseTileFunc func;
+    void *arg;
+    int width, height, tileWidth, tileHeight, tilesX;
+} NoiseTiles;
+
+/*
+ * runTiles(arg, begin, end, worker) - the tiles numbered begin to end-1.
+ */
+static void runTiles(void *arg, int begin, int end, int worker)
+{
+    NoiseTiles *tiles = (NoiseTiles*)arg;
+    int tile, x0, y0, x1, y1;
+
+    for(tile = begin; tile < end; tile++)
+    {
+        x0 = (tile % tiles->tilesX) * tiles->tileWidth;
+        y0 = (tile / tiles->tilesX) * tiles->tileHeight;
+        x1 = x0 + tiles->tileWidth;
+        y1 = y0 + tiles->tileHeight;
+        if(x1 > tiles->width) x1 = tiles->width;
+        if(y1 > tiles->height) y1 = tiles->height;
+        tiles->func(tiles->arg, x0, y0, x1, y1, worker);
+    }
+}
+
+void parallelFor2D(NoisePool *pool, int width, int height, int tileWidth,
+                   int tileHeight, NoiseTileFunc func, void *arg)
+{
+    NoiseTiles tiles;
+    int tilesY;
+
+    if(width <= 0 || height <= 0 || tileWidth <= 0 || tileHeight <= 0)
+        return;
+    tiles.func = func;
+    tiles.arg = arg;
+    tiles.width = width;
+    tiles.height = height;
+    tiles.tileWidth = tileWidth;
+    tiles.tileHeight = tileHeight;
+    tiles.tilesX = (width + tileWidth - 1) / tileWidth;
+    tilesY = (height + tileHeight - 1) / tileHeight;
+    parallelFor(pool, tiles.tilesX * tilesY, 1, runTiles, &tiles);
+}
+
+void getNoisePoolStats(const NoisePool *pool, int worker, NoisePoolStats *stats)
+{
+    *stats = pool->workers[worker].stats;
+}
+
+void resetNoisePoolStats(NoisePool *pool)
+{
+    int i;
+
+    for(i = 0; i < pool->numWorkers; i++)
+        memset(&pool->workers[i].stats, 0, sizeof(NoisePoolStats));
+}
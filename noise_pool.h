@@ -0,0 +1,94 @@
+/*
+ * A work-stealing thread pool for CPU noise work.
+ *
+ * Tile bakes, point batches and mesh builds all come down to running a
+ * function over a range of items on every core, with items that don't
+ * all cost the same: a tile of sky is cheap, a tile of planet is not.
+ * Each worker has a deque of ranges. It splits the range it runs in
+ * half until it is down to the grain, pushing the other halves onto its
+ * own deque and popping them back newest first, while workers with
+ * nothing to do steal the oldest, largest ones from a random other
+ * worker. The thread that creates the pool is worker 0, and works too
+ * while it waits for a parallelFor() to finish.
+ *
+ * parallelFor() can be called again from inside a task, and the worker
+ * runs other tasks until the inner one is done. It must not be called
+ * from threads outside the pool, which just run the whole range on
+ * their own.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef NOISE_POOL_H
+#define NOISE_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NoisePool NoisePool;
+
+/* func(arg, begin, end, worker) - do items begin to end-1 */
+typedef void (*NoiseTaskFunc)(void *arg, int begin, int end, int worker);
+
+/* func(arg, x0, y0, x1, y1, worker) - do the tile from x0,y0 to x1-1,y1-1 */
+typedef void (*NoiseTileFunc)(void *arg, int x0, int y0, int x1, int y1,
+                              int worker);
+
+/*
+ * createNoisePool(threads, pin) - a pool of threads workers, one per
+ * core for 0, counting the calling thread. With pin set, worker i is
+ * bound to the i-th core the process may run on, the calling thread
+ * included. Returns NULL if the threads can't be started.
+ */
+NoisePool *createNoisePool(int threads, int pin);
+
+/* destroyNoisePool(pool) - stop and join the workers */
+void destroyNoisePool(NoisePool *pool);
+
+/* noisePoolWorkers(pool) - the number of workers, the caller included */
+int noisePoolWorkers(const NoisePool *pool);
+
+/*
+ * parallelFor(pool, count, grain, func, arg) - call func on ranges that
+ * cover 0 to count-1 between them, of no more than grain items unless
+ * a deque is full, and return once all are done.
+ */
+void parallelFor(NoisePool *pool, int count, int grain, NoiseTaskFunc func,
+                 void *arg);
+
+/*
+ * parallelFor2D(pool, width, height, tileWidth, tileHeight, func, arg) -
+ * call func on every tile of a width by height rectangle, cut into
+ * tileWidth by tileHeight tiles, smaller along the right and bottom.
+ * The tiles are numbered row by row and split like the items of
+ * parallelFor() with a grain of one, so a steal takes a band of rows.
+ */
+void parallelFor2D(NoisePool *pool, int width, int height, int tileWidth,
+                   int tileHeight, NoiseTileFunc func, void *arg);
+
+/*
+ * What a worker has done since the pool was created or the stats were
+ * reset: the ranges it ran and their items, the ranges it stole and the
+ * stretches of looking that found nothing, and the seconds it spent
+ * running tasks and looking for them while a parallelFor() was going
+ * on. Idle time is the scheduling overhead and the imbalance together;
+ * between calls the helper threads sleep, and that isn't counted.
+ */
+typedef struct {
+    unsigned long long tasks, items;
+    unsigned long long steals, failedSteals;
+    double busy, idle;
+} NoisePoolStats;
+
+/* getNoisePoolStats(pool, worker, stats) - between parallelFor() calls */
+void getNoisePoolStats(const NoisePool *pool, int worker, NoisePoolStats *stats);
+
+/* resetNoisePoolStats(pool) - zero every worker's stats */
+void resetNoisePoolStats(NoisePool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOISE_POOL_H */
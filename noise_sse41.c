@@ -0,0 +1,329 @@
+/*
+ * snoise4() four points at a time, with SSE4.1. Build this file with
+ * -msse4.1; noise_batch.c only calls it on a CPU that has it.
+ *
+ * The same steps as noise_avx2.c, four lanes wide and without FMA.
+ * There are no gathers before AVX2, so the table lookups are done one
+ * lane at a time. fbmBatchSSE41() is fbmBatchAVX2(), four lanes wide.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <smmintrin.h>
+
+#include "noise.h"
+#include "noise_internal.h"
+
+/*
+ * texel(table, x, y) - the byte table entries at column x & 255, row
+ * y & 255.
+ */
+static inline __m128i texel(const unsigned char *table, __m128i x, __m128i y)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i index = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(y, mask), 8),
+                                 _mm_and_si128(x, mask));
+    return _mm_setr_epi32(table[_mm_extract_epi32(index, 0)], table[_mm_extract_epi32(index, 1)],
+                          table[_mm_extract_epi32(index, 2)], table[_mm_extract_epi32(index, 3)]);
+}
+
+/*
+ * gradient(k, g) - component k of the gradients with noiseGrad4[] indices g.
+ */
+static inline __m128 gradient(int k, __m128i g)
+{
+    const float *component = noiseGradients[k];
+    return _mm_setr_ps(component[_mm_extract_epi32(g, 0)], component[_mm_extract_epi32(g, 1)],
+                       component[_mm_extract_epi32(g, 2)], component[_mm_extract_epi32(g, 3)]);
+}
+
+/*
+ * corner(x, y, z, w, px, py, pz, pw) - the contributions of four simplex
+ * corners with integer coordinates (x,y,z,w), at offsets (px,py,pz,pw).
+ */
+static inline __m128 corner(__m128i x, __m128i y, __m128i z, __m128i w,
+                            __m128 px, __m128 py, __m128 pz, __m128 pw)
+{
+    __m128i xy = texel(noisePermTexels, x, y);
+    __m128i zw = texel(noisePermTexels, z, w);
+    __m128i g = texel(noiseGradTexels, xy, zw);
+    __m128 t, d;
+
+    t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)),
+                   _mm_add_ps(_mm_mul_ps(pz, pz), _mm_mul_ps(pw, pw)));
+    t = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(0.6f), t), _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    t = _mm_mul_ps(t, t);
+
+    d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gradient(0, g), px), _mm_mul_ps(gradient(1, g), py)),
+                   _mm_add_ps(_mm_mul_ps(gradient(2, g), pz), _mm_mul_ps(gradient(3, g), pw)));
+    return _mm_mul_ps(t, d);
+}
+
+/*
+ * snoise4x4(x, y, z, w) - snoise4() of four points.
+ */
+static inline __m128 snoise4x4(__m128 x, __m128 y, __m128 z, __m128 w)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 s, t, fx, fy, fz, fw, n;
+    __m128i ix, iy, iz, iw, c01, c02, c03, c12, c13, c23;
+    __m128i r0, r1, r2, r3, o0, o1, o2, o3, limit;
+    int c;
+
+    // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+    s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(x, y), z), w), _mm_set1_ps(F4));
+    fx = _mm_floor_ps(_mm_add_ps(x, s));
+    fy = _mm_floor_ps(_mm_add_ps(y, s));
+    fz = _mm_floor_ps(_mm_add_ps(z, s));
+    fw = _mm_floor_ps(_mm_add_ps(w, s));
+    t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(fx, fy), fz), fw), _mm_set1_ps(G4));
+    ix = _mm_cvttps_epi32(fx);
+    iy = _mm_cvttps_epi32(fy);
+    iz = _mm_cvttps_epi32(fz);
+    iw = _mm_cvttps_epi32(fw);
+    // The distances from the cell origin
+    x = _mm_sub_ps(x, _mm_sub_ps(fx, t));
+    y = _mm_sub_ps(y, _mm_sub_ps(fy, t));
+    z = _mm_sub_ps(z, _mm_sub_ps(fz, t));
+    w = _mm_sub_ps(w, _mm_sub_ps(fw, t));
+
+    // Rank the components like simplex(), see noise_avx2.c
+    c01 = _mm_castps_si128(_mm_cmpge_ps(x, y));
+    c02 = _mm_castps_si128(_mm_cmpge_ps(x, z));
+    c03 = _mm_castps_si128(_mm_cmpge_ps(x, w));
+    c12 = _mm_castps_si128(_mm_cmpge_ps(y, z));
+    c13 = _mm_castps_si128(_mm_cmpge_ps(y, w));
+    c23 = _mm_castps_si128(_mm_cmpge_ps(z, w));
+    r0 = _mm_sub_epi32(_mm_setzero_si128(), _mm_add_epi32(_mm_add_epi32(c01, c02), c03));
+    r1 = _mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(1), c01), _mm_add_epi32(c12, c13));
+    r2 = _mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(2), _mm_add_epi32(c02, c12)), c23);
+    r3 = _mm_add_epi32(_mm_set1_epi32(3), _mm_add_epi32(_mm_add_epi32(c03, c13), c23));
+
+    n = corner(ix, iy, iz, iw, x, y, z, w);
+    for(c = 1; c <= 3; c++)
+    {
+        // Step along every component ranked 4-c or higher
+        __m128 g = _mm_set1_ps((float)c * G4);
+        limit = _mm_set1_epi32(3 - c);
+        o0 = _mm_cmpgt_epi32(r0, limit);
+        o1 = _mm_cmpgt_epi32(r1, limit);
+        o2 = _mm_cmpgt_epi32(r2, limit);
+        o3 = _mm_cmpgt_epi32(r3, limit);
+        n = _mm_add_ps(n, corner(
+            _mm_sub_epi32(ix, o0), _mm_sub_epi32(iy, o1),
+            _mm_sub_epi32(iz, o2), _mm_sub_epi32(iw, o3),
+            _mm_add_ps(_mm_sub_ps(x, _mm_and_ps(_mm_castsi128_ps(o0), one)), g),
+            _mm_add_ps(_mm_sub_ps(y, _mm_and_ps(_mm_castsi128_ps(o1), one)), g),
+            _mm_add_ps(_mm_sub_ps(z, _mm_and_ps(_mm_castsi128_ps(o2), one)), g),
+            _mm_add_ps(_mm_sub_ps(w, _mm_and_ps(_mm_castsi128_ps(o3), one)), g)));
+    }
+    o0 = _mm_set1_epi32(1);
+    s = _mm_set1_ps(1.0f - 4.0f*G4);
+    n = _mm_add_ps(n, corner(
+        _mm_add_epi32(ix, o0), _mm_add_epi32(iy, o0),
+        _mm_add_epi32(iz, o0), _mm_add_epi32(iw, o0),
+        _mm_sub_ps(x, s), _mm_sub_ps(y, s),
+        _mm_sub_ps(z, s), _mm_sub_ps(w, s)));
+
+    // Sum up and scale the result to cover the range [-1,1]
+    return _mm_mul_ps(n, _mm_set1_ps(27.0f));
+}
+
+void snoise4BatchSSE41(const float *x, const float *y, const float *z,
+                       const float *w, float *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, snoise4x4(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i),
+                                         _mm_loadu_ps(z + i), _mm_loadu_ps(w + i)));
+    // The last few points one at a time
+    snoise4BatchScalar(x + i, y + i, z + i, w + i, out + i, count - i);
+}
+
+void fbmBatchSSE41(const float *x, const float *y, const float *z, float *out,
+                   int count, int octaves, float frequency, float persistence,
+                   float time)
+{
+    __m128 px, py, pz, w, f, amplitude, total;
+    float maxAmplitude = 0.0f, a = 1.0f;
+    int i, o;
+
+    for(o = 0; o < octaves; o++)
+    {
+        maxAmplitude += a;
+        a *= persistence;
+    }
+    w = _mm_set1_ps(time);
+    for(i = 0; i + 4 <= count; i += 4)
+    {
+        px = _mm_loadu_ps(x + i);
+        py = _mm_loadu_ps(y + i);
+        pz = _mm_loadu_ps(z + i);
+        f = _mm_set1_ps(frequency);
+        amplitude = _mm_set1_ps(1.0f);
+        total = _mm_setzero_ps();
+        for(o = 0; o < octaves; o++)
+        {
+            total = _mm_add_ps(total, _mm_mul_ps(snoise4x4(
+                _mm_mul_ps(px, f), _mm_mul_ps(py, f), _mm_mul_ps(pz, f), w), amplitude));
+            f = _mm_add_ps(f, f);
+            amplitude = _mm_mul_ps(amplitude, _mm_set1_ps(persistence));
+        }
+        _mm_storeu_ps(out + i, _mm_div_ps(total, _mm_set1_ps(maxAmplitude)));
+    }
+}
+
+/*
+ * cellFixed(x, y, z, w, Pi, Pf) - the 32-bit steps of snoise4Fixed()
+ * for four points: their lattice cells in Pi[] and their Q15 offsets
+ * from the cell origins in Pf[], both still in 32-bit lanes.
+ */
+static inline void cellFixed(__m128i x, __m128i y, __m128i z, __m128i w,
+                             __m128i Pi[4], __m128i Pf[4])
+{
+    __m128i P[4], s, hi;
+    int k;
+
+    P[0] = x; P[1] = y; P[2] = z; P[3] = w;
+    s = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(x, y), z), w);
+    hi = _mm_srai_epi32(s, 16);
+    s = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(hi, _mm_set1_epi32(F4_HIGH)),
+                                    _mm_srai_epi32(_mm_mullo_epi32(hi, _mm_set1_epi32(F4_LOW)), 15)),
+                      _mm_srai_epi32(_mm_mullo_epi32(_mm_and_si128(s, _mm_set1_epi32(0xFFFF)),
+                                                     _mm_set1_epi32(F4_HIGH)), 16));
+    for(k = 0; k < 4; k++)
+        Pi[k] = _mm_srai_epi32(_mm_add_epi32(P[k], s), 16);
+    s = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(Pi[0], Pi[1]), Pi[2]), Pi[3]);
+    s = _mm_add_epi32(_mm_mullo_epi32(s, _mm_set1_epi32(G4_HIGH)),
+                      _mm_srai_epi32(_mm_mullo_epi32(s, _mm_set1_epi32(G4_LOW)), 15));
+    for(k = 0; k < 4; k++)
+        Pf[k] = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(P[k], _mm_slli_epi32(Pi[k], 16)), s), 1);
+}
+
+/*
+ * texel16(table, x, y) - texel() of 16-bit lanes.
+ */
+static inline __m128i texel16(const unsigned char *table, __m128i x, __m128i y)
+{
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    __m128i index = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(y, mask), 8),
+                                 _mm_and_si128(x, mask));
+    return _mm_setr_epi16(table[_mm_extract_epi16(index, 0)], table[_mm_extract_epi16(index, 1)],
+                          table[_mm_extract_epi16(index, 2)], table[_mm_extract_epi16(index, 3)],
+                          table[_mm_extract_epi16(index, 4)], table[_mm_extract_epi16(index, 5)],
+                          table[_mm_extract_epi16(index, 6)], table[_mm_extract_epi16(index, 7)]);
+}
+
+/*
+ * gradSign(k, g, high) - noiseGrad4[g][k] as the sign of each lane, for
+ * _mm_sign_epi16(). Both bytes of g are the index, so both look up the
+ * same sign, and high has bit 4 of the index at bit 7 of each byte to
+ * pick between the two 16-byte halves of the table.
+ */
+static inline __m128i gradSign(int k, __m128i g, __m128i high)
+{
+    return _mm_blendv_epi8(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)noiseGradSigns[k]), g),
+                           _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(noiseGradSigns[k] + 16)), g),
+                           high);
+}
+
+/*
+ * cornerFixed(x, y, z, w, px, py, pz, pw) - the Q17 contributions of
+ * eight simplex corners with integer coordinates (x,y,z,w), at Q15
+ * offsets (px,py,pz,pw), all in 16-bit lanes.
+ */
+static inline __m128i cornerFixed(__m128i x, __m128i y, __m128i z, __m128i w,
+                                  __m128i px, __m128i py, __m128i pz, __m128i pw)
+{
+    __m128i g = texel16(noiseGradTexels, texel16(noisePermTexels, x, y),
+                        texel16(noisePermTexels, z, w));
+    __m128i high, t, h, a, sum;
+
+    t = _mm_subs_epi16(_mm_set1_epi16(RADIUS_FIXED), _mm_mulhrs_epi16(px, px));
+    t = _mm_subs_epi16(t, _mm_mulhrs_epi16(py, py));
+    t = _mm_subs_epi16(t, _mm_mulhrs_epi16(pz, pz));
+    t = _mm_subs_epi16(t, _mm_mulhrs_epi16(pw, pw));
+    t = _mm_max_epi16(t, _mm_setzero_si128());
+    t = _mm_slli_epi16(_mm_mulhrs_epi16(t, t), 1);
+    t = _mm_mulhrs_epi16(t, t);
+
+    g = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+    high = _mm_slli_epi16(g, 3);
+    sum = h = _mm_mulhrs_epi16(t, px);
+    a = _mm_sign_epi16(h, gradSign(0, g, high));
+    sum = _mm_add_epi16(sum, h = _mm_mulhrs_epi16(t, py));
+    a = _mm_add_epi16(a, _mm_sign_epi16(h, gradSign(1, g, high)));
+    sum = _mm_add_epi16(sum, h = _mm_mulhrs_epi16(t, pz));
+    a = _mm_add_epi16(a, _mm_sign_epi16(h, gradSign(2, g, high)));
+    sum = _mm_add_epi16(sum, h = _mm_mulhrs_epi16(t, pw));
+    a = _mm_add_epi16(a, _mm_sign_epi16(h, gradSign(3, g, high)));
+    return _mm_add_epi16(a, _mm_mulhrs_epi16(_mm_add_epi16(a, sum), _mm_set1_epi16(128)));
+}
+
+/*
+ * snoise4Fixed8(x, y, z, w) - snoise4Fixed() of the eight points at x, y,
+ * z and w.
+ */
+static inline __m128i snoise4Fixed8(const int *x, const int *y, const int *z, const int *w)
+{
+    __m128i Pi0[4], Pi1[4], Pf0[4], Pf1[4], Pi[4], Pf[4], r[4], step[4], p[4];
+    __m128i d01, d02, d03, d12, d13, d23, n, s, offset;
+    int c, k;
+
+    cellFixed(_mm_loadu_si128((const __m128i*)x), _mm_loadu_si128((const __m128i*)y),
+              _mm_loadu_si128((const __m128i*)z), _mm_loadu_si128((const __m128i*)w), Pi0, Pf0);
+    cellFixed(_mm_loadu_si128((const __m128i*)(x + 4)), _mm_loadu_si128((const __m128i*)(y + 4)),
+              _mm_loadu_si128((const __m128i*)(z + 4)), _mm_loadu_si128((const __m128i*)(w + 4)),
+              Pi1, Pf1);
+    for(k = 0; k < 4; k++)
+    {
+        Pi[k] = _mm_packs_epi32(Pi0[k], Pi1[k]);
+        Pf[k] = _mm_packs_epi32(Pf0[k], Pf1[k]);
+    }
+
+    // Rank the components, from "less than" masks this time
+    d01 = _mm_cmpgt_epi16(Pf[1], Pf[0]);
+    d02 = _mm_cmpgt_epi16(Pf[2], Pf[0]);
+    d03 = _mm_cmpgt_epi16(Pf[3], Pf[0]);
+    d12 = _mm_cmpgt_epi16(Pf[2], Pf[1]);
+    d13 = _mm_cmpgt_epi16(Pf[3], Pf[1]);
+    d23 = _mm_cmpgt_epi16(Pf[3], Pf[2]);
+    r[0] = _mm_add_epi16(_mm_set1_epi16(3), _mm_add_epi16(_mm_add_epi16(d01, d02), d03));
+    r[1] = _mm_sub_epi16(_mm_add_epi16(_mm_set1_epi16(2), _mm_add_epi16(d12, d13)), d01);
+    r[2] = _mm_sub_epi16(_mm_add_epi16(_mm_set1_epi16(1), d23), _mm_add_epi16(d02, d12));
+    r[3] = _mm_sub_epi16(_mm_setzero_si128(), _mm_add_epi16(_mm_add_epi16(d03, d13), d23));
+
+    n = _mm_setzero_si128();
+    for(c = 0; c <= 4; c++)
+    {
+        // Step along every component ranked 4-c or higher
+        for(k = 0; k < 4; k++)
+        {
+            step[k] = _mm_cmpgt_epi16(r[k], _mm_set1_epi16(3 - c));
+            offset = _mm_add_epi16(_mm_set1_epi16(c * G4_Q15),
+                                   _mm_and_si128(step[k], _mm_set1_epi16(-32768)));
+            p[k] = _mm_max_epi16(_mm_adds_epi16(Pf[k], offset), _mm_set1_epi16(-32767));
+        }
+        n = _mm_add_epi16(n, cornerFixed(
+            _mm_sub_epi16(Pi[0], step[0]), _mm_sub_epi16(Pi[1], step[1]),
+            _mm_sub_epi16(Pi[2], step[2]), _mm_sub_epi16(Pi[3], step[3]),
+            p[0], p[1], p[2], p[3]));
+    }
+
+    // 27 * n, from Q17 to Q15
+    s = _mm_adds_epi16(n, n);
+    s = _mm_adds_epi16(_mm_adds_epi16(s, s), s);
+    return _mm_adds_epi16(s, _mm_mulhrs_epi16(n, _mm_set1_epi16(24576)));
+}
+
+void snoise4FixedBatchSSE41(const int *x, const int *y, const int *z,
+                            const int *w, short *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i*)(out + i), snoise4Fixed8(x + i, y + i, z + i, w + i));
+    snoise4FixedBatchScalar(x + i, y + i, z + i, w + i, out + i, count - i);
+}
@@ -0,0 +1,479 @@
+/*
+ * The tiled container of noise_tiles.h: reading it through mmap(), and
+ * writing it a band of rows at a time.
+ *
+ * The writer keeps one band of tileSize rows for each level. Level 0
+ * fills from the rows given to it; when a band is full, or the face
+ * ends, its tiles are written and it is box filtered into the next
+ * level's band, half as high, which fills after two of them, and so on
+ * down. The header, the level table and the index are only known at the
+ * end, so the tiles start at dataOffset and the writer fills in the hole
+ * before it once they are all on disk.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "noise_tiles.h"
+#include "noise_writer.h"
+
+#define TILE_BUFFERS 16 // Tiles being written at once
+
+uint16_t floatToHalf(float f)
+{
+    uint32_t x, mantissa, half, rest, halfway;
+    int exponent, shift;
+    uint16_t sign;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (uint16_t)((x >> 16) & 0x8000);
+    mantissa = x & 0x7fffff;
+    exponent = (int)((x >> 23) & 0xff);
+    if(exponent == 255)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0); // Infinity, NaN
+    exponent += 15 - 127;
+    if(exponent >= 31)
+        return sign | 0x7c00; // Too large, infinity
+    if(exponent <= 0)
+    {
+        // Denormal, or too small and zero
+        if(exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+    // To nearest, ties to even; a carry into the exponent is right too
+    if(rest > halfway || (rest == halfway && (half & 1)))
+        half++;
+    return sign | (uint16_t)half;
+}
+
+float halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff, x;
+    float f;
+
+    if(exponent == 0)
+    {
+        // Zero or denormal, mantissa * 2^-24
+        f = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    if(exponent == 31)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+
+struct NoiseTiles {
+    const unsigned char *data;
+    size_t size;
+    const NoiseTileHeader *header;
+    const NoiseTileLevel *levels;
+    const NoiseTileEntry *index;
+};
+
+NoiseTiles *openNoiseTiles(const char *filename)
+{
+    NoiseTiles *tiles;
+    const NoiseTileHeader *header;
+    const NoiseTileLevel *level;
+    struct stat status;
+    void *data;
+    uint64_t tilesInLevel;
+    unsigned l;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    if(fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(NoiseTileHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file
+    if(data == MAP_FAILED)
+        return NULL;
+
+    header = (const NoiseTileHeader*)data;
+    if(memcmp(header->magic, NOISE_TILES_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != NOISE_TILES_VERSION || header->levels < 1 ||
+       header->levels > NOISE_TILES_MAX_LEVELS || header->tileSize == 0 ||
+       header->channels == 0 || (header->faces != 1 && header->faces != 6) ||
+       (header->format != NOISE_TILE_U8 && header->format != NOISE_TILE_F16) ||
+       // A tile's bytes have to fit the 32 bits of its index entry
+       (uint64_t)header->tileSize * header->tileSize > UINT32_MAX / (2 * (uint64_t)header->channels) ||
+       header->indexOffset < sizeof(NoiseTileHeader) + header->levels * sizeof(NoiseTileLevel) ||
+       header->indexOffset % 8 != 0 ||
+       // Subtracting, as adding to a bad offset could wrap around
+       header->indexOffset > (uint64_t)status.st_size ||
+       (uint64_t)header->tileCount * sizeof(NoiseTileEntry) > (uint64_t)status.st_size - header->indexOffset)
+        goto invalid;
+    // The index is only looked at tile by tile, in noiseTile()
+    level = (const NoiseTileLevel*)(header + 1);
+    for(l = 0; l < header->levels; l++)
+    {
+        tilesInLevel = (uint64_t)level[l].tilesX * level[l].tilesY;
+        if((uint64_t)level[l].tilesX * header->tileSize < level[l].width ||
+           (uint64_t)level[l].tilesY * header->tileSize < level[l].height ||
+           tilesInLevel > header->tileCount || level[l].firstTile > header->tileCount ||
+           header->faces * tilesInLevel > header->tileCount - level[l].firstTile)
+            goto invalid;
+    }
+
+    tiles = (NoiseTiles*)malloc(sizeof(NoiseTiles));
+    if(tiles == NULL)
+        goto invalid;
+    tiles->data = (const unsigned char*)data;
+    tiles->size = (size_t)status.st_size;
+    tiles->header = header;
+    tiles->levels = level;
+    tiles->index = (const NoiseTileEntry*)(tiles->data + header->indexOffset);
+    return tiles;
+
+invalid:
+    munmap(data, (size_t)status.st_size);
+    return NULL;
+}
+
+void closeNoiseTiles(NoiseTiles *tiles)
+{
+    munmap((void*)tiles->data, tiles->size);
+    free(tiles);
+}
+
+const NoiseTileHeader *noiseTilesHeader(const NoiseTiles *tiles)
+{
+    return tiles->header;
+}
+
+const NoiseTileLevel *noiseTilesLevel(const NoiseTiles *tiles, int level)
+{
+    if(level < 0 || level >= (int)tiles->header->levels)
+        return NULL;
+    return &tiles->levels[level];
+}
+
+const void *noiseTile(const NoiseTiles *tiles, int level, int face, int tx, int ty)
+{
+    const NoiseTileLevel *l = noiseTilesLevel(tiles, level);
+    const NoiseTileEntry *entry;
+    uint64_t tileBytes;
+
+    if(l == NULL || face < 0 || face >= (int)tiles->header->faces ||
+       tx < 0 || tx >= (int)l->tilesX || ty < 0 || ty >= (int)l->tilesY)
+        return NULL;
+    entry = &tiles->index[l->firstTile + ((uint64_t)face * l->tilesY + ty) * l->tilesX + tx];
+    tileBytes = (uint64_t)tiles->header->tileSize * tiles->header->tileSize *
+                tiles->header->channels * (tiles->header->format == NOISE_TILE_F16 ? 2 : 1);
+    if(entry->bytes != tileBytes || entry->offset > tiles->size ||
+       entry->bytes > tiles->size - entry->offset)
+        return NULL; // Never written, or cut short
+    return tiles->data + entry->offset;
+}
+
+
+/* A level's band of rows, and where it is up to */
+typedef struct {
+    unsigned char *band;
+    int rows; // In the band
+    int done; // Rows of the face before the band
+    int face;
+} MipBand;
+
+struct NoiseTileWriter {
+    char *filename;
+    NoiseTileHeader header;
+    NoiseTileLevel levels[NOISE_TILES_MAX_LEVELS];
+    NoiseTileEntry *index;
+    MipBand bands[NOISE_TILES_MAX_LEVELS];
+    NoiseWriter *writer;
+    int nextBuffer;
+    size_t pixelBytes, tileBytes;
+    long long offset; // Of the next tile
+    int failed;
+};
+
+/*
+ * writeTiles(writer, l) - write the tiles of a level's band, copying out
+ * its pixels and repeating the last row and column past the image edge.
+ */
+static void writeTiles(NoiseTileWriter *writer, int l)
+{
+    const NoiseTileLevel *level = &writer->levels[l];
+    MipBand *band = &writer->bands[l];
+    int size = (int)writer->header.tileSize, ty = band->done / size;
+    int tx, y, x, columns, buffer;
+    size_t pixel = writer->pixelBytes;
+    const unsigned char *from;
+    unsigned char *to;
+    uint32_t tile;
+
+    for(tx = 0; tx < (int)level->tilesX; tx++)
+    {
+        buffer = writer->nextBuffer;
+        writer->nextBuffer = (buffer + 1) % TILE_BUFFERS;
+        if(!waitNoiseBuffer(writer->writer, buffer))
+        {
+            writer->failed = 1;
+            return;
+        }
+        to = noiseWriterData(writer->writer, buffer, writer->offset);
+        columns = (int)level->width - tx*size;
+        if(columns > size)
+            columns = size;
+        for(y = 0; y < size; y++, to += size*pixel)
+        {
+            from = band->band + ((size_t)(y < band->rows ? y : band->rows - 1) * level->width
+                                 + (size_t)tx*size) * pixel;
+            memcpy(to, from, columns*pixel);
+            for(x = columns; x < size; x++)
+                memcpy(to + x*pixel, from + (columns - 1)*pixel, pixel);
+        }
+        if(!writeNoiseBuffer(writer->writer, buffer, writer->offset, writer->tileBytes))
+        {
+            writer->failed = 1;
+            return;
+        }
+        tile = level->firstTile + ((uint32_t)band->face * level->tilesY + ty) * level->tilesX + tx;
+        writer->index[tile].offset = (uint64_t)writer->offset;
+        writer->index[tile].bytes = (uint32_t)writer->tileBytes;
+        writer->offset += (long long)writer->tileBytes;
+    }
+}
+
+/*
+ * averagePixels(writer, a, b, c, d, out) - the 2x2 box filter.
+ */
+static void averagePixels(const NoiseTileWriter *writer, const unsigned char *a,
+                          const unsigned char *b, const unsigned char *c,
+                          const unsigned char *d, unsigned char *out)
+{
+    const uint16_t *ha = (const uint16_t*)a, *hb = (const uint16_t*)b;
+    const uint16_t *hc = (const uint16_t*)c, *hd = (const uint16_t*)d;
+    uint16_t *hout = (uint16_t*)out;
+    unsigned k;
+
+    if(writer->header.format == NOISE_TILE_U8)
+        for(k = 0; k < writer->header.channels; k++)
+            out[k] = (unsigned char)((a[k] + b[k] + c[k] + d[k] + 2) >> 2);
+    else
+        for(k = 0; k < writer->header.channels; k++)
+            hout[k] = floatToHalf((halfToFloat(ha[k]) + halfToFloat(hb[k]) +
+                                   halfToFloat(hc[k]) + halfToFloat(hd[k])) * 0.25f);
+}
+
+/*
+ * flushBand(writer, l) - write out a full band of a level, or the last
+ * one of a face, filter it into the next level, and start a new one.
+ */
+static void flushBand(NoiseTileWriter *writer, int l)
+{
+    const NoiseTileLevel *level = &writer->levels[l], *next = level + 1;
+    MipBand *band = &writer->bands[l], *down = band + 1;
+    int first, last, y, x, y0, y1, x0, x1;
+    size_t pixel = writer->pixelBytes;
+    const unsigned char *row0, *row1;
+    unsigned char *out;
+
+    writeTiles(writer, l);
+    if(l + 1 < (int)writer->header.levels)
+    {
+        // The rows of the next level that this band covers
+        first = band->done / 2;
+        last = band->done + band->rows == (int)level->height ?
+               (int)next->height : (band->done + band->rows) / 2;
+        for(y = first; y < last; y++)
+        {
+            y0 = 2*y - band->done;
+            y1 = y0 + 1 < band->rows ? y0 + 1 : band->rows - 1;
+            row0 = band->band + (size_t)y0 * level->width * pixel;
+            row1 = band->band + (size_t)y1 * level->width * pixel;
+            out = down->band + (size_t)down->rows * next->width * pixel;
+            for(x = 0; x < (int)next->width; x++, out += pixel)
+            {
+                x0 = 2*x;
+                x1 = x0 + 1 < (int)level->width ? x0 + 1 : x0;
+                averagePixels(writer, row0 + x0*pixel, row0 + x1*pixel,
+                              row1 + x0*pixel, row1 + x1*pixel, out);
+            }
+            down->rows++;
+        }
+    }
+
+    band->done += band->rows;
+    band->rows = 0;
+    if(band->done == (int)level->height)
+    {
+        band->done = 0;
+        band->face++;
+    }
+    if(l + 1 < (int)writer->header.levels &&
+       (down->rows == (int)writer->header.tileSize ||
+        down->done + down->rows == (int)next->height))
+        flushBand(writer, l + 1);
+}
+
+NoiseTileWriter *createNoiseTileWriter(const char *filename, int width, int height,
+                                       int faces, int tileSize, int channels,
+                                       int format, int levels, int backend,
+                                       int direct)
+{
+    NoiseTileWriter *writer;
+    NoiseTileLevel *level;
+    uint32_t tiles = 0;
+    int l, w, h;
+
+    if(width < 1 || height < 1 || (faces != 1 && faces != 6) || channels < 1 || levels < 0 ||
+       levels > NOISE_TILES_MAX_LEVELS || tileSize < 64 || (tileSize & (tileSize - 1)) ||
+       (format != NOISE_TILE_U8 && format != NOISE_TILE_F16))
+        return NULL;
+    if(levels == 0)
+    {
+        // Down to the first level in one tile
+        for(levels = 1, w = width, h = height; (w > tileSize || h > tileSize) &&
+            levels < NOISE_TILES_MAX_LEVELS; levels++)
+        {
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+
+    writer = (NoiseTileWriter*)calloc(1, sizeof(NoiseTileWriter));
+    if(writer == NULL)
+        return NULL;
+    memcpy(writer->header.magic, NOISE_TILES_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = NOISE_TILES_VERSION;
+    writer->header.width = (uint32_t)width;
+    writer->header.height = (uint32_t)height;
+    writer->header.faces = (uint32_t)faces;
+    writer->header.tileSize = (uint32_t)tileSize;
+    writer->header.channels = (uint32_t)channels;
+    writer->header.format = (uint32_t)format;
+    writer->header.levels = (uint32_t)levels;
+    writer->pixelBytes = (size_t)channels * (format == NOISE_TILE_F16 ? 2 : 1);
+    writer->tileBytes = (size_t)tileSize * tileSize * writer->pixelBytes;
+
+    for(l = 0, w = width, h = height; l < levels; l++)
+    {
+        level = &writer->levels[l];
+        level->width = (uint32_t)w;
+        level->height = (uint32_t)h;
+        level->tilesX = (uint32_t)((w + tileSize - 1) / tileSize);
+        level->tilesY = (uint32_t)((h + tileSize - 1) / tileSize);
+        level->firstTile = tiles;
+        tiles += (uint32_t)faces * level->tilesX * level->tilesY;
+        writer->bands[l].band = (unsigned char*)malloc((size_t)w * tileSize * writer->pixelBytes);
+        if(writer->bands[l].band == NULL)
+            writer->failed = 1;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    writer->header.tileCount = tiles;
+    writer->header.indexOffset = sizeof(NoiseTileHeader) + levels * sizeof(NoiseTileLevel);
+    writer->header.dataOffset = (writer->header.indexOffset + tiles * sizeof(NoiseTileEntry)
+                                 + NOISE_WRITER_ALIGN - 1) & ~(uint64_t)(NOISE_WRITER_ALIGN - 1);
+    writer->offset = (long long)writer->header.dataOffset;
+
+    writer->filename = strdup(filename);
+    writer->index = (NoiseTileEntry*)calloc(tiles, sizeof(NoiseTileEntry));
+    writer->writer = createNoiseWriter(TILE_BUFFERS, writer->tileBytes, backend, direct);
+    if(writer->failed || writer->filename == NULL || writer->index == NULL ||
+       writer->writer == NULL || !openNoiseFile(writer->writer, filename, "", 0))
+    {
+        writer->failed = 1;
+        finishNoiseTiles(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int addNoiseTileRows(NoiseTileWriter *writer, const void *rows, int count)
+{
+    const NoiseTileLevel *level = &writer->levels[0];
+    MipBand *band = &writer->bands[0];
+    const unsigned char *from = (const unsigned char*)rows;
+    size_t rowBytes = level->width * writer->pixelBytes;
+    int size = (int)writer->header.tileSize, take;
+
+    while(count > 0 && !writer->failed)
+    {
+        if(band->face >= (int)writer->header.faces)
+        {
+            writer->failed = 1; // More rows than the faces have
+            break;
+        }
+        take = size - band->rows;
+        if(take > (int)level->height - band->done - band->rows)
+            take = (int)level->height - band->done - band->rows;
+        if(take > count)
+            take = count;
+        memcpy(band->band + band->rows * rowBytes, from, take * rowBytes);
+        band->rows += take;
+        from += take * rowBytes;
+        count -= take;
+        if(band->rows == size || band->done + band->rows == (int)level->height)
+            flushBand(writer, 0);
+    }
+    return !writer->failed;
+}
+
+const char *noiseTileWriterBackend(const NoiseTileWriter *writer)
+{
+    return noiseWriterBackend(writer->writer);
+}
+
+int finishNoiseTiles(NoiseTileWriter *writer)
+{
+    int ok = !writer->failed && writer->bands[0].face == (int)writer->header.faces;
+    int l, fd;
+
+    if(writer->writer)
+    {
+        ok = closeNoiseFile(writer->writer) && ok;
+        destroyNoiseWriter(writer->writer);
+    }
+    if(ok)
+    {
+        // The tiles are all down, fill in the start
+        fd = open(writer->filename, O_WRONLY);
+        ok = fd >= 0 &&
+             pwrite(fd, &writer->header, sizeof(NoiseTileHeader), 0) == sizeof(NoiseTileHeader) &&
+             pwrite(fd, writer->levels, writer->header.levels * sizeof(NoiseTileLevel),
+                    sizeof(NoiseTileHeader)) == (ssize_t)(writer->header.levels * sizeof(NoiseTileLevel)) &&
+             pwrite(fd, writer->index, writer->header.tileCount * sizeof(NoiseTileEntry),
+                    (off_t)writer->header.indexOffset) ==
+                 (ssize_t)(writer->header.tileCount * sizeof(NoiseTileEntry));
+        if(fd >= 0 && close(fd) != 0)
+            ok = 0;
+    }
+
+    for(l = 0; l < NOISE_TILES_MAX_LEVELS; l++)
+        free(writer->bands[l].band);
+    free(writer->index);
+    free(writer->filename);
+    free(writer);
+    return ok;
+}
@@ -0,0 +1,144 @@
+/*
+ * A tiled container for baked planet surfaces, made to be mmap()ed.
+ *
+ * The file holds an equirectangular map, or the six faces of a cubemap,
+ * and its mip levels, each cut into square tiles of 8-bit or float16
+ * channels:
+ *
+ *     NoiseTileHeader                  at 0
+ *     NoiseTileLevel[levels]           right after it
+ *     NoiseTileEntry[tileCount]        at indexOffset, right after those
+ *     tile data                        from dataOffset, a multiple of 4096
+ *
+ * Every field is little-endian. Every tile is tileSize x tileSize pixels,
+ * rows top to bottom, the channels of a pixel together; along the right
+ * and bottom of a level, where the image ends inside a tile, its edge
+ * pixels are repeated to fill it. Tile t of level l, face f is number
+ * levels[l].firstTile + (f*tilesY + ty)*tilesX + tx in the index, which
+ * gives where its data is. The tiles are in the order they were made,
+ * not in index order, and tileSize is a power of two of 64 or more, so
+ * each tile starts on a page boundary and can be used straight out of
+ * the mapping.
+ *
+ * Level 0 is the full size, and each level after it half the one before,
+ * rounded down but at least 1, each pixel the average of the 2x2 below.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef NOISE_TILES_H
+#define NOISE_TILES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOISE_TILES_MAGIC "NOISETIL"
+#define NOISE_TILES_VERSION 1
+#define NOISE_TILES_MAX_LEVELS 32
+
+/* Channel formats */
+#define NOISE_TILE_U8 0  // 0 to 255 for 0.0 to 1.0
+#define NOISE_TILE_F16 1 // IEEE half precision
+
+typedef struct {
+    char magic[8];          // NOISE_TILES_MAGIC, without a terminating 0
+    uint32_t version;       // NOISE_TILES_VERSION
+    uint32_t width, height; // Of level 0
+    uint32_t faces;         // 1 for a map, 6 for a cubemap, in the GL order
+    uint32_t tileSize;
+    uint32_t channels;
+    uint32_t format;        // NOISE_TILE_U8 or NOISE_TILE_F16
+    uint32_t levels;
+    uint32_t tileCount;     // Over all levels and faces
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t dataOffset;
+} NoiseTileHeader;
+
+typedef struct {
+    uint32_t width, height;
+    uint32_t tilesX, tilesY;
+    uint32_t firstTile;
+    uint32_t reserved;
+} NoiseTileLevel;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t reserved;
+} NoiseTileEntry;
+
+/* floatToHalf(f), halfToFloat(h) - IEEE half precision, rounded to nearest even */
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+
+/*
+ * Reading: the whole file is mapped, and the header, levels, index and
+ * tiles are pointers into the mapping, valid until closeNoiseTiles().
+ */
+typedef struct NoiseTiles NoiseTiles;
+
+/*
+ * openNoiseTiles(filename) - map a file, and check that its header,
+ * levels and index are consistent and inside it. Returns NULL if not.
+ */
+NoiseTiles *openNoiseTiles(const char *filename);
+
+/* closeNoiseTiles(tiles) - unmap the file */
+void closeNoiseTiles(NoiseTiles *tiles);
+
+const NoiseTileHeader *noiseTilesHeader(const NoiseTiles *tiles);
+const NoiseTileLevel *noiseTilesLevel(const NoiseTiles *tiles, int level);
+
+/*
+ * noiseTile(tiles, level, face, tx, ty) - the data of a tile, or NULL if
+ * there is no such tile.
+ */
+const void *noiseTile(const NoiseTiles *tiles, int level, int face, int tx, int ty);
+
+/*
+ * Writing: rows of level 0 go in top to bottom, one face after another,
+ * and the mip levels are made from them as they come, so only a band of
+ * tileSize rows of each level is ever held. The tiles are written through
+ * a NoiseWriter (see noise_writer.h), in the background.
+ */
+typedef struct NoiseTileWriter NoiseTileWriter;
+
+/*
+ * createNoiseTileWriter(filename, width, height, faces, tileSize,
+ * channels, format, levels, backend, direct) - start a file. levels 0
+ * goes down to the first level that fits in one tile. backend and
+ * direct are as for createNoiseWriter(). Returns NULL if faces isn't 1
+ * or 6, tileSize isn't a power of two from 64 up, or the file can't be
+ * created.
+ */
+NoiseTileWriter *createNoiseTileWriter(const char *filename, int width, int height,
+                                       int faces, int tileSize, int channels,
+                                       int format, int levels, int backend,
+                                       int direct);
+
+/*
+ * addNoiseTileRows(writer, rows, count) - add count rows of level 0, of
+ * width pixels each in the file's format, packed. Returns 0 if a write
+ * has failed.
+ */
+int addNoiseTileRows(NoiseTileWriter *writer, const void *rows, int count);
+
+/* noiseTileWriterBackend(writer) - noiseWriterBackend() of its writer */
+const char *noiseTileWriterBackend(const NoiseTileWriter *writer);
+
+/*
+ * finishNoiseTiles(writer) - wait for the tiles to be written, then write
+ * the header, levels and index, and free the writer. Returns 0 if the
+ * file is incomplete or anything failed.
+ */
+int finishNoiseTiles(NoiseTileWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOISE_TILES_H */
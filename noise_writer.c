@@ -0,0 +1,608 @@
+/*
+ * The asynchronous file writer of noise_writer.h.
+ *
+ * io_uring is driven with the raw system calls rather than liburing, which
+ * isn't installed everywhere: one submission for each buffer written, or
+ * for what is left of it after a short write, and the completions reaped
+ * whenever the caller waits for a buffer. The buffers, and the block
+ * that holds the unaligned end of the file so far, are registered once
+ * and written with IORING_OP_WRITE_FIXED, which saves the kernel mapping
+ * them for every write; if the kernel won't register that much locked
+ * memory, plain IORING_OP_WRITE does the same job.
+ *
+ * Without io_uring, WRITER_THREADS threads take the buffers off a queue
+ * and pwrite() them.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#include "noise_writer.h"
+
+#define WRITER_THREADS 4
+
+typedef struct {
+    unsigned char *memory; // NOISE_WRITER_ALIGN aligned
+    long long offset;      // Where memory[0] goes in the file
+    size_t length, done;   // Bytes to write, and written so far
+    int busy;
+} WriteBuffer;
+
+struct NoiseWriter {
+    int backend;
+    int direct;     // Open files with O_DIRECT if possible
+    int registered; // io_uring has the buffers
+    const char *name;
+    char description[64]; // The name, and whether the file has O_DIRECT
+
+    // buffers[numBuffers] is the block that the ends are carried in
+    WriteBuffer *buffers;
+    int numBuffers;
+    size_t capacity;
+    size_t carryBytes;
+
+    int fd;
+    long long end; // Of the file so far
+    int failed;
+    double waited;
+
+#ifdef __linux__
+    // io_uring
+    int ring;
+    void *sqRing, *cqRing;
+    size_t sqRingBytes, cqRingBytes, sqesBytes;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+#endif
+
+    // pwrite() threads
+    pthread_t threads[WRITER_THREADS];
+    int numThreads;
+    pthread_mutex_t lock;
+    pthread_cond_t queued, completed;
+    int *queue;
+    int queueHead, queueCount;
+    int quit;
+};
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+#ifdef __linux__
+
+/*
+ * closeUring(writer) - unmap the ring and close it, which unregisters
+ * the buffers too.
+ */
+static void closeUring(NoiseWriter *writer)
+{
+    if(writer->sqes && writer->sqes != MAP_FAILED)
+        munmap(writer->sqes, writer->sqesBytes);
+    if(writer->cqRing && writer->cqRing != MAP_FAILED && writer->cqRing != writer->sqRing)
+        munmap(writer->cqRing, writer->cqRingBytes);
+    if(writer->sqRing && writer->sqRing != MAP_FAILED)
+        munmap(writer->sqRing, writer->sqRingBytes);
+    if(writer->ring >= 0)
+        close(writer->ring);
+    writer->sqes = NULL;
+    writer->sqRing = writer->cqRing = NULL;
+    writer->ring = -1;
+    writer->registered = 0;
+}
+
+/*
+ * setupUring(writer) - create the ring, with room to submit every buffer
+ * at once, map it, and register the buffers. Returns 0 if the kernel
+ * has no io_uring, or won't let us have one.
+ */
+static int setupUring(NoiseWriter *writer)
+{
+    struct io_uring_params params;
+    struct iovec *iov;
+    unsigned char *sq;
+    int i;
+
+    memset(&params, 0, sizeof(params));
+    writer->ring = (int)syscall(__NR_io_uring_setup, writer->numBuffers + 1, &params);
+    if(writer->ring < 0)
+        return 0;
+
+    writer->sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    writer->cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        // One mapping holds both rings
+        if(writer->cqRingBytes > writer->sqRingBytes)
+            writer->sqRingBytes = writer->cqRingBytes;
+        writer->cqRingBytes = 0;
+    }
+    writer->sqRing = mmap(NULL, writer->sqRingBytes, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, writer->ring, IORING_OFF_SQ_RING);
+    if(writer->sqRing == MAP_FAILED)
+        goto failed;
+    if(writer->cqRingBytes == 0)
+        writer->cqRing = writer->sqRing;
+    else
+    {
+        writer->cqRing = mmap(NULL, writer->cqRingBytes, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, writer->ring, IORING_OFF_CQ_RING);
+        if(writer->cqRing == MAP_FAILED)
+            goto failed;
+    }
+    writer->sqesBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+    writer->sqes = (struct io_uring_sqe*)mmap(NULL, writer->sqesBytes,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       writer->ring, IORING_OFF_SQES);
+    if(writer->sqes == MAP_FAILED)
+        goto failed;
+
+    sq = (unsigned char*)writer->sqRing;
+    writer->sqHead = (unsigned*)(sq + params.sq_off.head);
+    writer->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    writer->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    writer->sqArray = (unsigned*)(sq + params.sq_off.array);
+    writer->cqHead = (unsigned*)((unsigned char*)writer->cqRing + params.cq_off.head);
+    writer->cqTail = (unsigned*)((unsigned char*)writer->cqRing + params.cq_off.tail);
+    writer->cqMask = (unsigned*)((unsigned char*)writer->cqRing + params.cq_off.ring_mask);
+    writer->cqes = (struct io_uring_cqe*)((unsigned char*)writer->cqRing + params.cq_off.cqes);
+
+    iov = (struct iovec*)malloc((writer->numBuffers + 1) * sizeof(struct iovec));
+    if(iov == NULL)
+        goto failed;
+    for(i = 0; i <= writer->numBuffers; i++)
+    {
+        iov[i].iov_base = writer->buffers[i].memory;
+        iov[i].iov_len = i < writer->numBuffers ? writer->capacity : NOISE_WRITER_ALIGN;
+    }
+    writer->registered = syscall(__NR_io_uring_register, writer->ring,
+                                 IORING_REGISTER_BUFFERS, iov, writer->numBuffers + 1) == 0;
+    free(iov);
+    return 1;
+
+failed:
+    closeUring(writer);
+    return 0;
+}
+
+/*
+ * submitUring(writer, index) - queue the rest of a buffer's write.
+ */
+static int submitUring(NoiseWriter *writer, int index)
+{
+    WriteBuffer *buffer = &writer->buffers[index];
+    unsigned tail = *writer->sqTail, slot = tail & *writer->sqMask;
+    struct io_uring_sqe *sqe = &writer->sqes[slot];
+    int result;
+
+    // There are as many entries as buffers, so there is always room
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = writer->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = writer->fd;
+    sqe->off = (unsigned long long)(buffer->offset + buffer->done);
+    sqe->addr = (unsigned long long)(unsigned long)(buffer->memory + buffer->done);
+    sqe->len = (unsigned)(buffer->length - buffer->done);
+    sqe->buf_index = (unsigned short)index;
+    sqe->user_data = (unsigned long long)index;
+    writer->sqArray[slot] = slot;
+    __atomic_store_n(writer->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    do
+        result = (int)syscall(__NR_io_uring_enter, writer->ring, 1, 0, 0, NULL, 0);
+    while(result < 0 && errno == EINTR);
+    return result == 1;
+}
+
+/*
+ * reapUring(writer) - wait for at least one write to complete, and deal
+ * with all that have: free the buffer, or write the rest of it.
+ */
+static void reapUring(NoiseWriter *writer)
+{
+    WriteBuffer *buffer;
+    struct io_uring_cqe *cqe;
+    unsigned head, tail;
+    int index;
+
+    if(syscall(__NR_io_uring_enter, writer->ring, 0, 1, IORING_ENTER_GETEVENTS,
+               NULL, 0) < 0 && errno != EINTR)
+    {
+        // Nothing more will complete, give up on all of them
+        writer->failed = 1;
+        for(index = 0; index <= writer->numBuffers; index++)
+            writer->buffers[index].busy = 0;
+        return;
+    }
+    head = *writer->cqHead;
+    tail = __atomic_load_n(writer->cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++)
+    {
+        cqe = &writer->cqes[head & *writer->cqMask];
+        index = (int)cqe->user_data;
+        buffer = &writer->buffers[index];
+        if(cqe->res == -EINTR || cqe->res == -EAGAIN)
+        {
+            if(submitUring(writer, index))
+                continue;
+        }
+        else if(cqe->res > 0)
+        {
+            buffer->done += (size_t)cqe->res;
+            if(buffer->done == buffer->length || submitUring(writer, index))
+            {
+                buffer->busy = buffer->done < buffer->length;
+                continue;
+            }
+        }
+        // An error, or a write of nothing
+        writer->failed = 1;
+        buffer->busy = 0;
+    }
+    __atomic_store_n(writer->cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif /* __linux__ */
+
+/*
+ * writeThread(arg) - a pwrite() thread: write the queued buffers, one at
+ * a time, until the writer is destroyed.
+ */
+static void *writeThread(void *arg)
+{
+    NoiseWriter *writer = (NoiseWriter*)arg;
+    WriteBuffer *buffer;
+    ssize_t result;
+    int index, failed;
+
+    pthread_mutex_lock(&writer->lock);
+    for(;;)
+    {
+        while(writer->queueCount == 0 && !writer->quit)
+            pthread_cond_wait(&writer->queued, &writer->lock);
+        if(writer->queueCount == 0)
+            break;
+        index = writer->queue[writer->queueHead];
+        writer->queueHead = (writer->queueHead + 1) % (writer->numBuffers + 1);
+        writer->queueCount--;
+        pthread_mutex_unlock(&writer->lock);
+
+        buffer = &writer->buffers[index];
+        failed = 0;
+        while(buffer->done < buffer->length)
+        {
+            result = pwrite(writer->fd, buffer->memory + buffer->done,
+                            buffer->length - buffer->done, buffer->offset + buffer->done);
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0)
+            {
+                failed = 1;
+                break;
+            }
+            buffer->done += (size_t)result;
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        if(failed)
+            writer->failed = 1;
+        buffer->busy = 0;
+        pthread_cond_broadcast(&writer->completed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/*
+ * hasFailed(writer) - whether any write has failed so far.
+ */
+static int hasFailed(NoiseWriter *writer)
+{
+    int failed;
+
+    if(writer->backend == NOISE_WRITER_URING)
+        return writer->failed;
+    pthread_mutex_lock(&writer->lock);
+    failed = writer->failed;
+    pthread_mutex_unlock(&writer->lock);
+    return failed;
+}
+
+/*
+ * startWrite(writer, index, offset, length) - write length bytes from the
+ * start of a buffer to offset, in the background.
+ */
+static int startWrite(NoiseWriter *writer, int index, long long offset, size_t length)
+{
+    WriteBuffer *buffer = &writer->buffers[index];
+
+    buffer->offset = offset;
+    buffer->length = length;
+    buffer->done = 0;
+#ifdef __linux__
+    if(writer->backend == NOISE_WRITER_URING)
+    {
+        buffer->busy = 1;
+        if(!submitUring(writer, index))
+        {
+            buffer->busy = 0;
+            writer->failed = 1;
+        }
+        return !writer->failed;
+    }
+#endif
+    pthread_mutex_lock(&writer->lock);
+    buffer->busy = 1;
+    writer->queue[(writer->queueHead + writer->queueCount) % (writer->numBuffers + 1)] = index;
+    writer->queueCount++;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    return !hasFailed(writer);
+}
+
+/*
+ * waitBuffer(writer, index) - wait for a buffer's write to finish.
+ */
+static void waitBuffer(NoiseWriter *writer, int index)
+{
+    WriteBuffer *buffer = &writer->buffers[index];
+    double start;
+
+#ifdef __linux__
+    if(writer->backend == NOISE_WRITER_URING)
+    {
+        if(!buffer->busy)
+            return;
+        start = now();
+        while(buffer->busy)
+            reapUring(writer);
+        writer->waited += now() - start;
+        return;
+    }
+#endif
+    pthread_mutex_lock(&writer->lock);
+    if(buffer->busy)
+    {
+        start = now();
+        while(buffer->busy)
+            pthread_cond_wait(&writer->completed, &writer->lock);
+        writer->waited += now() - start;
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+NoiseWriter *createNoiseWriter(int buffers, size_t bytes, int backend, int direct)
+{
+    NoiseWriter *writer;
+    int i;
+
+    if(buffers < 1)
+        return NULL;
+    writer = (NoiseWriter*)calloc(1, sizeof(NoiseWriter));
+    if(writer == NULL)
+        return NULL;
+    writer->fd = -1;
+#ifdef __linux__
+    writer->ring = -1;
+#endif
+    writer->direct = direct;
+    writer->numBuffers = buffers;
+    // Room for the carried start, and for rounding the end up
+    writer->capacity = (bytes + 3*NOISE_WRITER_ALIGN - 1) & ~(size_t)(NOISE_WRITER_ALIGN - 1);
+    writer->buffers = (WriteBuffer*)calloc(buffers + 1, sizeof(WriteBuffer));
+    writer->queue = (int*)malloc((buffers + 1) * sizeof(int));
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued, NULL);
+    pthread_cond_init(&writer->completed, NULL);
+    if(writer->buffers == NULL || writer->queue == NULL)
+    {
+        destroyNoiseWriter(writer);
+        return NULL;
+    }
+    for(i = 0; i <= buffers; i++)
+    {
+        writer->buffers[i].memory = (unsigned char*)aligned_alloc(NOISE_WRITER_ALIGN,
+            i < buffers ? writer->capacity : NOISE_WRITER_ALIGN);
+        if(writer->buffers[i].memory == NULL)
+        {
+            destroyNoiseWriter(writer);
+            return NULL;
+        }
+    }
+
+#ifdef __linux__
+    if(backend != NOISE_WRITER_THREADS)
+    {
+        if(setupUring(writer))
+            writer->backend = NOISE_WRITER_URING;
+        else if(backend == NOISE_WRITER_URING)
+        {
+            destroyNoiseWriter(writer);
+            return NULL;
+        }
+    }
+#else
+    if(backend == NOISE_WRITER_URING)
+    {
+        destroyNoiseWriter(writer);
+        return NULL;
+    }
+#endif
+    if(writer->backend != NOISE_WRITER_URING)
+    {
+        writer->backend = NOISE_WRITER_THREADS;
+        for(i = 0; i < WRITER_THREADS; i++)
+        {
+            if(pthread_create(&writer->threads[i], NULL, writeThread, writer) != 0)
+                break;
+            writer->numThreads++;
+        }
+        if(writer->numThreads == 0)
+        {
+            destroyNoiseWriter(writer);
+            return NULL;
+        }
+    }
+    writer->name = writer->backend == NOISE_WRITER_THREADS ? "pwrite threads" :
+                   writer->registered ? "io_uring" : "io_uring, unregistered";
+    snprintf(writer->description, sizeof(writer->description), "%s", writer->name);
+    return writer;
+}
+
+void destroyNoiseWriter(NoiseWriter *writer)
+{
+    int i;
+
+    if(writer->fd >= 0)
+        closeNoiseFile(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->quit = 1;
+    pthread_cond_broadcast(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    for(i = 0; i < writer->numThreads; i++)
+        pthread_join(writer->threads[i], NULL);
+
+#ifdef __linux__
+    closeUring(writer);
+#endif
+
+    if(writer->buffers)
+        for(i = 0; i <= writer->numBuffers; i++)
+            free(writer->buffers[i].memory);
+    free(writer->buffers);
+    free(writer->queue);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queued);
+    pthread_cond_destroy(&writer->completed);
+    free(writer);
+}
+
+const char *noiseWriterBackend(const NoiseWriter *writer)
+{
+    return writer->description;
+}
+
+int openNoiseFile(NoiseWriter *writer, const char *filename,
+                  const void *header, size_t headerBytes)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC, direct = 0;
+
+    if(writer->fd >= 0 || headerBytes >= NOISE_WRITER_ALIGN)
+        return 0;
+    writer->fd = -1;
+#ifdef O_DIRECT
+    // Not every file system has it, tmpfs for one
+    if(writer->direct)
+        writer->fd = open(filename, flags | O_DIRECT, 0666);
+#endif
+    if(writer->fd < 0)
+        writer->fd = open(filename, flags, 0666);
+    if(writer->fd < 0)
+        return 0;
+
+#ifdef O_DIRECT
+    direct = (fcntl(writer->fd, F_GETFL) & O_DIRECT) != 0;
+#endif
+    snprintf(writer->description, sizeof(writer->description), "%s%s",
+             writer->name, direct ? ", O_DIRECT" : "");
+
+    memcpy(writer->buffers[writer->numBuffers].memory, header, headerBytes);
+    writer->carryBytes = headerBytes;
+    writer->end = (long long)headerBytes;
+    writer->failed = 0;
+    return 1;
+}
+
+unsigned char *noiseWriterData(NoiseWriter *writer, int buffer, long long offset)
+{
+    return writer->buffers[buffer].memory + (offset & (NOISE_WRITER_ALIGN - 1));
+}
+
+int writeNoiseBuffer(NoiseWriter *writer, int buffer, long long offset, size_t bytes)
+{
+    unsigned char *memory = writer->buffers[buffer].memory;
+    unsigned char *carry = writer->buffers[writer->numBuffers].memory;
+    size_t total, aligned;
+
+    if(writer->fd < 0 || offset < writer->end)
+        return 0;
+    if(offset > writer->end)
+    {
+        // Skipping a hole, from one block to a later one
+        if(writer->carryBytes > 0 || (offset & (NOISE_WRITER_ALIGN - 1)))
+            return 0;
+        writer->end = offset;
+    }
+    // Start with the end of the file so far, which is still to be written
+    memcpy(memory, carry, writer->carryBytes);
+    total = writer->carryBytes + bytes;
+    aligned = total & ~(size_t)(NOISE_WRITER_ALIGN - 1);
+    writer->carryBytes = total - aligned;
+    memcpy(carry, memory + aligned, writer->carryBytes);
+    writer->end = offset + (long long)bytes;
+    if(aligned == 0)
+        return !hasFailed(writer);
+    return startWrite(writer, buffer, writer->end - (long long)total, aligned);
+}
+
+int waitNoiseBuffer(NoiseWriter *writer, int buffer)
+{
+    waitBuffer(writer, buffer);
+    return !hasFailed(writer);
+}
+
+int closeNoiseFile(NoiseWriter *writer)
+{
+    unsigned char *carry = writer->buffers[writer->numBuffers].memory;
+    int i, ok;
+
+    if(writer->fd < 0)
+        return 0;
+    if(writer->carryBytes > 0)
+    {
+        // A whole block for O_DIRECT, and cut back to size below
+        memset(carry + writer->carryBytes, 0, NOISE_WRITER_ALIGN - writer->carryBytes);
+        startWrite(writer, writer->numBuffers,
+                   writer->end - (long long)writer->carryBytes, NOISE_WRITER_ALIGN);
+    }
+    for(i = 0; i <= writer->numBuffers; i++)
+        waitBuffer(writer, i);
+    writer->carryBytes = 0;
+
+    ok = !hasFailed(writer) && ftruncate(writer->fd, writer->end) == 0;
+    ok = close(writer->fd) == 0 && ok;
+    writer->fd = -1;
+    return ok;
+}
+
+double noiseWriterWaited(const NoiseWriter *writer)
+{
+    return writer->waited;
+}
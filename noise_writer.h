@@ -0,0 +1,108 @@
+/*
+ * Asynchronous file output for generated noise images.
+ *
+ * The writer owns a set of buffers. The caller fills one, queues it to be
+ * written at some offset of the file, and goes on generating into the
+ * others; waitNoiseBuffer() hands a buffer back once its write is done.
+ * Writes go through io_uring, with the buffers registered with the
+ * kernel, or else through a few threads calling pwrite(). Files are
+ * opened with O_DIRECT where the file system allows it, so a large
+ * export doesn't push everything else out of the page cache.
+ *
+ * O_DIRECT writes must start and end on NOISE_WRITER_ALIGN bytes of the
+ * file, and come from memory aligned the same. The caller doesn't need
+ * to care: noiseWriterData() says where in a buffer to put the bytes of
+ * a given offset, and the writer keeps the unaligned end of each buffer
+ * back, writes it with the start of the next one, and truncates the
+ * file to its real size at the end. So every file has to be written
+ * front to back, with each buffer following on from the one before.
+ *
+ * A writer is used from one thread at a time.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#ifndef NOISE_WRITER_H
+#define NOISE_WRITER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOISE_WRITER_ALIGN 4096
+
+/* How createNoiseWriter() writes */
+#define NOISE_WRITER_AUTO 0    // io_uring if the kernel has it, else threads
+#define NOISE_WRITER_URING 1
+#define NOISE_WRITER_THREADS 2
+
+typedef struct NoiseWriter NoiseWriter;
+
+/*
+ * createNoiseWriter(buffers, bytes, backend, direct) - a writer with
+ * buffers buffers of up to bytes bytes each, writing with backend, and
+ * O_DIRECT unless direct is 0. Returns NULL if the backend can't be set
+ * up, or the buffers allocated.
+ */
+NoiseWriter *createNoiseWriter(int buffers, size_t bytes, int backend, int direct);
+
+/* destroyNoiseWriter(writer) - close any open file and free it all */
+void destroyNoiseWriter(NoiseWriter *writer);
+
+/*
+ * noiseWriterBackend(writer) - "io_uring", "io_uring, unregistered" or
+ * "pwrite threads", and ", O_DIRECT" if the file last opened has it.
+ */
+const char *noiseWriterBackend(const NoiseWriter *writer);
+
+/*
+ * openNoiseFile(writer, filename, header, headerBytes) - start writing a
+ * file, with headerBytes of header, less than NOISE_WRITER_ALIGN, at the
+ * start. Returns 0 if it can't be created.
+ */
+int openNoiseFile(NoiseWriter *writer, const char *filename,
+                  const void *header, size_t headerBytes);
+
+/*
+ * noiseWriterData(writer, buffer, offset) - where the bytes for offset,
+ * and those after it, go in a buffer.
+ */
+unsigned char *noiseWriterData(NoiseWriter *writer, int buffer, long long offset);
+
+/*
+ * writeNoiseBuffer(writer, buffer, offset, bytes) - write bytes of a
+ * buffer at offset, which has to be where the header or the last buffer
+ * written ended. If that was on a multiple of NOISE_WRITER_ALIGN, offset
+ * can be any later multiple, leaving a hole for the caller to fill once
+ * the file is closed. The buffer must have been handed back by
+ * waitNoiseBuffer() if it was written before. Returns at once; the
+ * buffer can't be touched until the next waitNoiseBuffer() on it.
+ * Returns 0 if a write has failed.
+ */
+int writeNoiseBuffer(NoiseWriter *writer, int buffer, long long offset, size_t bytes);
+
+/*
+ * waitNoiseBuffer(writer, buffer) - wait until a buffer is free to fill.
+ * Returns 0 if a write has failed.
+ */
+int waitNoiseBuffer(NoiseWriter *writer, int buffer);
+
+/*
+ * closeNoiseFile(writer) - write what is left, wait for all of it, and
+ * close the file. Returns 0 if any write failed.
+ */
+int closeNoiseFile(NoiseWriter *writer);
+
+/*
+ * noiseWriterWaited(writer) - the seconds spent in waitNoiseBuffer() and
+ * closeNoiseFile() waiting for the disk, that generation didn't hide.
+ */
+double noiseWriterWaited(const NoiseWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOISE_WRITER_H */
@@ -0,0 +1,373 @@
+/*
+ * Throughput of the CPU noise kernels in noise.c, in points per second.
+ *
+ * Every kernel the CPU supports evaluates the same random points, and
+ * is checked against the scalar snoise4() and fbm() before it is timed,
+ * fbm both in bulk and in small queries, which take another path. fbm is
+ * timed with fbmOctaves octaves, and counted in points, not octaves,
+ * both over all the points and as the latency of small queries of
+ * queryPoints points each.
+ *
+ * Then snoise4Grid() is timed on a gridSize^3 grid with gridStep between
+ * points, against snoise4Batch() of the same points, with the number of
+ * gradients it hashed per point.
+ *
+ * Then snoise4FixedBatch() of the same random points, in fixed point,
+ * which every kernel must get bit for bit the same as snoise4Fixed().
+ *
+ * Last, fbmEval() with the default kernel, answering batches of
+ * queryBatch points picked at random from numEntities of them, the way
+ * a game server would, with and without an FbmCache.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "noise.h"
+
+int numPoints = 1 << 20;
+int numRuns = 5;
+int fbmOctaves = 8;
+int queryPoints = 4;
+int gridSize = 64;
+float gridStep = 1.0f / 64.0f;
+int numEntities = 1024;
+int queryBatch = 64;
+float range = 64.0f; // Points are spread over [-range, range]
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*
+ * benchGrid() - time snoise4Grid() with every kernel.
+ */
+void benchGrid(void)
+{
+    int count = gridSize * gridSize * gridSize, i, j, k, n, run;
+    float *x, *y, *z, *w, *reference, *out, hashes = 0.0f;
+    double start, best, batchBest, error;
+    const char *name;
+
+    x = (float*)malloc(count * sizeof(float));
+    y = (float*)malloc(count * sizeof(float));
+    z = (float*)malloc(count * sizeof(float));
+    w = (float*)malloc(count * sizeof(float));
+    reference = (float*)malloc(count * sizeof(float));
+    out = (float*)malloc(count * sizeof(float));
+    for(k = 0, n = 0; k < gridSize; k++)
+        for(j = 0; j < gridSize; j++)
+            for(i = 0; i < gridSize; i++, n++)
+            {
+                x[n] = 0.5f + i * gridStep;
+                y[n] = 0.25f + j * gridStep;
+                z[n] = -0.75f + k * gridStep;
+                w[n] = 0.125f;
+                reference[n] = snoise4(x[n], y[n], z[n], w[n]);
+            }
+
+    printf("\n%dx%dx%d grid, step %g\n", gridSize, gridSize, gridSize, gridStep);
+    printf("%-10s %14s %14s %12s %12s\n", "kernel", "grid points/s", "batch points/s",
+           "hashes/point", "max error");
+    for(n = 0; (name = noiseKernelNameAt(n)) != NULL; n++)
+    {
+        if(!setNoiseKernel(name))
+            continue;
+        best = batchBest = 1.0e30;
+        for(run = 0; run < numRuns; run++)
+        {
+            start = now();
+            hashes = snoise4Grid(0.5f, 0.25f, -0.75f, 0.125f, gridStep,
+                                 gridSize, gridSize, gridSize, out);
+            start = now() - start;
+            if(start < best)
+                best = start;
+        }
+        error = 0.0;
+        for(i = 0; i < count; i++)
+            if(fabs(out[i] - reference[i]) > error)
+                error = fabs(out[i] - reference[i]);
+        for(run = 0; run < numRuns; run++)
+        {
+            start = now();
+            snoise4Batch(x, y, z, w, out, count);
+            start = now() - start;
+            if(start < batchBest)
+                batchBest = start;
+        }
+        printf("%-10s %14.0f %14.0f %12.3f %12.2e\n", name, count / best, count / batchBest,
+               hashes, error);
+    }
+
+    free(x); free(y); free(z); free(w); free(reference); free(out);
+}
+
+/*
+ * benchFixed(x, y, z, w, reference) - time snoise4FixedBatch() with
+ * every kernel, and check it against snoise4Fixed() and snoise4().
+ */
+void benchFixed(const float *x, const float *y, const float *z, const float *w,
+                const float *reference)
+{
+    int *ix, *iy, *iz, *iw, i, n, run, mismatches;
+    short *expected, *out;
+    double start, best, error, sum = 0.0;
+    const char *name;
+
+    ix = (int*)malloc(numPoints * sizeof(int));
+    iy = (int*)malloc(numPoints * sizeof(int));
+    iz = (int*)malloc(numPoints * sizeof(int));
+    iw = (int*)malloc(numPoints * sizeof(int));
+    expected = (short*)malloc(numPoints * sizeof(short));
+    out = (short*)malloc(numPoints * sizeof(short));
+    // The float points are multiples of 1/2^16 that close to the origin
+    for(i = 0; i < numPoints; i++)
+    {
+        ix[i] = (int)lrintf(x[i] * NOISE_FIXED_ONE);
+        iy[i] = (int)lrintf(y[i] * NOISE_FIXED_ONE);
+        iz[i] = (int)lrintf(z[i] * NOISE_FIXED_ONE);
+        iw[i] = (int)lrintf(w[i] * NOISE_FIXED_ONE);
+        expected[i] = (short)snoise4Fixed(ix[i], iy[i], iz[i], iw[i]);
+    }
+    error = 0.0;
+    for(i = 0; i < numPoints; i++)
+    {
+        double e = fabs(expected[i] / 32768.0 - reference[i]);
+        sum += e;
+        if(e > error)
+            error = e;
+    }
+
+    printf("\nFixed point, against snoise4(): max error %.2e, mean %.2e\n", error, sum / numPoints);
+    printf("%-10s %14s %12s\n", "kernel", "points/s", "mismatches");
+    for(n = 0; (name = noiseKernelNameAt(n)) != NULL; n++)
+    {
+        if(!setNoiseKernel(name))
+            continue;
+        best = 1.0e30;
+        for(run = 0; run < numRuns; run++)
+        {
+            start = now();
+            snoise4FixedBatch(ix, iy, iz, iw, out, numPoints);
+            start = now() - start;
+            if(start < best)
+                best = start;
+        }
+        for(i = mismatches = 0; i < numPoints; i++)
+            mismatches += out[i] != expected[i];
+        printf("%-10s %14.0f %12d\n", name, numPoints / best, mismatches);
+    }
+
+    free(ix); free(iy); free(iz); free(iw); free(expected); free(out);
+}
+
+/*
+ * benchQueries(x, y, z) - time fbmEval() on batches of points picked
+ * from the first numEntities points, without a cache, with one keyed on
+ * the exact position, and with one keyed on cells 1/64 across.
+ */
+void benchQueries(const float *x, const float *y, const float *z)
+{
+    static FbmCache cache; // Too big for the stack
+    FbmParams params;
+    float px[256], py[256], pz[256], *reference, *out;
+    const float *points[3] = { px, py, pz };
+    int numQueries = numPoints / fbmOctaves, *picks, i, q, n, run, cached;
+    double start, best, error;
+
+    params.octaves = fbmOctaves;
+    params.frequency = 1.0f;
+    params.persistence = 0.5f;
+    params.time = 0.0f;
+    reference = (float*)malloc(numEntities * sizeof(float));
+    picks = (int*)malloc(numQueries * sizeof(int));
+    out = (float*)malloc(numQueries * sizeof(float));
+    for(i = 0; i < numEntities; i++)
+    {
+        float position[3];
+        position[0] = x[i];
+        position[1] = y[i];
+        position[2] = z[i];
+        reference[i] = fbm(position, fbmOctaves, 1.0f, 0.5f, 0.0f);
+    }
+    for(i = 0; i < numQueries; i++)
+        picks[i] = rand() % numEntities;
+
+    setNoiseKernel(NULL);
+    printf("\nfbmEval() with %s, batches of %d points from %d entities\n", noiseKernelName(),
+           queryBatch, numEntities);
+    printf("%-10s %14s %12s %12s\n", "cache", "queries/s", "hit rate", "max error");
+    for(cached = 0; cached <= 2; cached++)
+    {
+        best = 1.0e30;
+        for(run = 0; run < numRuns; run++)
+        {
+            initFbmCache(&cache, cached == 2 ? 1.0f / 64.0f : 0.0f);
+            start = now();
+            for(q = 0; q < numQueries; q += n)
+            {
+                n = numQueries - q < queryBatch ? numQueries - q : queryBatch;
+                for(i = 0; i < n; i++)
+                {
+                    px[i] = x[picks[q + i]];
+                    py[i] = y[picks[q + i]];
+                    pz[i] = z[picks[q + i]];
+                }
+                fbmEval(points, n, &params, cached ? &cache : NULL, out + q);
+            }
+            start = now() - start;
+            if(start < best)
+                best = start;
+        }
+        error = 0.0;
+        for(i = 0; i < numQueries; i++)
+            if(fabs(out[i] - reference[picks[i]]) > error)
+                error = fabs(out[i] - reference[picks[i]]);
+        if(cached)
+            printf("%-10s %14.0f %11.1f%% %12.2e\n", cached == 2 ? "1/64 cell" : "exact",
+                   numQueries / best,
+                   100.0 * cache.hits / (cache.hits + cache.misses), error);
+        else
+            printf("%-10s %14.0f %12s %12.2e\n", "none", numQueries / best, "", error);
+    }
+
+    free(reference); free(picks); free(out);
+}
+
+int main(int argc, char *argv[])
+{
+    float *x, *y, *z, *w, *reference, *fbmReference, *out;
+    double start, best, fbmBest, queryBest, scalarRate = 0.0, rate, error, fbmError;
+    const char *name;
+    int i, k, run, q, numQueries, numFbm;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(i + 1 < argc && !strcmp(argv[i], "-points"))
+            numPoints = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-runs"))
+            numRuns = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-range"))
+            range = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-octaves"))
+            fbmOctaves = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-query"))
+            queryPoints = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-grid"))
+            gridSize = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-step"))
+            gridStep = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-entities"))
+            numEntities = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-batch"))
+            queryBatch = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-points N] [-runs N] [-range R] [-octaves N] [-query N]"
+                            " [-grid N] [-step S] [-entities N] [-batch N]\n", argv[0]);
+            return 1;
+        }
+    }
+    numFbm = numPoints / fbmOctaves;
+    numQueries = numFbm / queryPoints;
+    if(numRuns < 1 || fbmOctaves < 1 || queryPoints < 1 || numQueries < 1 || gridSize < 1 ||
+       numEntities < 1 || numEntities > numPoints || queryBatch < 1 || queryBatch > 256)
+        return 1;
+
+    x = (float*)malloc(numPoints * sizeof(float));
+    y = (float*)malloc(numPoints * sizeof(float));
+    z = (float*)malloc(numPoints * sizeof(float));
+    w = (float*)malloc(numPoints * sizeof(float));
+    reference = (float*)malloc(numPoints * sizeof(float));
+    fbmReference = (float*)malloc(numFbm * sizeof(float));
+    out = (float*)malloc(numPoints * sizeof(float));
+    srand(1);
+    for(i = 0; i < numPoints; i++)
+    {
+        x[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        y[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        z[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        w[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        reference[i] = snoise4(x[i], y[i], z[i], w[i]);
+    }
+    for(i = 0; i < numFbm; i++)
+    {
+        float position[3];
+        position[0] = x[i];
+        position[1] = y[i];
+        position[2] = z[i];
+        fbmReference[i] = fbm(position, fbmOctaves, 1.0f, 0.5f, 0.0f);
+    }
+    initNoiseTables();
+
+    printf("%d points, best of %d runs, default kernel %s\n", numPoints, numRuns, noiseKernelName());
+    printf("%-10s %14s %10s %12s %14s %12s %12s\n", "kernel", "points/s", "speedup", "max error",
+           "fbm points/s", "fbm query", "fbm error");
+    for(k = 0; (name = noiseKernelNameAt(k)) != NULL; k++)
+    {
+        if(!setNoiseKernel(name))
+        {
+            printf("%-10s %14s\n", name, "unsupported");
+            continue;
+        }
+        snoise4Batch(x, y, z, w, out, numPoints);
+        error = 0.0;
+        for(i = 0; i < numPoints; i++)
+            if(fabs(out[i] - reference[i]) > error)
+                error = fabs(out[i] - reference[i]);
+        fbmError = 0.0;
+        fbmBatch(x, y, z, out, numFbm, fbmOctaves, 1.0f, 0.5f, 0.0f);
+        for(i = 0; i < numFbm; i++)
+            if(fabs(out[i] - fbmReference[i]) > fbmError)
+                fbmError = fabs(out[i] - fbmReference[i]);
+        for(q = 0; q < numQueries * queryPoints; q += queryPoints)
+            fbmBatch(x + q, y + q, z + q, out + q, queryPoints, fbmOctaves, 1.0f, 0.5f, 0.0f);
+        for(i = 0; i < numQueries * queryPoints; i++)
+            if(fabs(out[i] - fbmReference[i]) > fbmError)
+                fbmError = fabs(out[i] - fbmReference[i]);
+
+        best = fbmBest = queryBest = 1.0e30;
+        for(run = 0; run < numRuns; run++)
+        {
+            start = now();
+            snoise4Batch(x, y, z, w, out, numPoints);
+            start = now() - start;
+            if(start < best)
+                best = start;
+            start = now();
+            fbmBatch(x, y, z, out, numFbm, fbmOctaves, 1.0f, 0.5f, 0.0f);
+            start = now() - start;
+            if(start < fbmBest)
+                fbmBest = start;
+            start = now();
+            for(q = 0; q < numQueries * queryPoints; q += queryPoints)
+                fbmBatch(x + q, y + q, z + q, out + q, queryPoints, fbmOctaves, 1.0f, 0.5f, 0.0f);
+            start = now() - start;
+            if(start < queryBest)
+                queryBest = start;
+        }
+        rate = numPoints / best;
+        if(k == 0)
+            scalarRate = rate;
+        printf("%-10s %14.0f %9.2fx %12.2e %14.0f %9.2f us %12.2e\n", name, rate, rate / scalarRate,
+               error, numFbm / fbmBest, 1.0e6 * queryBest / numQueries, fbmError);
+    }
+
+    benchGrid();
+    benchFixed(x, y, z, w, reference);
+    benchQueries(x, y, z);
+
+    free(x); free(y); free(z); free(w); free(reference); free(fbmReference); free(out);
+    return 0;
+}
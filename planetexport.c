@@ -0,0 +1,684 @@
+/*
+ * Export the planet surface of GLSLnoise.c as an equirectangular map or
+ * the six faces of a cubemap, at any size, in bounded memory.
+ *
+ * The map is made in bands of rows: the worker threads of a NoisePool
+ * (see noise_pool.h) colour a batch of bands with fbmBatch() and
+ * colourize(), the same GetColour() planetrender draws, straight into
+ * the buffers of a NoiseWriter (see noise_writer.h). Each finished batch
+ * is queued to be written through io_uring, or by a few pwrite() threads,
+ * while the workers go on to the next one. The buffers are a ring of
+ * -memory megabytes, and the workers only start on a band once its
+ * buffer has been written, so a 64K x 32K map needs no more memory than
+ * a small one, and a slow disk holds up the workers rather than filling
+ * the memory.
+ *
+ * The equirectangular map has its poles on the Y axis, across the
+ * colour bands of the ramp, and longitude 0 on +Z. The cubemap faces
+ * are those GLSLnoise.c bakes, in the GL cube map layout, with row 0 at
+ * t = 0 as glGetTexImage() returns them.
+ *
+ * With -tiles, the bands go to a NoiseTileWriter instead (see
+ * noise_tiles.h), which cuts them into tiles and mip levels in a single
+ * random-access file, in 8-bit or float16 channels.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "noise.h"
+#include "noise_pool.h"
+#include "noise_writer.h"
+#include "noise_tiles.h"
+
+#define SEGMENT 256 // Pixels coloured per task
+#define PI_D 3.14159265358979323846
+
+int mapWidth = 4096, mapHeight = 2048;
+int cubemapSize = 0; // Six faces of this size instead of the equirectangular map
+int bandRows = 16;
+int memoryLimit = 256; // Megabytes of bands in flight
+int numThreads = 0; // All the cores
+int pinThreads = 0;
+int writerBackend = NOISE_WRITER_AUTO;
+int directIO = 1;
+int octaves = 8;
+float frequency[3] = {0.5f, 1.0f, 2.0f};
+float persistence = 0.5f;
+float noiseTime = 0.0f;
+const char *outputPrefix = "planet";
+int tileSize = 0; // Write PREFIX.tiles with tiles this size instead of PPM files
+int halfFloat = 0; // float16 channels in the tiles, not 8 bits
+int mipLevels = 0; // Down to one tile
+int verifyTiles = 0;
+
+/* Centre, s and t directions of each face, as cubeFaces in GLSLnoise.c */
+const float cubeFaces[6][3][3] = {
+    { {  1, 0, 0 }, {  0, 0,-1 }, { 0,-1, 0 } }, // +X
+    { { -1, 0, 0 }, {  0, 0, 1 }, { 0,-1, 0 } }, // -X
+    { {  0, 1, 0 }, {  1, 0, 0 }, { 0, 0, 1 } }, // +Y
+    { {  0,-1, 0 }, {  1, 0, 0 }, { 0, 0,-1 } }, // -Y
+    { {  0, 0, 1 }, {  1, 0, 0 }, { 0,-1, 0 } }, // +Z
+    { {  0, 0,-1 }, { -1, 0, 0 }, { 0,-1, 0 } }  // -Z
+};
+const char *faceNames[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+/* The image being made: one map, or the faces one after the other */
+int width, height, numFaces;
+int bandsPerFace, numBands, segmentsPerRow;
+float *sinLongitude, *cosLongitude;
+
+/* The ring of band buffers, band b in buffer b % numSlots */
+NoiseWriter *writer;
+int numSlots;
+size_t bandBytes;
+char header[64];
+size_t headerBytes;
+
+/* Or the ring of bands for the tile writer, and its pixel size */
+NoiseTileWriter *tileWriter;
+unsigned char **bandData;
+size_t pixelBytes = 3;
+char writtenWith[64];
+
+/* A worker's arrays for one segment of a row */
+typedef struct {
+    float x1[SEGMENT], y1[SEGMENT], z1[SEGMENT];
+    float x2[SEGMENT], y2[SEGMENT], z2[SEGMENT];
+    float n1[SEGMENT], n2[SEGMENT], p[SEGMENT][3];
+} SegmentBuffers;
+
+SegmentBuffers *buffers;
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*
+ * toByte(c) - a colour channel as the framebuffer stores it.
+ */
+unsigned char toByte(float c)
+{
+    if(c <= 0.0f)
+        return 0;
+    if(c >= 1.0f)
+        return 255;
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+/*
+ * surfacePoint(face, col, row, p) - the point on the unit sphere that a
+ * pixel of the map or of a cubemap face shows.
+ */
+void surfacePoint(int face, int col, int row, float p[3])
+{
+    const float (*axes)[3];
+    float x, y, len, latitude;
+    int k;
+
+    if(cubemapSize == 0)
+    {
+        latitude = (float)(PI_D * 0.5 - PI_D * (row + 0.5) / height);
+        p[0] = cosf(latitude) * sinLongitude[col];
+        p[1] = sinf(latitude);
+        p[2] = cosf(latitude) * cosLongitude[col];
+        return;
+    }
+    // The direction cubeface.vert interpolates to this texel
+    axes = cubeFaces[face];
+    x = 2.0f * (col + 0.5f) / cubemapSize - 1.0f;
+    y = 2.0f * (row + 0.5f) / cubemapSize - 1.0f;
+    for(k = 0; k < 3; k++)
+        p[k] = axes[0][k] + x * axes[1][k] + y * axes[2][k];
+    len = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+    for(k = 0; k < 3; k++)
+        p[k] /= len;
+}
+
+/*
+ * bandOffset(band) - where a band starts in its file.
+ */
+long long bandOffset(int band)
+{
+    return (long long)headerBytes + (long long)(band % bandsPerFace) * bandBytes;
+}
+
+/*
+ * bandRowCount(band) - the rows of a band, fewer in the last of a face.
+ */
+int bandRowCount(int band)
+{
+    int rows = height - (band % bandsPerFace) * bandRows;
+
+    return rows < bandRows ? rows : bandRows;
+}
+
+/*
+ * storePixel(rgb, out) - a colour in the format of the output.
+ */
+void storePixel(const float rgb[3], unsigned char *out)
+{
+    uint16_t half[3];
+    int k;
+
+    if(!halfFloat)
+    {
+        for(k = 0; k < 3; k++)
+            out[k] = toByte(rgb[k]);
+        return;
+    }
+    for(k = 0; k < 3; k++)
+        half[k] = floatToHalf(rgb[k]);
+    memcpy(out, half, sizeof(half));
+}
+
+/*
+ * colourSegments(arg, begin, end, worker) - colour row segments of the
+ * batch of bands starting at the band *arg, each as GetColour() would.
+ */
+void colourSegments(void *arg, int begin, int end, int worker)
+{
+    SegmentBuffers *b = &buffers[worker];
+    int firstBand = *(int*)arg;
+    int item, band, face, row, left, right, col, count, i;
+    unsigned char *out;
+    float rgb[3];
+
+    for(item = begin; item < end; item++)
+    {
+        band = firstBand + item / (bandRows * segmentsPerRow);
+        face = band / bandsPerFace;
+        row = (band % bandsPerFace) * bandRows + item / segmentsPerRow % bandRows;
+        if(row >= height)
+            continue; // The last band of a face is short
+        left = item % segmentsPerRow * SEGMENT;
+        right = left + SEGMENT < width ? left + SEGMENT : width;
+        count = right - left;
+        for(col = left, i = 0; col < right; col++, i++)
+        {
+            surfacePoint(face, col, row, b->p[i]);
+            b->x1[i] = b->p[i][0] * 4.0f;
+            b->y1[i] = b->p[i][1] * 4.0f;
+            b->z1[i] = b->p[i][2] * 4.0f;
+            b->x2[i] = b->p[i][0] * 3.14159f;
+            b->y2[i] = b->p[i][1] * 3.14159f;
+            b->z2[i] = b->p[i][2] * 3.14159f;
+        }
+        fbmBatch(b->x1, b->y1, b->z1, b->n1, count, octaves, frequency[0],
+                 persistence, noiseTime);
+        fbmBatch(b->x2, b->y2, b->z2, b->n2, count, octaves, frequency[2],
+                 persistence, noiseTime);
+        if(tileWriter)
+            out = bandData[band % numSlots];
+        else
+            out = noiseWriterData(writer, band % numSlots, bandOffset(band));
+        out += ((size_t)(row % bandRows) * width + left) * pixelBytes;
+        for(i = 0; i < count; i++)
+        {
+            colourize(b->p[i], b->n1[i], b->n2[i], rgb);
+            storePixel(rgb, out + i * pixelBytes);
+        }
+    }
+}
+
+/*
+ * openImage(face) - start the PPM file of the map, or of a face.
+ */
+int openImage(int face)
+{
+    char filename[1024];
+
+    if(cubemapSize == 0)
+        snprintf(filename, sizeof(filename), "%s.ppm", outputPrefix);
+    else
+        snprintf(filename, sizeof(filename), "%s_%s.ppm", outputPrefix, faceNames[face]);
+    if(!openNoiseFile(writer, filename, header, headerBytes))
+    {
+        fprintf(stderr, "ERROR: Cannot open output image file %s\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * exportImage(pool) - make all the bands, half the ring at a time, and
+ * queue each batch to be written while the workers make the next one.
+ * Returns 0 if a file can't be written.
+ */
+int exportImage(NoisePool *pool)
+{
+    int first, count, band, rows;
+
+    for(first = 0; first < numBands; first += count)
+    {
+        count = (numSlots + 1) / 2;
+        if(count > numBands - first)
+            count = numBands - first;
+        for(band = first; band < first + count; band++)
+            if(!waitNoiseBuffer(writer, band % numSlots))
+                goto failed;
+
+        parallelFor(pool, count * bandRows * segmentsPerRow, 1, colourSegments, &first);
+
+        for(band = first; band < first + count; band++)
+        {
+            if(band % bandsPerFace == 0)
+            {
+                // The next face, after the last one is all on disk
+                if(band > 0 && !closeNoiseFile(writer))
+                    goto failed;
+                if(!openImage(band / bandsPerFace))
+                    return 0;
+            }
+            rows = bandRowCount(band);
+            if(!writeNoiseBuffer(writer, band % numSlots, bandOffset(band),
+                                 (size_t)rows * width * 3))
+                goto failed;
+        }
+    }
+    if(closeNoiseFile(writer))
+        return 1;
+
+failed:
+    fprintf(stderr, "ERROR: Cannot write the output image\n");
+    return 0;
+}
+
+/* A batch of the tile export: bands to colour, and bands to tile */
+typedef struct {
+    int first; // First band to colour, as colourSegments() takes it
+    int tileFirst, tileCount;
+    int ok;
+} TileBatch;
+
+/*
+ * tileBatch(arg, begin, end, worker) - item 0 gives the bands coloured
+ * in the batch before to the tile writer, in order; the rest are the row
+ * segments of this batch, as for colourSegments().
+ */
+void tileBatch(void *arg, int begin, int end, int worker)
+{
+    TileBatch *batch = (TileBatch*)arg;
+    int band;
+
+    if(begin == 0)
+    {
+        for(band = batch->tileFirst; band < batch->tileFirst + batch->tileCount && batch->ok; band++)
+            batch->ok = addNoiseTileRows(tileWriter, bandData[band % numSlots], bandRowCount(band));
+        begin++;
+    }
+    if(begin < end)
+        colourSegments(&batch->first, begin - 1, end - 1, worker);
+}
+
+/*
+ * exportTiles(pool) - make all the bands, half the ring at a time, and
+ * give each batch to the tile writer in order while the workers make the
+ * next one. Returns 0 if the file can't be written.
+ */
+int exportTiles(NoisePool *pool)
+{
+    TileBatch batch;
+    int first, count, half = numSlots > 1 ? numSlots / 2 : 1, ok;
+
+    snprintf(writtenWith, sizeof(writtenWith), "%s", noiseTileWriterBackend(tileWriter));
+    batch.tileCount = 0;
+    batch.ok = 1;
+    // One more batch at the end, with nothing to colour, for the last tiles
+    for(first = 0; batch.ok && (first < numBands || batch.tileCount > 0); first += count)
+    {
+        count = half < numBands - first ? half : numBands - first;
+        batch.first = first;
+        // The calling worker takes item 0 first, and the others steal the rest
+        parallelFor(pool, 1 + count * bandRows * segmentsPerRow, 1, tileBatch, &batch);
+        batch.tileFirst = first;
+        batch.tileCount = count;
+    }
+    ok = finishNoiseTiles(tileWriter) && batch.ok;
+    tileWriter = NULL;
+    if(!ok)
+        fprintf(stderr, "ERROR: Cannot write the output tiles\n");
+    return ok;
+}
+
+/*
+ * tilePixel(tiles, level, face, x, y) - a pixel of a level, in its tile
+ * in the mapping.
+ */
+const unsigned char *tilePixel(const NoiseTiles *tiles, int level, int face, int x, int y)
+{
+    const unsigned char *tile = (const unsigned char*)noiseTile(tiles, level, face,
+                                                                x / tileSize, y / tileSize);
+
+    if(tile == NULL)
+        return NULL;
+    return tile + ((size_t)(y % tileSize) * tileSize + x % tileSize) * pixelBytes;
+}
+
+/*
+ * channelDifference(a, b, k) - how far apart channel k of two pixels is,
+ * in 8-bit steps or as a float.
+ */
+float channelDifference(const unsigned char *a, const unsigned char *b, int k)
+{
+    uint16_t ha, hb;
+
+    if(!halfFloat)
+        return fabsf((float)a[k] - (float)b[k]);
+    memcpy(&ha, a + k*2, 2);
+    memcpy(&hb, b + k*2, 2);
+    return fabsf(halfToFloat(ha) - halfToFloat(hb));
+}
+
+/*
+ * checkTiles(tiles) - check random pixels of level 0 against GetColour()
+ * worked out again one at a time, and of the other levels against the
+ * average of the 2x2 pixels of the level before, as the writer makes
+ * them. Returns 0 if any is off, by more than the one step the SIMD and
+ * scalar fbm can differ by at level 0.
+ */
+int checkTiles(const NoiseTiles *tiles)
+{
+    const NoiseTileHeader *h = noiseTilesHeader(tiles);
+    const NoiseTileLevel *level, *above;
+    const unsigned char *pixel, *quad[4];
+    unsigned char expected[6];
+    uint16_t half[4];
+    float p[3], x1, y1, z1, x2, y2, z2, n1, n2, rgb[3], d, worst = 0.0f;
+    float tolerance = halfFloat ? 1.0f / 1024.0f : 1.0f;
+    int samples = 1000, bad = 0, i, j, k, l, face, x, y, xs[2], ys[2];
+
+    srand(1);
+    for(i = 0; i < samples; i++)
+    {
+        face = rand() % numFaces;
+        x = rand() % width;
+        y = rand() % height;
+        surfacePoint(face, x, y, p);
+        x1 = p[0] * 4.0f; y1 = p[1] * 4.0f; z1 = p[2] * 4.0f;
+        x2 = p[0] * 3.14159f; y2 = p[1] * 3.14159f; z2 = p[2] * 3.14159f;
+        fbmBatch(&x1, &y1, &z1, &n1, 1, octaves, frequency[0], persistence, noiseTime);
+        fbmBatch(&x2, &y2, &z2, &n2, 1, octaves, frequency[2], persistence, noiseTime);
+        colourize(p, n1, n2, rgb);
+        storePixel(rgb, expected);
+        pixel = tilePixel(tiles, 0, face, x, y);
+        if(pixel == NULL)
+        {
+            bad++;
+            continue;
+        }
+        for(k = 0; k < 3; k++)
+        {
+            d = channelDifference(pixel, expected, k);
+            worst = d > worst ? d : worst;
+            bad += d > tolerance;
+        }
+    }
+    for(i = 0; i < samples && h->levels > 1; i++)
+    {
+        l = 1 + rand() % (h->levels - 1);
+        level = noiseTilesLevel(tiles, l);
+        above = noiseTilesLevel(tiles, l - 1);
+        face = rand() % numFaces;
+        x = rand() % level->width;
+        y = rand() % level->height;
+        xs[0] = 2*x;
+        xs[1] = 2*x + 1 < (int)above->width ? 2*x + 1 : 2*x;
+        ys[0] = 2*y;
+        ys[1] = 2*y + 1 < (int)above->height ? 2*y + 1 : 2*y;
+        for(k = 0; k < 4; k++)
+        {
+            quad[k] = tilePixel(tiles, l - 1, face, xs[k & 1], ys[k >> 1]);
+            if(quad[k] == NULL)
+                break;
+        }
+        pixel = tilePixel(tiles, l, face, x, y);
+        if(k < 4 || pixel == NULL)
+        {
+            bad++;
+            continue;
+        }
+        for(k = 0; k < 3; k++)
+        {
+            if(halfFloat)
+            {
+                for(j = 0; j < 4; j++)
+                    memcpy(&half[j], quad[j] + k*2, 2);
+                half[0] = floatToHalf((halfToFloat(half[0]) + halfToFloat(half[1]) +
+                                       halfToFloat(half[2]) + halfToFloat(half[3])) * 0.25f);
+                memcpy(expected + k*2, &half[0], 2);
+            }
+            else
+                expected[k] = (unsigned char)((quad[0][k] + quad[1][k] +
+                                               quad[2][k] + quad[3][k] + 2) >> 2);
+        }
+        bad += memcmp(pixel, expected, pixelBytes) != 0;
+    }
+
+    printf("Verified %d pixels of level 0, largest difference %g%s, and %d of the "
+           "mip levels: %s\n", samples, worst, halfFloat ? "" : " steps",
+           h->levels > 1 ? samples : 0, bad ? "FAILED" : "ok");
+    return bad == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    NoisePool *pool;
+    NoiseTiles *tiles;
+    struct rusage usage;
+    char filename[1024];
+    double start, longitude;
+    int i;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(i + 1 < argc && !strcmp(argv[i], "-size"))
+        {
+            if(sscanf(argv[++i], "%dx%d", &mapWidth, &mapHeight) != 2)
+                goto usage;
+        }
+        else if(i + 1 < argc && !strcmp(argv[i], "-cubemap"))
+            cubemapSize = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-octaves"))
+            octaves = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-frequency"))
+        {
+            if(sscanf(argv[++i], "%f,%f,%f", &frequency[0], &frequency[1], &frequency[2]) != 3)
+                goto usage;
+        }
+        else if(i + 1 < argc && !strcmp(argv[i], "-persistence"))
+            persistence = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-time"))
+            noiseTime = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-threads"))
+            numThreads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-pin"))
+            pinThreads = 1;
+        else if(i + 1 < argc && !strcmp(argv[i], "-band"))
+            bandRows = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-memory"))
+            memoryLimit = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-output"))
+            outputPrefix = argv[++i];
+        else if(i + 1 < argc && !strcmp(argv[i], "-writer"))
+        {
+            i++;
+            if(!strcmp(argv[i], "auto"))
+                writerBackend = NOISE_WRITER_AUTO;
+            else if(!strcmp(argv[i], "uring"))
+                writerBackend = NOISE_WRITER_URING;
+            else if(!strcmp(argv[i], "threads"))
+                writerBackend = NOISE_WRITER_THREADS;
+            else
+                goto usage;
+        }
+        else if(!strcmp(argv[i], "-nodirect"))
+            directIO = 0;
+        else if(i + 1 < argc && !strcmp(argv[i], "-tiles"))
+            tileSize = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-half"))
+            halfFloat = 1;
+        else if(i + 1 < argc && !strcmp(argv[i], "-mips"))
+            mipLevels = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-verify"))
+            verifyTiles = 1;
+        else
+            goto usage;
+    }
+    if(mapWidth < 1 || mapHeight < 1 || cubemapSize < 0 || bandRows < 1 ||
+       memoryLimit < 1 || octaves < 2 || octaves > 32)
+        goto usage;
+    if(tileSize ? tileSize < 64 || (tileSize & (tileSize - 1)) ||
+                  mipLevels < 0 || mipLevels > NOISE_TILES_MAX_LEVELS
+                : halfFloat || mipLevels || verifyTiles)
+        goto usage;
+
+    width = cubemapSize ? cubemapSize : mapWidth;
+    height = cubemapSize ? cubemapSize : mapHeight;
+    numFaces = cubemapSize ? 6 : 1;
+    if(bandRows > height)
+        bandRows = height;
+    bandsPerFace = (height + bandRows - 1) / bandRows;
+    numBands = bandsPerFace * numFaces;
+    segmentsPerRow = (width + SEGMENT - 1) / SEGMENT;
+    if((long long)numBands * bandRows * segmentsPerRow > 0x7fffffff)
+    {
+        fprintf(stderr, "ERROR: %dx%d is too large\n", width, height);
+        return 1;
+    }
+
+    // Two slots at least, so the workers and the disk can overlap
+    pixelBytes = halfFloat ? 6 : 3;
+    bandBytes = (size_t)bandRows * width * pixelBytes;
+    numSlots = (int)(((size_t)memoryLimit << 20) / bandBytes);
+    if(numSlots < 2)
+        numSlots = 2;
+    if(numSlots > numBands)
+        numSlots = numBands;
+    if(tileSize)
+    {
+        snprintf(filename, sizeof(filename), "%s.tiles", outputPrefix);
+        tileWriter = createNoiseTileWriter(filename, width, height, numFaces, tileSize, 3,
+                                           halfFloat ? NOISE_TILE_F16 : NOISE_TILE_U8,
+                                           mipLevels, writerBackend, directIO);
+        if(tileWriter == NULL)
+        {
+            fprintf(stderr, "ERROR: Cannot open output tile file %s\n", filename);
+            return 1;
+        }
+        bandData = (unsigned char**)malloc(numSlots * sizeof(unsigned char*));
+        for(i = 0; bandData != NULL && i < numSlots; i++)
+            if((bandData[i] = (unsigned char*)malloc(bandBytes)) == NULL)
+            {
+                fprintf(stderr, "ERROR: Out of memory\n");
+                return 1;
+            }
+    }
+    headerBytes = (size_t)snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    if(!tileSize)
+        writer = createNoiseWriter(numSlots, bandBytes, writerBackend, directIO);
+    if(!tileSize && writer == NULL)
+    {
+        fprintf(stderr, "ERROR: Cannot set up the %s writer\n",
+                writerBackend == NOISE_WRITER_URING ? "io_uring" : "file");
+        return 1;
+    }
+    sinLongitude = (float*)malloc(width * sizeof(float));
+    cosLongitude = (float*)malloc(width * sizeof(float));
+    if(sinLongitude == NULL || cosLongitude == NULL || (tileSize && bandData == NULL))
+    {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return 1;
+    }
+    for(i = 0; i < width; i++)
+    {
+        longitude = 2.0 * PI_D * (i + 0.5) / width - PI_D;
+        sinLongitude[i] = (float)sin(longitude);
+        cosLongitude[i] = (float)cos(longitude);
+    }
+
+    // Before the threads start, they would all race to do it
+    initNoiseTables();
+    pool = createNoisePool(numThreads, pinThreads);
+    if(pool == NULL)
+    {
+        fprintf(stderr, "ERROR: Cannot start the worker threads\n");
+        return 1;
+    }
+    buffers = (SegmentBuffers*)malloc(noisePoolWorkers(pool) * sizeof(SegmentBuffers));
+
+    start = now();
+    if(!(tileSize ? exportTiles(pool) : exportImage(pool)))
+        return 1;
+    start = now() - start;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%d face%s of %dx%d, %d octaves, %d threads, %s kernel: %.2f s, "
+           "%.1f Mpixels/s\n", numFaces, numFaces > 1 ? "s" : "", width, height,
+           octaves, noisePoolWorkers(pool), noiseKernelName(), start,
+           (double)width * height * numFaces / start * 1.0e-6);
+    if(!tileSize)
+    {
+        printf("%d bands of %d rows, %d buffers of %.1f MB, written with %s, "
+               "%.2f s waiting for the disk; peak RSS %.1f MB\n", numBands, bandRows,
+               numSlots, bandBytes / 1048576.0, noiseWriterBackend(writer),
+               noiseWriterWaited(writer), usage.ru_maxrss / 1024.0);
+        destroyNoiseWriter(writer);
+        destroyNoisePool(pool);
+        return 0;
+    }
+
+    // Read the file back, as a viewer would
+    tiles = openNoiseTiles(filename);
+    if(tiles == NULL)
+    {
+        fprintf(stderr, "ERROR: %s is not a valid tile file\n", filename);
+        return 1;
+    }
+    printf("%d bands of %d rows, %d buffers of %.1f MB; %u %s tiles of %dx%d in %u "
+           "levels, written with %s; peak RSS %.1f MB\n", numBands, bandRows, numSlots,
+           bandBytes / 1048576.0, noiseTilesHeader(tiles)->tileCount,
+           halfFloat ? "float16" : "8-bit", tileSize, tileSize,
+           noiseTilesHeader(tiles)->levels, writtenWith, usage.ru_maxrss / 1024.0);
+    i = !verifyTiles || checkTiles(tiles);
+    closeNoiseTiles(tiles);
+    destroyNoisePool(pool);
+    return i ? 0 : 1;
+
+usage:
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -size WxH           equirectangular map size (default 4096x2048)\n"
+        "  -cubemap N          six NxN cubemap faces instead of the map\n"
+        "  -octaves N          fbm octaves, 2 to 32 (default 8)\n"
+        "  -frequency X,Y,Z    fbm base frequencies (default 0.5,1.0,2.0)\n"
+        "  -persistence P      fbm amplitude falloff per octave (default 0.5)\n"
+        "  -time T             noise time (default 0)\n"
+        "  -threads N          worker threads (default one per core)\n"
+        "  -pin                bind each worker thread to its own core\n"
+        "  -band N             rows per band (default 16)\n"
+        "  -memory MB          memory for the bands in flight (default 256)\n"
+        "  -writer TYPE        \"uring\", \"threads\" (pwrite) or \"auto\" (default)\n"
+        "  -nodirect           write through the page cache, not with O_DIRECT\n"
+        "  -output PREFIX      write PREFIX.ppm, or PREFIX_px.ppm, PREFIX_nx.ppm,\n"
+        "                      ... for a cubemap (default \"planet\")\n"
+        "  -tiles N            write PREFIX.tiles, in NxN tiles with mip levels,\n"
+        "                      N a power of two from 64 up, instead of PPM files\n"
+        "  -half               float16 channels in the tiles, not 8 bits\n"
+        "  -mips N             mip levels, with the full size (default down to one tile)\n"
+        "  -verify             read the tiles back and check them\n",
+        argv[0]);
+    return 1;
+}
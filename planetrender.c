@@ -0,0 +1,406 @@
+/*
+ * The planet scene of GLSLnoise.c, rendered on the CPU.
+ *
+ * This draws the same image as renderScene() in single-pass mode, with
+ * the same camera and the same rotation, but ray casts the sphere for
+ * each pixel instead of rasterizing its polygons, and colours the hits
+ * with fbmBatch() and colourize() from the noise library instead of
+ * the shader's GetColour(). It needs no GPU and no GL at all, for
+ * rendering on machines that have neither, and for comparing the SIMD
+ * kernels with a software GL such as Mesa's llvmpipe running the shader.
+ *
+ * The frame is cut into square tiles and drawn with parallelFor2D() on
+ * a NoisePool (see noise_pool.h), so threads that get the cheap tiles of
+ * empty sky steal the rest of the planet from the others. -scaling draws
+ * it with 1, 2, 4 and so on up to -threads workers, with the scheduling
+ * stats of each, to see how close to linear it gets.
+ *
+ * The images agree with the GPU ones to a few levels per channel where
+ * the GPU's tessellated sphere is close to the real one. The shader
+ * colours the normal interpolated across each polygon, which is a little
+ * shorter than 1 away from the vertices, and the polygon silhouette cuts
+ * a few edge pixels off or leaves them in. -lit is not done here.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "noise.h"
+#include "noise_pool.h"
+
+#define MAX_TILE 256
+#define PI_F 3.14159265358979f
+
+int width = 640, height = 480;
+int tileSize = 32;
+int numThreads = 0; // All the cores
+int numRuns = 1;
+int pinThreads = 0;
+int scaling = 0;
+int octaves = 8;
+float frequency[3] = {0.5f, 1.0f, 2.0f};
+float persistence = 0.5f;
+float frameTime = 0.0f; // Both the rotation and the noise time
+const char *outputFile = "planet.ppm";
+
+unsigned char *image;
+
+/* The camera and the object rotation, set up by setupCamera() */
+float tanX, tanY, cosX, sinX, cosZ, sinZ;
+
+/* A worker's arrays of the hits in its tile, one tileSize^2 of each */
+typedef struct {
+    float *x1, *y1, *z1, *x2, *y2, *z2, *n1, *n2, *p;
+    int *pixel;
+} TileBuffers;
+
+TileBuffers *buffers;
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*
+ * setupCamera() - the projection and view of setupCamera() in GLSLnoise.c,
+ * a 45 degree field of view from (0,-4,0) with Z up, and the rotations of
+ * drawScene(): 30 degrees about X for the view, 45*t about Z for the spin.
+ */
+void setupCamera(void)
+{
+    float spin = 45.0f * frameTime * PI_F / 180.0f;
+
+    tanY = tanf(22.5f * PI_F / 180.0f);
+    tanX = tanY * (float)width / (float)height;
+    cosX = cosf(30.0f * PI_F / 180.0f);
+    sinX = sinf(30.0f * PI_F / 180.0f);
+    cosZ = cosf(spin);
+    sinZ = sinf(spin);
+}
+
+/*
+ * castRay(col, row, p) - hit the unit sphere with the ray through the
+ * middle of a pixel, and return the point in object space, which is
+ * the normal the shader colours. Returns 0 for the background.
+ */
+int castRay(int col, int row, float p[3])
+{
+    // The eye looks down +Y, with X right and Z up
+    float dx = ((2.0f * col + 1.0f) / width - 1.0f) * tanX;
+    float dz = (1.0f - (2.0f * row + 1.0f) / height) * tanY;
+    float a = dx*dx + 1.0f + dz*dz;
+    float b = -4.0f; // The eye at (0,-4,0) dotted with (dx,1,dz)
+    float disc = b*b - a*15.0f, s, hx, hy, hz, y;
+
+    if(disc < 0.0f)
+        return 0;
+    s = (-b - sqrtf(disc)) / a;
+    hx = s * dx;
+    hy = s * 1.0f - 4.0f;
+    hz = s * dz;
+    // Undo the view rotation about X, then the spin about Z
+    y = hy*cosX + hz*sinX;
+    p[2] = hz*cosX - hy*sinX;
+    p[0] = hx*cosZ + y*sinZ;
+    p[1] = y*cosZ - hx*sinZ;
+    return 1;
+}
+
+/*
+ * toByte(c) - a colour channel as the framebuffer stores it.
+ */
+unsigned char toByte(float c)
+{
+    if(c <= 0.0f)
+        return 0;
+    if(c >= 1.0f)
+        return 255;
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+/*
+ * renderTile(arg, left, top, right, bottom, worker) - ray cast one tile,
+ * then colour all of its hits at once: the two fbm() of GetColour() as
+ * two fbmBatch() calls.
+ */
+void renderTile(void *arg, int left, int top, int right, int bottom, int worker)
+{
+    TileBuffers *tile = &buffers[worker];
+    int col, row, count = 0, i;
+    unsigned char *out;
+    float p[3], rgb[3];
+
+    (void)arg;
+    for(row = top; row < bottom; row++)
+        for(col = left; col < right; col++)
+        {
+            out = image + (row*width + col)*3;
+            if(!castRay(col, row, p))
+            {
+                // glClearColor(0.0, 0.1, 0.3, 1.0)
+                out[0] = toByte(0.0f);
+                out[1] = toByte(0.1f);
+                out[2] = toByte(0.3f);
+                continue;
+            }
+            tile->pixel[count] = row*width + col;
+            memcpy(tile->p + count*3, p, sizeof(p));
+            tile->x1[count] = p[0] * 4.0f;
+            tile->y1[count] = p[1] * 4.0f;
+            tile->z1[count] = p[2] * 4.0f;
+            tile->x2[count] = p[0] * 3.14159f;
+            tile->y2[count] = p[1] * 3.14159f;
+            tile->z2[count] = p[2] * 3.14159f;
+            count++;
+        }
+
+    fbmBatch(tile->x1, tile->y1, tile->z1, tile->n1, count,
+             octaves, frequency[0], persistence, frameTime);
+    fbmBatch(tile->x2, tile->y2, tile->z2, tile->n2, count,
+             octaves, frequency[2], persistence, frameTime);
+    for(i = 0; i < count; i++)
+    {
+        colourize(tile->p + i*3, tile->n1[i], tile->n2[i], rgb);
+        out = image + tile->pixel[i]*3;
+        out[0] = toByte(rgb[0]);
+        out[1] = toByte(rgb[1]);
+        out[2] = toByte(rgb[2]);
+    }
+}
+
+/*
+ * renderFrame(pool) - draw every tile, and wait for them all.
+ */
+void renderFrame(NoisePool *pool)
+{
+    parallelFor2D(pool, width, height, tileSize, tileSize, renderTile, NULL);
+}
+
+/*
+ * timeFrames(pool) - the fastest of numRuns frames, in seconds.
+ */
+double timeFrames(NoisePool *pool)
+{
+    double start, best = 1.0e30;
+    int run;
+
+    resetNoisePoolStats(pool);
+    for(run = 0; run < numRuns; run++)
+    {
+        start = now();
+        renderFrame(pool);
+        start = now() - start;
+        if(start < best)
+            best = start;
+    }
+    return best;
+}
+
+/*
+ * printStats(pool) - each worker's share of the frames, and all of them
+ * together: tiles, steals, and the part of the time spent looking for
+ * work rather than doing it.
+ */
+void printStats(NoisePool *pool)
+{
+    NoisePoolStats stats, total;
+    int i;
+
+    memset(&total, 0, sizeof(total));
+    printf("  worker  tiles  tasks  steals  failed  busy ms  idle %%\n");
+    for(i = 0; i < noisePoolWorkers(pool); i++)
+    {
+        getNoisePoolStats(pool, i, &stats);
+        printf("  %6d %6llu %6llu %7llu %7llu %8.2f %7.1f\n", i, stats.items,
+               stats.tasks, stats.steals, stats.failedSteals, 1000.0*stats.busy,
+               100.0*stats.idle / (stats.busy + stats.idle + 1.0e-12));
+        total.items += stats.items;
+        total.tasks += stats.tasks;
+        total.steals += stats.steals;
+        total.failedSteals += stats.failedSteals;
+        total.busy += stats.busy;
+        total.idle += stats.idle;
+    }
+    printf("  %6s %6llu %6llu %7llu %7llu %8.2f %7.1f\n", "all", total.items,
+           total.tasks, total.steals, total.failedSteals, 1000.0*total.busy,
+           100.0*total.idle / (total.busy + total.idle + 1.0e-12));
+}
+
+/*
+ * runScaling() - time the frame with 1, 2, 4, ... workers and then
+ * numThreads, against one.
+ */
+int runScaling(void)
+{
+    NoisePool *pool;
+    NoisePoolStats stats;
+    double best, single = 0.0, idle, busy;
+    unsigned long long steals;
+    int threads, i;
+
+    printf("threads,ms,mpixels_per_s,speedup,efficiency,steals,idle_percent\n");
+    for(threads = 1; ; threads = threads*2 < numThreads ? threads*2 : numThreads)
+    {
+        pool = createNoisePool(threads, pinThreads);
+        if(pool == NULL)
+            return 0;
+        best = timeFrames(pool);
+        if(threads == 1)
+            single = best;
+        steals = 0;
+        idle = busy = 0.0;
+        for(i = 0; i < threads; i++)
+        {
+            getNoisePoolStats(pool, i, &stats);
+            steals += stats.steals;
+            idle += stats.idle;
+            busy += stats.busy;
+        }
+        printf("%d,%.2f,%.1f,%.2f,%.3f,%.1f,%.1f\n", threads, 1000.0*best,
+               width*height / best * 1.0e-6, single / best,
+               single / best / threads, (double)steals / numRuns,
+               100.0*idle / (busy + idle + 1.0e-12));
+        destroyNoisePool(pool);
+        if(threads >= numThreads)
+            return 1;
+    }
+}
+
+/*
+ * writePPM(filename) - save the image as a binary PPM, like writePPM()
+ * in GLSLnoise.c.
+ */
+int writePPM(const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if(file == NULL)
+    {
+        fprintf(stderr, "ERROR: Cannot open output image file %s\n", filename);
+        return 0;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    fwrite(image, 1, (size_t)width*height*3, file);
+    fclose(file);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    NoisePool *pool;
+    double best;
+    int i, pixels;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(i + 1 < argc && !strcmp(argv[i], "-size"))
+        {
+            if(sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+                goto usage;
+        }
+        else if(i + 1 < argc && !strcmp(argv[i], "-octaves"))
+            octaves = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-frequency"))
+        {
+            if(sscanf(argv[++i], "%f,%f,%f", &frequency[0], &frequency[1], &frequency[2]) != 3)
+                goto usage;
+        }
+        else if(i + 1 < argc && !strcmp(argv[i], "-persistence"))
+            persistence = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-time"))
+            frameTime = (float)atof(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-threads"))
+            numThreads = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-tile"))
+            tileSize = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-runs"))
+            numRuns = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-output"))
+            outputFile = argv[++i];
+        else if(!strcmp(argv[i], "-nooutput"))
+            outputFile = NULL;
+        else if(!strcmp(argv[i], "-pin"))
+            pinThreads = 1;
+        else if(!strcmp(argv[i], "-scaling"))
+            scaling = 1;
+        else
+            goto usage;
+    }
+    if(numThreads <= 0)
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(numThreads < 1)
+        numThreads = 1;
+    if(width < 1 || height < 1 || tileSize < 1 || tileSize > MAX_TILE ||
+       octaves < 2 || octaves > 32 || numRuns < 1)
+        goto usage;
+
+    image = (unsigned char*)malloc((size_t)width*height*3);
+    buffers = (TileBuffers*)malloc(numThreads * sizeof(TileBuffers));
+    pixels = tileSize*tileSize;
+    for(i = 0; i < numThreads; i++)
+    {
+        buffers[i].x1 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].y1 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].z1 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].x2 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].y2 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].z2 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].n1 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].n2 = (float*)malloc(pixels * sizeof(float));
+        buffers[i].p = (float*)malloc(pixels * 3 * sizeof(float));
+        buffers[i].pixel = (int*)malloc(pixels * sizeof(int));
+    }
+    // Before the threads start, they would all race to do it
+    initNoiseTables();
+    setupCamera();
+
+    if(scaling)
+        return runScaling() ? 0 : 1;
+
+    pool = createNoisePool(numThreads, pinThreads);
+    if(pool == NULL)
+    {
+        fprintf(stderr, "ERROR: Cannot start %d threads\n", numThreads);
+        return 1;
+    }
+    best = timeFrames(pool);
+    printf("%dx%d, %d octaves, %d threads, %dx%d tiles, %s kernel: "
+           "%.2f ms/frame, %.1f Mpixels/s\n", width, height, octaves,
+           numThreads, tileSize, tileSize, noiseKernelName(), 1000.0*best,
+           width*height / best * 1.0e-6);
+    printStats(pool);
+    destroyNoisePool(pool);
+
+    if(outputFile && !writePPM(outputFile))
+        return 1;
+    return 0;
+
+usage:
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -size WxH           render size (default 640x480)\n"
+        "  -octaves N          fbm octaves, 2 to 32 (default 8)\n"
+        "  -frequency X,Y,Z    fbm base frequencies (default 0.5,1.0,2.0)\n"
+        "  -persistence P      fbm amplitude falloff per octave (default 0.5)\n"
+        "  -time T             rotation and noise time (default 0)\n"
+        "  -threads N          worker threads (default one per core)\n"
+        "  -pin                bind each worker thread to its own core\n"
+        "  -tile N             tile size in pixels, 1 to %d (default 32)\n"
+        "  -runs N             render N times and report the fastest (default 1)\n"
+        "  -scaling            time 1, 2, 4, ... -threads workers, print CSV and quit\n"
+        "  -output FILE        write the image to FILE (default \"planet.ppm\")\n"
+        "  -nooutput           render only, don't write the image\n",
+        argv[0], MAX_TILE);
+    return 1;
+}
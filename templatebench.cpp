@@ -0,0 +1,316 @@
+/*
+ * Throughput of the noise.hpp templates, against the C noise library.
+ *
+ * simplex<4, float, Batch> is checked against snoise4() and timed for a
+ * few batch widths, next to snoise4Batch() with the kernel it picks, and
+ * fbm<8> against fbm() and fbmBatch(). The 2D and 3D noise are checked
+ * against simplex2() and simplex3() below, the textbook algorithm written
+ * out the long way. Double precision is checked against itself a point
+ * at a time: the texture quirks make the noise jump at cell edges, and
+ * near one double and float can pick different cells, so against
+ * snoise4() it is off by up to 2e-3. Any error over 1e-4, or
+ * proportionally more past the default range where float coordinates
+ * lose precision, makes the run fail.
+ *
+ * Released under the same terms as GLSLnoise.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "noise.h"
+#include "noise.hpp"
+
+int numPoints = 1 << 20;
+int numRuns = 5;
+float range = 64.0f; // Points are spread over [-range, range]
+
+float *x, *y, *z, *w, *reference, *fbmReference, *out;
+float *reference2, *reference3;
+double *dx, *dy, *dz, *dw, *dout, *dreference;
+int failures = 0;
+
+/*
+ * gradDot(g, x, y, z) - the dot product with cube edge gradient g of
+ * noiseGrad3[], the table noise.hpp builds its own from.
+ */
+float gradDot(int g, float x, float y, float z)
+{
+    return noiseGrad3[g][0] * x + noiseGrad3[g][1] * y + noiseGrad3[g][2] * z;
+}
+
+/*
+ * corner(g, x, y, z, radius) - the contribution of a simplex corner with
+ * gradient g at offset (x, y, z) from the point.
+ */
+float corner(int g, float x, float y, float z, float radius)
+{
+    float t = radius - x*x - y*y - z*z;
+    if(t < 0.0f)
+        return 0.0f;
+    t *= t;
+    return t * t * gradDot(g, x, y, z);
+}
+
+/*
+ * simplex2(xin, yin) - 2D simplex noise as in Stefan Gustavson's "Simplex
+ * noise demystified", with perm[] from noise.c.
+ */
+float simplex2(float xin, float yin)
+{
+    const float F2 = (float)(0.5 * (sqrt(3.0) - 1.0)), G2 = (float)((3.0 - sqrt(3.0)) / 6.0);
+    const int *perm = noisePermutation;
+    float s = (xin + yin) * F2;
+    int i = (int)floorf(xin + s), j = (int)floorf(yin + s);
+    float t = (i + j) * G2;
+    float x0 = xin - (i - t), y0 = yin - (j - t);
+    int i1, j1, ii = i & 255, jj = j & 255;
+
+    // The lower or the upper triangle of the skewed square
+    if(x0 > y0)
+    {
+        i1 = 1; j1 = 0;
+    }
+    else
+    {
+        i1 = 0; j1 = 1;
+    }
+    float x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+    float x2 = x0 - 1.0f + 2.0f * G2, y2 = y0 - 1.0f + 2.0f * G2;
+
+    return 70.0f * (corner(perm[(ii + perm[jj]) & 255] % 12, x0, y0, 0.0f, 0.5f) +
+                    corner(perm[(ii + i1 + perm[(jj + j1) & 255]) & 255] % 12, x1, y1, 0.0f, 0.5f) +
+                    corner(perm[(ii + 1 + perm[(jj + 1) & 255]) & 255] % 12, x2, y2, 0.0f, 0.5f));
+}
+
+/*
+ * simplex3(xin, yin, zin) - 3D simplex noise, the same way.
+ */
+float simplex3(float xin, float yin, float zin)
+{
+    const float F3 = 1.0f / 3.0f, G3 = 1.0f / 6.0f;
+    const int *perm = noisePermutation;
+    float s = (xin + yin + zin) * F3;
+    int i = (int)floorf(xin + s), j = (int)floorf(yin + s), k = (int)floorf(zin + s);
+    float t = (i + j + k) * G3;
+    float x0 = xin - (i - t), y0 = yin - (j - t), z0 = zin - (k - t);
+    int i1, j1, k1, i2, j2, k2, ii = i & 255, jj = j & 255, kk = k & 255;
+
+    // Which of the six tetrahedra of the skewed cube
+    if(x0 >= y0)
+    {
+        if(y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        else if(x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+        else              { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+    }
+    else
+    {
+        if(y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+        else if(x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+        else              { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    }
+    float x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+    float x2 = x0 - i2 + 2.0f * G3, y2 = y0 - j2 + 2.0f * G3, z2 = z0 - k2 + 2.0f * G3;
+    float x3 = x0 - 1.0f + 3.0f * G3, y3 = y0 - 1.0f + 3.0f * G3, z3 = z0 - 1.0f + 3.0f * G3;
+
+    return 32.0f * (corner(perm[(ii + perm[(jj + perm[kk]) & 255]) & 255] % 12,
+                           x0, y0, z0, 0.6f) +
+                    corner(perm[(ii + i1 + perm[(jj + j1 + perm[(kk + k1) & 255]) & 255]) & 255] % 12,
+                           x1, y1, z1, 0.6f) +
+                    corner(perm[(ii + i2 + perm[(jj + j2 + perm[(kk + k2) & 255]) & 255]) & 255] % 12,
+                           x2, y2, z2, 0.6f) +
+                    corner(perm[(ii + 1 + perm[(jj + 1 + perm[(kk + 1) & 255]) & 255]) & 255] % 12,
+                           x3, y3, z3, 0.6f));
+}
+
+/*
+ * now() - seconds from some fixed point in time.
+ */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*
+ * report(name, best, count, values, expected) - print a row: the points
+ * per second, and the largest difference from expected, or the range of
+ * values without one.
+ */
+template <typename Scalar, typename Expected>
+void report(const char *name, double best, int count, const Scalar *values,
+            const Expected *expected)
+{
+    double error = 0.0, low = 0.0, high = 0.0;
+
+    for(int i = 0; i < count; i++)
+    {
+        if(expected && fabs(values[i] - expected[i]) > error)
+            error = fabs(values[i] - expected[i]);
+        if(values[i] < low)
+            low = values[i];
+        if(values[i] > high)
+            high = values[i];
+    }
+    if(expected)
+    {
+        printf("%-32s %14.0f %12.2e\n", name, count / best, error);
+        if(error > 1.0e-4 * (range > 64.0f ? range / 64.0f : 1.0f))
+            failures++;
+    }
+    else
+        printf("%-32s %14.0f %12s [%.3f, %.3f]\n", name, count / best, "", low, high);
+}
+
+/*
+ * benchSimplex<Noise>(name, coords, results, expected) - time Noise over
+ * all the points.
+ */
+template <typename Noise>
+void benchSimplex(const char *name, const typename Noise::scalar *const *coords,
+                  typename Noise::scalar *results, const typename Noise::scalar *expected)
+{
+    double start, best = 1.0e30;
+
+    for(int run = 0; run < numRuns; run++)
+    {
+        start = now();
+        Noise::eval(coords, results, numPoints);
+        start = now() - start;
+        if(start < best)
+            best = start;
+    }
+    report(name, best, numPoints, results, expected);
+}
+
+/*
+ * benchFbm<Fbm>(name) - time Fbm over numPoints/8 points, with time 0.
+ */
+template <typename Fbm>
+void benchFbm(const char *name)
+{
+    const float *coords[3] = {x, y, z};
+    double start, best = 1.0e30;
+    int count = numPoints / 8;
+
+    for(int run = 0; run < numRuns; run++)
+    {
+        start = now();
+        Fbm::eval(coords, out, count, 1.0f, 0.0f);
+        start = now() - start;
+        if(start < best)
+            best = start;
+    }
+    report(name, best, count, out, fbmReference);
+}
+
+int main(int argc, char *argv[])
+{
+    double start, best;
+    int i, run;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(i + 1 < argc && !strcmp(argv[i], "-points"))
+            numPoints = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-runs"))
+            numRuns = atoi(argv[++i]);
+        else if(i + 1 < argc && !strcmp(argv[i], "-range"))
+            range = (float)atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-points N] [-runs N] [-range R]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(numRuns < 1 || numPoints < 8)
+        return 1;
+
+    x = (float*)malloc(numPoints * sizeof(float));
+    y = (float*)malloc(numPoints * sizeof(float));
+    z = (float*)malloc(numPoints * sizeof(float));
+    w = (float*)malloc(numPoints * sizeof(float));
+    reference = (float*)malloc(numPoints * sizeof(float));
+    reference2 = (float*)malloc(numPoints * sizeof(float));
+    reference3 = (float*)malloc(numPoints * sizeof(float));
+    fbmReference = (float*)malloc(numPoints / 8 * sizeof(float));
+    out = (float*)malloc(numPoints * sizeof(float));
+    dx = (double*)malloc(numPoints * sizeof(double));
+    dy = (double*)malloc(numPoints * sizeof(double));
+    dz = (double*)malloc(numPoints * sizeof(double));
+    dw = (double*)malloc(numPoints * sizeof(double));
+    dout = (double*)malloc(numPoints * sizeof(double));
+    dreference = (double*)malloc(numPoints * sizeof(double));
+    srand(1);
+    for(i = 0; i < numPoints; i++)
+    {
+        dx[i] = x[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        dy[i] = y[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        dz[i] = z[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        dw[i] = w[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+        reference[i] = snoise4(x[i], y[i], z[i], w[i]);
+        reference2[i] = simplex2(x[i], y[i]);
+        reference3[i] = simplex3(x[i], y[i], z[i]);
+    }
+    for(i = 0; i < numPoints / 8; i++)
+    {
+        float position[3] = {x[i], y[i], z[i]};
+        fbmReference[i] = fbm(position, 8, 1.0f, 0.5f, 0.0f);
+    }
+    initNoiseTables();
+
+    const float *coords[4] = {x, y, z, w};
+    const double *dcoords[4] = {dx, dy, dz, dw};
+    noise::simplex<4, double, 1>::eval(dcoords, dreference, numPoints);
+
+    printf("%d points, best of %d runs\n", numPoints, numRuns);
+    printf("%-32s %14s %12s\n", "function", "points/s", "max error");
+
+    best = 1.0e30;
+    for(run = 0; run < numRuns; run++)
+    {
+        start = now();
+        snoise4Batch(x, y, z, w, out, numPoints);
+        start = now() - start;
+        if(start < best)
+            best = start;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "snoise4Batch (%s)", noiseKernelName());
+    report(name, best, numPoints, out, reference);
+
+    benchSimplex<noise::simplex<4, float, 1>>("simplex<4, float, 1>", coords, out, reference);
+    benchSimplex<noise::simplex<4, float, 4>>("simplex<4, float, 4>", coords, out, reference);
+    benchSimplex<noise::simplex<4, float, 8>>("simplex<4, float, 8>", coords, out, reference);
+    benchSimplex<noise::simplex<4, float, 16>>("simplex<4, float, 16>", coords, out, reference);
+    benchSimplex<noise::simplex<4, double, 8>>("simplex<4, double, 8>", dcoords, dout, dreference);
+    benchSimplex<noise::simplex<3, float, 8>>("simplex<3, float, 8>", coords, out, reference3);
+    benchSimplex<noise::simplex<2, float, 8>>("simplex<2, float, 8>", coords, out, reference2);
+
+    best = 1.0e30;
+    for(run = 0; run < numRuns; run++)
+    {
+        start = now();
+        fbmBatch(x, y, z, out, numPoints / 8, 8, 1.0f, 0.5f, 0.0f);
+        start = now() - start;
+        if(start < best)
+            best = start;
+    }
+    snprintf(name, sizeof(name), "fbmBatch (%s)", noiseKernelName());
+    report(name, best, numPoints / 8, out, fbmReference);
+
+    benchFbm<noise::fbm<8, std::ratio<1, 2>, noise::simplex<4, float, 1>>>("fbm<8> of simplex<4, float, 1>");
+    benchFbm<noise::fbm<8, std::ratio<1, 2>, noise::simplex<4, float, 8>>>("fbm<8> of simplex<4, float, 8>");
+    benchFbm<noise::fbm<8, std::ratio<1, 2>, noise::simplex<4, float, 16>>>("fbm<8> of simplex<4, float, 16>");
+
+    free(x); free(y); free(z); free(w); free(reference); free(fbmReference); free(out);
+    free(reference2); free(reference3);
+    free(dx); free(dy); free(dz); free(dw); free(dout); free(dreference);
+    if(failures)
+        fprintf(stderr, "ERROR: %d functions differ from their reference by over 1e-4\n", failures);
+    return failures ? 1 : 0;
+}
@@ -1,220 +1,470 @@
-/*
- * 4D simplex noise, in a GLSL fragment shader.
- *
- * Simplex noise is implemented by the functions:
- * float snoise(vec4 P)
- *
- * Author: Stefan Gustavson ITN-LiTH (stegu@itn.liu.se) 2004-12-05
- * Simplex indexing functions by Bill Licea-Kane, ATI
- */
- 
-/*
-This code was irrevocably released into the public domain
-by its original author, Stefan Gustavson, in January 2011.
-Please feel free to use it for whatever you want.
-Credit is appreciated where appropriate, and I also
-appreciate being told where this code finds any use,
-but you may do as you like. Alternatively, if you want
-to have a familiar OSI-approved license, you may use
-This code under the terms of the MIT license:
-
-Copyright (C) 2004 by Stefan Gustavson. All rights reserved.
-This code is licensed to you under the terms of the MIT license:
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-*/
-
-#version 120
-
-uniform sampler2D permTexture;
-uniform sampler2D gradTexture;
-uniform sampler2D diffuse; // the vertical colour gradient
-uniform float time; // Used for texture animation
-
-uniform int octavesIn;
-uniform vec3 frequency;
-
-varying vec3 v_texCoord3D;
-
-/*
- * To create offsets of one texel and one half texel in the
- * texture lookup, we need to know the texture image size.
- */
-#define ONE 0.00390625
-#define ONEHALF 0.001953125
-// The numbers above are 1/256 and 0.5/256, change accordingly
-// if you change the code to use another perm/grad texture size.
-
-void simplex( const in vec4 P, out vec4 offset1, out vec4 offset2, out vec4 offset3 )
-{
-  vec4 offset0;
- 
-  vec3 isX = step( P.yzw, P.xxx );        // See comments in 3D simplex function
-  offset0.x = dot( isX, vec3( 1.0 ) );
-  offset0.yzw = 1.0 - isX;
-
-  vec2 isY = step( P.zw, P.yy );
-  offset0.y += dot( isY, vec2( 1.0 ) );
-  offset0.zw += 1.0 - isY;
- 
-  float isZ = step( P.w, P.z );
-  offset0.z += isZ;
-  offset0.w += 1.0 - isZ;
-
-  // offset0 now contains the unique values 0,1,2,3 in each channel
-
-  offset3 = clamp(   offset0, 0.0, 1.0 );
-  offset2 = clamp( --offset0, 0.0, 1.0 );
-  offset1 = clamp( --offset0, 0.0, 1.0 );
-}
-
-
-/*
- * 4D simplex noise. A lot faster than classic 4D noise, and better looking.
- */
-
-float snoise(const in vec4 P) {
-
-// The skewing and unskewing factors are hairy again for the 4D case
-// This is (sqrt(5.0)-1.0)/4.0
-#define F4 0.309016994375
-// This is (5.0-sqrt(5.0))/20.0
-#define G4 0.138196601125
-
-  // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
- 	float s = (P.x + P.y + P.z + P.w) * F4; // Factor for 4D skewing
-  vec4 Pi = floor(P + s);
-  float t = (Pi.x + Pi.y + Pi.z + Pi.w) * G4;
-  vec4 P0 = Pi - t; // Unskew the cell origin back to (x,y,z,w) space
-  Pi = Pi * ONE + ONEHALF; // Integer part, scaled and offset for texture lookup
-
-  vec4 Pf0 = P - P0;  // The x,y distances from the cell origin
-
-  // For the 4D case, the simplex is a 4D shape I won't even try to describe.
-  // To find out which of the 24 possible simplices we're in, we need to
-  // determine the magnitude ordering of x, y, z and w components of Pf0.
-  vec4 o1;
-  vec4 o2;
-  vec4 o3;
-  simplex(Pf0, o1, o2, o3);  
-
-  // Noise contribution from simplex origin
-  float perm0xy = texture2D(permTexture, Pi.xy).a;
-  float perm0zw = texture2D(permTexture, Pi.zw).a;
-  vec4  grad0 = texture2D(gradTexture, vec2(perm0xy, perm0zw)).rgba * 4.0 - 1.0;
-  float t0 = 0.6 - dot(Pf0, Pf0);
-  float n0;
-  if (t0 < 0.0) n0 = 0.0;
-  else {
-    t0 *= t0;
-    n0 = t0 * t0 * dot(grad0, Pf0);
-  }
-
-  // Noise contribution from second corner
-  vec4 Pf1 = Pf0 - o1 + G4;
-  o1 = o1 * ONE;
-  float perm1xy = texture2D(permTexture, Pi.xy + o1.xy).a;
-  float perm1zw = texture2D(permTexture, Pi.zw + o1.zw).a;
-  vec4  grad1 = texture2D(gradTexture, vec2(perm1xy, perm1zw)).rgba * 4.0 - 1.0;
-  float t1 = 0.6 - dot(Pf1, Pf1);
-  float n1;
-  if (t1 < 0.0) n1 = 0.0;
-  else {
-    t1 *= t1;
-    n1 = t1 * t1 * dot(grad1, Pf1);
-  }
-  
-  // Noise contribution from third corner
-  vec4 Pf2 = Pf0 - o2 + 2.0 * G4;
-  o2 = o2 * ONE;
-  float perm2xy = texture2D(permTexture, Pi.xy + o2.xy).a;
-  float perm2zw = texture2D(permTexture, Pi.zw + o2.zw).a;
-  vec4  grad2 = texture2D(gradTexture, vec2(perm2xy, perm2zw)).rgba * 4.0 - 1.0;
-  float t2 = 0.6 - dot(Pf2, Pf2);
-  float n2;
-  if (t2 < 0.0) n2 = 0.0;
-  else {
-    t2 *= t2;
-    n2 = t2 * t2 * dot(grad2, Pf2);
-  }
-  
-  // Noise contribution from fourth corner
-  vec4 Pf3 = Pf0 - o3 + 3.0 * G4;
-  o3 = o3 * ONE;
-  float perm3xy = texture2D(permTexture, Pi.xy + o3.xy).a;
-  float perm3zw = texture2D(permTexture, Pi.zw + o3.zw).a;
-  vec4  grad3 = texture2D(gradTexture, vec2(perm3xy, perm3zw)).rgba * 4.0 - 1.0;
-  float t3 = 0.6 - dot(Pf3, Pf3);
-  float n3;
-  if (t3 < 0.0) n3 = 0.0;
-  else {
-    t3 *= t3;
-    n3 = t3 * t3 * dot(grad3, Pf3);
-  }
-  
-  // Noise contribution from last corner
-  vec4 Pf4 = Pf0 - vec4(1.0-4.0*G4);
-  float perm4xy = texture2D(permTexture, Pi.xy + vec2(ONE, ONE)).a;
-  float perm4zw = texture2D(permTexture, Pi.zw + vec2(ONE, ONE)).a;
-  vec4  grad4 = texture2D(gradTexture, vec2(perm4xy, perm4zw)).rgba * 4.0 - 1.0;
-  float t4 = 0.6 - dot(Pf4, Pf4);
-  float n4;
-  if(t4 < 0.0) n4 = 0.0;
-  else {
-    t4 *= t4;
-    n4 = t4 * t4 * dot(grad4, Pf4);
-  }
-
-  // Sum up and scale the result to cover the range [-1,1]
-  return 27.0 * (n0 + n1 + n2 + n3 + n4);
-}
-
-float fbm(vec3 position, int octaves, float frequency, float persistence) {
-	float total = 0.0;
-	float maxAmplitude = 0.0;
-	float amplitude = 1.0;
-	for (int i = 0; i < octaves; i++) {
-		total += snoise(vec4(position * frequency, time)) * amplitude;
-		frequency *= 2.0;
-		maxAmplitude += amplitude;
-		amplitude *= persistence;
-	}
-	return total / maxAmplitude;
-}
-
-vec4 GetColour(in vec3 p)
-{	
-	// octaves = 7;	// broken
-	// octaves = 6;	// distorted
-	// octaves = 5;	// working
-
-	float n1 = fbm(p * 4.0, octavesIn, frequency.x, 0.5);
-	float n2 = fbm(p * 3.14159, octavesIn, frequency.z, 0.5);
-	vec4 color = vec4(texture2D(diffuse, vec2(0.0, (p.y + 1.0) * 0.5) + vec2(n1*0.075,n2*0.075)).xyz, 1.0);
-	return color;
-}
-
-void main(void)
-{
-	// call the GetColour function implemented for this shader type
-	vec4 colour = GetColour(v_texCoord3D);
-	
-	// Hue Shift the colour and store the final result
-	gl_FragColor = colour;
-}
+/*
+ * 4D simplex noise, in a GLSL fragment shader.
+ *
+ * Simplex noise is implemented by the functions:
+ * float snoise(vec4 P)
+ * float snoiseGrad(vec4 P, out vec4 gradient)
+ *
+ * snoiseGrad() also returns the analytic gradient of the noise, summed
+ * from the same five corner contributions. snoise() just drops it, and
+ * the compiler with it.
+ *
+ * By default the hashing uses the permTexture and gradTexture lookup
+ * tables. Define ARITHMETIC_NOISE to use a texture-free variant instead.
+ *
+ * Author: Stefan Gustavson ITN-LiTH (stegu@itn.liu.se) 2004-12-05
+ * Simplex indexing functions by Bill Licea-Kane, ATI
+ */
+ 
+/*
+This code was irrevocably released into the public domain
+by its original author, Stefan Gustavson, in January 2011.
+Please feel free to use it for whatever you want.
+Credit is appreciated where appropriate, and I also
+appreciate being told where this code finds any use,
+but you may do as you like. Alternatively, if you want
+to have a familiar OSI-approved license, you may use
+This code under the terms of the MIT license:
+
+Copyright (C) 2004 by Stefan Gustavson. All rights reserved.
+This code is licensed to you under the terms of the MIT license:
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#version 120
+
+#ifndef ARITHMETIC_NOISE
+uniform sampler2D permTexture;
+uniform sampler2D gradTexture;
+#endif
+uniform sampler2D diffuse; // the vertical colour gradient
+uniform float time; // Used for texture animation
+
+/*
+ * The fbm() parameters are uniforms by default. A specialized build
+ * defines FBM_OCTAVES, FBM_FREQUENCY and FBM_PERSISTENCE instead, which
+ * gives fbm() a constant trip count that the compiler can fully unroll.
+ */
+#ifdef FBM_OCTAVES
+#define octavesIn FBM_OCTAVES
+#else
+uniform int octavesIn;
+#endif
+#ifdef FBM_FREQUENCY
+const vec3 frequency = FBM_FREQUENCY;
+#else
+uniform vec3 frequency;
+#endif
+#ifdef FBM_PERSISTENCE
+#define persistenceIn FBM_PERSISTENCE
+#else
+uniform float persistenceIn;
+#endif
+
+/*
+ * LIT_SHADING lights the surface, bump mapped by the gradient of the
+ * first fbm() that GetColour() computes, from a fixed light direction.
+ */
+#ifdef LIT_SHADING
+const vec3 lightDirection = vec3(0.5773503, 0.5773503, 0.5773503); // Eye space
+const float bumpScale = 0.02;  // Height of the bumps per unit of fbm()
+const float ambient = 0.15;
+#endif
+
+/*
+ * CUBEMAP_BAKE builds the program that bakes GetColour() into the faces
+ * of a cubemap, with cubeface.vert as the vertex shader.
+ *
+ * Multi-pass rendering splits the octaves over several passes.
+ * FBM_ACCUMULATE builds a pass that outputs the raw (n1, n2) sums of
+ * octavesIn octaves, to be added up in a float render target. The first
+ * of them has the amplitude octaveAmplitude and octaveScale times the
+ * base frequency, multiplied up on the CPU the same way fbm() does.
+ * FBM_RESOLVE builds the final pass, which reads the sums back,
+ * normalizes them and does the colour lookup.
+ */
+#ifdef FBM_ACCUMULATE
+uniform float octaveAmplitude;
+uniform float octaveScale;
+#endif
+#ifdef FBM_RESOLVE
+uniform sampler2D accumTexture;
+uniform vec2 accumScale;   // 1.0 / render target size
+uniform float maxAmplitude; // Sum of the amplitudes of all octaves
+#endif
+
+varying vec3 v_texCoord3D;
+
+void simplex( const in vec4 P, out vec4 offset1, out vec4 offset2, out vec4 offset3 )
+{
+  vec4 offset0;
+ 
+  vec3 isX = step( P.yzw, P.xxx );        // See comments in 3D simplex function
+  offset0.x = dot( isX, vec3( 1.0 ) );
+  offset0.yzw = 1.0 - isX;
+
+  vec2 isY = step( P.zw, P.yy );
+  offset0.y += dot( isY, vec2( 1.0 ) );
+  offset0.zw += 1.0 - isY;
+ 
+  float isZ = step( P.w, P.z );
+  offset0.z += isZ;
+  offset0.w += 1.0 - isZ;
+
+  // offset0 now contains the unique values 0,1,2,3 in each channel
+
+  offset3 = clamp(   offset0, 0.0, 1.0 );
+  offset2 = clamp( --offset0, 0.0, 1.0 );
+  offset1 = clamp( --offset0, 0.0, 1.0 );
+}
+
+
+// The skewing and unskewing factors are hairy again for the 4D case
+// This is (sqrt(5.0)-1.0)/4.0
+#define F4 0.309016994375
+// This is (5.0-sqrt(5.0))/20.0
+#define G4 0.138196601125
+
+#ifdef ARITHMETIC_NOISE
+
+/*
+ * Texture-free hashing, as in the later webgl-noise code by Ian McEwan
+ * and Stefan Gustavson. The permutation polynomial (34x^2 + x) mod 289
+ * replaces the perm table, and the gradients are spread over the 4D
+ * cross-polytope arithmetically instead of being read from gradTexture.
+ * This trades 15 dependent texture fetches for about as many ALU ops,
+ * a good deal on llvmpipe and on fetch-starved VLIW GPUs.
+ */
+vec4 mod289(vec4 x) {
+  return x - floor(x * (1.0 / 289.0)) * 289.0;
+}
+
+float mod289(float x) {
+  return x - floor(x * (1.0 / 289.0)) * 289.0;
+}
+
+vec4 permute(vec4 x) {
+  return mod289(((x*34.0)+1.0)*x);
+}
+
+float permute(float x) {
+  return mod289(((x*34.0)+1.0)*x);
+}
+
+vec4 taylorInvSqrt(vec4 r) {
+  return 1.79284291400159 - 0.85373472095314 * r;
+}
+
+float taylorInvSqrt(float r) {
+  return 1.79284291400159 - 0.85373472095314 * r;
+}
+
+vec4 grad4(float j, vec4 ip) {
+  const vec4 ones = vec4(1.0, 1.0, 1.0, -1.0);
+  vec4 p, s;
+
+  p.xyz = floor( fract( vec3(j) * ip.xyz ) * 7.0 ) * ip.z - 1.0;
+  p.w = 1.5 - dot( abs(p.xyz), ones.xyz );
+  s = vec4( lessThan(p, vec4(0.0)) );
+  p.xyz = p.xyz + (s.xyz*2.0 - 1.0) * s.www;
+  return p;
+}
+
+/*
+ * 4D simplex noise without lookup textures. The skewing and the simplex
+ * traversal are the same as below, only the hashing differs, so the
+ * pattern has the same character but not the same values.
+ */
+float snoiseGrad(const in vec4 P, out vec4 gradient) {
+  const vec4 ip = vec4(1.0/294.0, 1.0/49.0, 1.0/7.0, 0.0);
+
+  // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+  float s = (P.x + P.y + P.z + P.w) * F4;
+  vec4 Pi = floor(P + s);
+  float t = (Pi.x + Pi.y + Pi.z + Pi.w) * G4;
+  vec4 Pf0 = P - (Pi - t); // The distances from the unskewed cell origin
+
+  vec4 o1;
+  vec4 o2;
+  vec4 o3;
+  simplex(Pf0, o1, o2, o3);
+
+  vec4 Pf1 = Pf0 - o1 + G4;
+  vec4 Pf2 = Pf0 - o2 + 2.0 * G4;
+  vec4 Pf3 = Pf0 - o3 + 3.0 * G4;
+  vec4 Pf4 = Pf0 - vec4(1.0-4.0*G4);
+
+  // Hash the five corners, the last four side by side in a vec4
+  Pi = mod289(Pi);
+  float j0 = permute( permute( permute( permute(Pi.w) + Pi.z) + Pi.y) + Pi.x);
+  vec4 j1 = permute( permute( permute( permute (
+             Pi.w + vec4(o1.w, o2.w, o3.w, 1.0 ))
+           + Pi.z + vec4(o1.z, o2.z, o3.z, 1.0 ))
+           + Pi.y + vec4(o1.y, o2.y, o3.y, 1.0 ))
+           + Pi.x + vec4(o1.x, o2.x, o3.x, 1.0 ));
+
+  vec4 g0 = grad4(j0,   ip);
+  vec4 g1 = grad4(j1.x, ip);
+  vec4 g2 = grad4(j1.y, ip);
+  vec4 g3 = grad4(j1.z, ip);
+  vec4 g4 = grad4(j1.w, ip);
+
+  // Normalise the gradients
+  vec4 norm = taylorInvSqrt(vec4(dot(g0,g0), dot(g1,g1), dot(g2,g2), dot(g3,g3)));
+  g0 *= norm.x;
+  g1 *= norm.y;
+  g2 *= norm.z;
+  g3 *= norm.w;
+  g4 *= taylorInvSqrt(dot(g4,g4));
+
+  // Mix the contributions from the five corners
+  vec3 m0 = max(0.6 - vec3(dot(Pf0,Pf0), dot(Pf1,Pf1), dot(Pf2,Pf2)), 0.0);
+  vec2 m1 = max(0.6 - vec2(dot(Pf3,Pf3), dot(Pf4,Pf4)), 0.0);
+  vec3 m02 = m0 * m0;
+  vec2 m12 = m1 * m1;
+  vec3 m04 = m02 * m02;
+  vec2 m14 = m12 * m12;
+  vec3 gdot0 = vec3( dot( g0, Pf0 ), dot( g1, Pf1 ), dot( g2, Pf2 ) );
+  vec2 gdot1 = vec2( dot( g3, Pf3 ), dot( g4, Pf4 ) );
+
+  // Each corner adds m^4 (g.Pf), whose gradient is m^4 g - 8 m^3 (g.Pf) Pf
+  vec3 temp0 = m02 * m0 * gdot0;
+  vec2 temp1 = m12 * m1 * gdot1;
+  gradient = m04.x * g0 + m04.y * g1 + m04.z * g2 + m14.x * g3 + m14.y * g4
+           - 8.0 * (temp0.x * Pf0 + temp0.y * Pf1 + temp0.z * Pf2 + temp1.x * Pf3 + temp1.y * Pf4);
+  gradient *= 49.0;
+  return 49.0 * ( dot(m04, gdot0) + dot(m14, gdot1) ) ;
+}
+
+#else
+
+/*
+ * To create offsets of one texel and one half texel in the
+ * texture lookup, we need to know the texture image size.
+ */
+#define ONE 0.00390625
+#define ONEHALF 0.001953125
+// The numbers above are 1/256 and 0.5/256, change accordingly
+// if you change the code to use another perm/grad texture size.
+
+/*
+ * contribution(grad, Pf, gradient) - the contribution of one simplex
+ * corner, with gradient grad, at offset Pf from the point. With
+ * t = 0.6 - |Pf|^2 that is t^4 (grad.Pf), whose own gradient
+ * t^4 grad - 8 t^3 (grad.Pf) Pf is added to gradient.
+ */
+float contribution(const in vec4 grad, const in vec4 Pf, inout vec4 gradient) {
+  float t = 0.6 - dot(Pf, Pf);
+  if (t < 0.0) return 0.0;
+  float t2 = t * t;
+  float n = dot(grad, Pf);
+  gradient += t2 * t2 * grad - 8.0 * t2 * t * n * Pf;
+  return t2 * t2 * n;
+}
+
+/*
+ * 4D simplex noise. A lot faster than classic 4D noise, and better looking.
+ */
+
+float snoiseGrad(const in vec4 P, out vec4 gradient) {
+
+  // Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+ 	float s = (P.x + P.y + P.z + P.w) * F4; // Factor for 4D skewing
+  vec4 Pi = floor(P + s);
+  float t = (Pi.x + Pi.y + Pi.z + Pi.w) * G4;
+  vec4 P0 = Pi - t; // Unskew the cell origin back to (x,y,z,w) space
+  Pi = Pi * ONE + ONEHALF; // Integer part, scaled and offset for texture lookup
+
+  vec4 Pf0 = P - P0;  // The x,y distances from the cell origin
+
+  // For the 4D case, the simplex is a 4D shape I won't even try to describe.
+  // To find out which of the 24 possible simplices we're in, we need to
+  // determine the magnitude ordering of x, y, z and w components of Pf0.
+  vec4 o1;
+  vec4 o2;
+  vec4 o3;
+  simplex(Pf0, o1, o2, o3);  
+
+  // Noise contribution from simplex origin
+  gradient = vec4(0.0);
+  float perm0xy = texture2D(permTexture, Pi.xy).a;
+  float perm0zw = texture2D(permTexture, Pi.zw).a;
+  vec4  grad0 = texture2D(gradTexture, vec2(perm0xy, perm0zw)).rgba * 4.0 - 1.0;
+  float n0 = contribution(grad0, Pf0, gradient);
+
+  // Noise contribution from second corner
+  vec4 Pf1 = Pf0 - o1 + G4;
+  o1 = o1 * ONE;
+  float perm1xy = texture2D(permTexture, Pi.xy + o1.xy).a;
+  float perm1zw = texture2D(permTexture, Pi.zw + o1.zw).a;
+  vec4  grad1 = texture2D(gradTexture, vec2(perm1xy, perm1zw)).rgba * 4.0 - 1.0;
+  float n1 = contribution(grad1, Pf1, gradient);
+  
+  // Noise contribution from third corner
+  vec4 Pf2 = Pf0 - o2 + 2.0 * G4;
+  o2 = o2 * ONE;
+  float perm2xy = texture2D(permTexture, Pi.xy + o2.xy).a;
+  float perm2zw = texture2D(permTexture, Pi.zw + o2.zw).a;
+  vec4  grad2 = texture2D(gradTexture, vec2(perm2xy, perm2zw)).rgba * 4.0 - 1.0;
+  float n2 = contribution(grad2, Pf2, gradient);
+  
+  // Noise contribution from fourth corner
+  vec4 Pf3 = Pf0 - o3 + 3.0 * G4;
+  o3 = o3 * ONE;
+  float perm3xy = texture2D(permTexture, Pi.xy + o3.xy).a;
+  float perm3zw = texture2D(permTexture, Pi.zw + o3.zw).a;
+  vec4  grad3 = texture2D(gradTexture, vec2(perm3xy, perm3zw)).rgba * 4.0 - 1.0;
+  float n3 = contribution(grad3, Pf3, gradient);
+  
+  // Noise contribution from last corner
+  vec4 Pf4 = Pf0 - vec4(1.0-4.0*G4);
+  float perm4xy = texture2D(permTexture, Pi.xy + vec2(ONE, ONE)).a;
+  float perm4zw = texture2D(permTexture, Pi.zw + vec2(ONE, ONE)).a;
+  vec4  grad4 = texture2D(gradTexture, vec2(perm4xy, perm4zw)).rgba * 4.0 - 1.0;
+  float n4 = contribution(grad4, Pf4, gradient);
+
+  // Sum up and scale the result to cover the range [-1,1]
+  gradient *= 27.0;
+  return 27.0 * (n0 + n1 + n2 + n3 + n4);
+}
+
+#endif
+
+float snoise(const in vec4 P) {
+  vec4 gradient;
+  return snoiseGrad(P, gradient);
+}
+
+float fbm(vec3 position, int octaves, float frequency, float persistence) {
+	float total = 0.0;
+	float maxAmplitude = 0.0;
+	float amplitude = 1.0;
+	for (int i = 0; i < octaves; i++) {
+		total += snoise(vec4(position * frequency, time)) * amplitude;
+		frequency *= 2.0;
+		maxAmplitude += amplitude;
+		amplitude *= persistence;
+	}
+	return total / maxAmplitude;
+}
+
+#ifdef LIT_SHADING
+/*
+ * fbm() and its gradient with respect to position. Each octave's noise
+ * gradient is scaled by its amplitude and, for the chain rule, its
+ * frequency.
+ */
+float fbmGrad(vec3 position, int octaves, float frequency, float persistence, out vec3 gradient) {
+	float total = 0.0;
+	float maxAmplitude = 0.0;
+	float amplitude = 1.0;
+	vec4 d;
+	gradient = vec3(0.0);
+	for (int i = 0; i < octaves; i++) {
+		total += snoiseGrad(vec4(position * frequency, time), d) * amplitude;
+		gradient += d.xyz * (amplitude * frequency);
+		frequency *= 2.0;
+		maxAmplitude += amplitude;
+		amplitude *= persistence;
+	}
+	gradient /= maxAmplitude;
+	return total / maxAmplitude;
+}
+#endif
+
+/*
+ * The weighted sum of a band of octaves of fbm(), starting at amplitude
+ * and scale times the base frequency, without the normalization. Adding
+ * up the bands gives fbm() * maxAmplitude, up to rounding.
+ */
+float fbmBand(vec3 position, float amplitude, float scale, int octaves, float frequency, float persistence) {
+	float total = 0.0;
+	frequency *= scale;
+	for (int i = 0; i < octaves; i++) {
+		total += snoise(vec4(position * frequency, time)) * amplitude;
+		frequency *= 2.0;
+		amplitude *= persistence;
+	}
+	return total;
+}
+
+// Look up the colour ramp, displaced by the two fbm values
+vec4 Colourize(in vec3 p, float n1, float n2)
+{
+	return vec4(texture2D(diffuse, vec2(0.0, (p.y + 1.0) * 0.5) + vec2(n1*0.075,n2*0.075)).xyz, 1.0);
+}
+
+#ifdef LIT_SHADING
+/*
+ * Light(p, height) - the diffuse lighting at p on the unit sphere, with
+ * the surface raised by bumpScale times a height field whose gradient
+ * is height. Only the part of the gradient along the surface tilts it.
+ */
+float Light(in vec3 p, in vec3 height)
+{
+	vec3 normal = normalize(p);
+	normal = normalize(normal - bumpScale * (height - dot(height, normal) * normal));
+	normal = normalize(gl_NormalMatrix * normal);
+	return ambient + (1.0 - ambient) * max(dot(normal, lightDirection), 0.0);
+}
+#endif
+
+vec4 GetColour(in vec3 p)
+{	
+	// octaves = 7;	// broken
+	// octaves = 6;	// distorted
+	// octaves = 5;	// working
+
+#ifdef LIT_SHADING
+	vec3 g1;
+	float n1 = fbmGrad(p * 4.0, octavesIn, frequency.x, persistenceIn, g1);
+	float n2 = fbm(p * 3.14159, octavesIn, frequency.z, persistenceIn);
+	vec4 colour = Colourize(p, n1, n2);
+	colour.rgb *= Light(p, g1 * 4.0);
+	return colour;
+#else
+	float n1 = fbm(p * 4.0, octavesIn, frequency.x, persistenceIn);
+	float n2 = fbm(p * 3.14159, octavesIn, frequency.z, persistenceIn);
+	return Colourize(p, n1, n2);
+#endif
+}
+
+void main(void)
+{
+#if defined(FBM_ACCUMULATE)
+	// One band of octaves, added to the previous ones by blending
+	gl_FragColor = vec4(fbmBand(v_texCoord3D * 4.0, octaveAmplitude, octaveScale, octavesIn, frequency.x, persistenceIn),
+	                    fbmBand(v_texCoord3D * 3.14159, octaveAmplitude, octaveScale, octavesIn, frequency.z, persistenceIn),
+	                    0.0, 0.0);
+#elif defined(FBM_RESOLVE)
+	// Colour the accumulated octaves
+	vec2 n = texture2D(accumTexture, gl_FragCoord.xy * accumScale).xy / maxAmplitude;
+	gl_FragColor = Colourize(v_texCoord3D, n.x, n.y);
+#elif defined(CUBEMAP_BAKE)
+	// Baking a cubemap face: v_texCoord3D is a cube direction, not a normal
+	gl_FragColor = GetColour(normalize(v_texCoord3D));
+#else
+	// call the GetColour function implemented for this shader type
+	vec4 colour = GetColour(v_texCoord3D);
+	
+	// Hue Shift the colour and store the final result
+	gl_FragColor = colour;
+#endif
+}
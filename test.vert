@@ -1,9 +1,13 @@
-#version 120
-
-varying vec3 v_texCoord3D;
-
-void main( void )
-{
-	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
-    v_texCoord3D = gl_Normal.xyz;
-}
+#version 120
+
+varying vec3 v_texCoord3D;
+
+// Multi-pass rendering draws the sphere with several programs and
+// relies on them all producing exactly the same depth.
+invariant gl_Position;
+
+void main( void )
+{
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    v_texCoord3D = gl_Normal.xyz;
+}